@@ -0,0 +1,31 @@
+#include "ActionScheduler.h"
+
+namespace AMM {
+    void ActionScheduler::Schedule(double simTime, std::shared_ptr<const biogears::SEAction> action) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.push(Entry{simTime, m_sequence++, std::move(action)});
+    }
+
+    void ActionScheduler::TakeDue(double simTime, std::vector<std::shared_ptr<const biogears::SEAction>> &due) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        while (!m_queue.empty() && m_queue.top().simTime <= simTime) {
+            due.push_back(m_queue.top().action);
+            m_queue.pop();
+        }
+    }
+
+    void ActionScheduler::Clear() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue = decltype(m_queue)();
+    }
+
+    size_t ActionScheduler::GetPendingCount() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_queue.size();
+    }
+
+    double ActionScheduler::GetNextTime() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_queue.empty() ? -1.0 : m_queue.top().simTime;
+    }
+}
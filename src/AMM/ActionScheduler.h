@@ -0,0 +1,46 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <vector>
+
+#include <biogears/cdm/scenario/SEAction.h>
+
+namespace AMM {
+    // Scenario actions waiting for a future simulation time.  Scenarios are
+    // scheduled from the command thread and the engine thread takes whatever
+    // is due before each tick; actions due at the same time keep their order.
+    class ActionScheduler {
+    public:
+        // Holds the action until it is taken.
+        void Schedule(double simTime, std::shared_ptr<const biogears::SEAction> action);
+
+        // Appends the actions due at or before simTime, earliest first.
+        void TakeDue(double simTime, std::vector<std::shared_ptr<const biogears::SEAction>> &due);
+
+        void Clear();
+
+        size_t GetPendingCount();
+
+        // Simulation time of the earliest pending action, or a negative value when there is none
+        double GetNextTime();
+
+    private:
+        struct Entry {
+            double simTime;
+            uint64_t sequence;
+            std::shared_ptr<const biogears::SEAction> action;
+        };
+
+        struct Later {
+            bool operator()(const Entry &a, const Entry &b) const {
+                return a.simTime != b.simTime ? a.simTime > b.simTime : a.sequence > b.sequence;
+            }
+        };
+
+        std::priority_queue<Entry, std::vector<Entry>, Later> m_queue;
+        uint64_t m_sequence = 0;
+        std::mutex m_mutex;
+    };
+}
@@ -0,0 +1,157 @@
+#include "AlarmEngine.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "tinyxml2.h"
+
+#include "amm/BaseLogger.h"
+
+namespace AMM {
+    bool AlarmEngine::LoadRules(const std::string &file, std::vector<Rule> &rules) {
+        tinyxml2::XMLDocument doc;
+        if (doc.LoadFile(file.c_str()) != tinyxml2::XML_SUCCESS) {
+            LOG_ERROR << "Unable to load alarm rules from " << file;
+            return false;
+        }
+
+        tinyxml2::XMLElement *root = doc.FirstChildElement("AlarmRules");
+        if (root == nullptr) {
+            LOG_ERROR << "No AlarmRules element in " << file;
+            return false;
+        }
+
+        rules.clear();
+        for (tinyxml2::XMLElement *element = root->FirstChildElement("Rule");
+             element != nullptr; element = element->NextSiblingElement("Rule")) {
+            Rule rule;
+            const char *name = element->Attribute("name");
+            const char *node = element->Attribute("node");
+            if (name == nullptr || node == nullptr) {
+                LOG_WARNING << "Skipping alarm rule without a name and node";
+                continue;
+            }
+            rule.name = name;
+            rule.node = node;
+
+            if (element->Attribute("above") != nullptr) {
+                rule.above = true;
+                rule.threshold = element->DoubleAttribute("above");
+            } else if (element->Attribute("below") != nullptr) {
+                rule.above = false;
+                rule.threshold = element->DoubleAttribute("below");
+            } else {
+                LOG_WARNING << "Skipping alarm rule " << rule.name << " without an above or below threshold";
+                continue;
+            }
+            rule.clear = element->DoubleAttribute("clear", rule.threshold);
+            rule.duration = element->DoubleAttribute("duration", 0.0);
+            rules.push_back(rule);
+        }
+
+        LOG_INFO << "Loaded " << rules.size() << " alarm rules from " << file;
+        return true;
+    }
+
+    void AlarmEngine::Configure(const std::vector<Rule> &rules, const std::vector<int> &indices, double tickSeconds) {
+        m_rules = rules;
+        m_indices = indices;
+
+        size_t count = m_rules.size();
+        m_sign.resize(count);
+        m_threshold.resize(count);
+        m_clear.resize(count);
+        m_durationTicks.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            const Rule &rule = m_rules[i];
+            m_sign[i] = rule.above ? 1.0 : -1.0;
+            m_threshold[i] = m_sign[i] * rule.threshold;
+            m_clear[i] = m_sign[i] * rule.clear;
+            m_durationTicks[i] = tickSeconds > 0.0
+                                 ? std::max(1, static_cast<int32_t>(std::ceil(rule.duration / tickSeconds))) : 1;
+        }
+
+        m_values.resize(count);
+        m_heldTicks.resize(count);
+        m_active.resize(count);
+        m_changed.resize(count);
+        std::fill(m_heldTicks.begin(), m_heldTicks.end(), 0);
+        std::fill(m_active.begin(), m_active.end(), 0);
+        m_transitions.clear();
+    }
+
+    void AlarmEngine::Reset(double simTime) {
+        for (size_t i = 0; i < m_rules.size(); ++i) {
+            if (m_active[i]) {
+                Transition transition;
+                transition.name = m_rules[i].name;
+                transition.node = m_rules[i].node;
+                transition.active = false;
+                transition.value = m_sign[i] * m_values[i];
+                transition.simTime = simTime;
+                m_transitions.push_back(transition);
+            }
+        }
+        std::fill(m_heldTicks.begin(), m_heldTicks.end(), 0);
+        std::fill(m_active.begin(), m_active.end(), 0);
+    }
+
+    bool AlarmEngine::IsEnabled() const {
+        return !m_rules.empty();
+    }
+
+    void AlarmEngine::Evaluate(const std::vector<double> &snapshot, double simTime) {
+        const size_t count = m_rules.size();
+        if (count == 0) {
+            return;
+        }
+
+        // Gather then compare; the loops below have no branches to vectorize around
+        for (size_t i = 0; i < count; ++i) {
+            m_values[i] = m_sign[i] * snapshot[m_indices[i]];
+        }
+
+        const double *value = m_values.data();
+        const double *threshold = m_threshold.data();
+        const double *clear = m_clear.data();
+        const int32_t *duration = m_durationTicks.data();
+        int32_t *held = m_heldTicks.data();
+        uint8_t *active = m_active.data();
+        uint8_t *changed = m_changed.data();
+        uint8_t any = 0;
+        for (size_t i = 0; i < count; ++i) {
+            int32_t beyond = value[i] > threshold[i];
+            held[i] = (held[i] + 1) * beyond;
+            uint8_t raise = !active[i] & (held[i] >= duration[i]);
+            uint8_t lower = active[i] & (value[i] < clear[i]);
+            changed[i] = raise | lower;
+            active[i] ^= changed[i];
+            any |= changed[i];
+        }
+
+        if (!any) {
+            return;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            if (!changed[i]) {
+                continue;
+            }
+            Transition transition;
+            transition.name = m_rules[i].name;
+            transition.node = m_rules[i].node;
+            transition.active = active[i] != 0;
+            transition.value = m_sign[i] * value[i];
+            transition.simTime = simTime;
+            m_transitions.push_back(transition);
+        }
+    }
+
+    void AlarmEngine::TakeTransitions(std::vector<Transition> &transitions) {
+        transitions.clear();
+        transitions.swap(m_transitions);
+    }
+
+    size_t AlarmEngine::GetActiveCount() const {
+        return static_cast<size_t>(std::count(m_active.begin(), m_active.end(), 1));
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace AMM {
+    // Threshold alarms over the node snapshot, evaluated every tick.  Rules
+    // are flattened into parallel arrays so each tick is a handful of
+    // branch-free loops over all rules; only rules that change state do any
+    // further work.
+    class AlarmEngine {
+    public:
+        // Raised when node goes above (or below) threshold for at least
+        // duration seconds; cleared once it is back past clear.
+        struct Rule {
+            std::string name;
+            std::string node;
+            bool above = false;
+            double threshold = 0.0;
+            double clear = 0.0;
+            double duration = 0.0;
+        };
+
+        struct Transition {
+            std::string name;
+            std::string node;
+            bool active = false;
+            double value = 0.0;
+            double simTime = 0.0;
+        };
+
+        // Reads <AlarmRules><Rule name node above|below [clear] [duration]/></AlarmRules>
+        static bool LoadRules(const std::string &file, std::vector<Rule> &rules);
+
+        // indices are the snapshot positions of each rule's node.
+        void Configure(const std::vector<Rule> &rules, const std::vector<int> &indices, double tickSeconds);
+
+        // Every alarm back to inactive; the active ones are reported cleared at simTime.
+        void Reset(double simTime);
+
+        bool IsEnabled() const;
+
+        void Evaluate(const std::vector<double> &snapshot, double simTime);
+
+        // Moves the transitions since the last call into transitions.
+        void TakeTransitions(std::vector<Transition> &transitions);
+
+        size_t GetActiveCount() const;
+
+    private:
+        std::vector<Rule> m_rules;
+        std::vector<int> m_indices;
+
+        // +1 for above, -1 for below, so every comparison is a greater-than
+        std::vector<double> m_sign;
+        std::vector<double> m_threshold;
+        std::vector<double> m_clear;
+        std::vector<int32_t> m_durationTicks;
+
+        std::vector<double> m_values;
+        std::vector<int32_t> m_heldTicks;
+        std::vector<uint8_t> m_active;
+        std::vector<uint8_t> m_changed;
+
+        std::vector<Transition> m_transitions;
+    };
+}
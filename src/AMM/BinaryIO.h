@@ -0,0 +1,46 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+
+namespace AMM {
+    // Native-endian values and length-prefixed strings, as the journal, the
+    // columnar recorder, state archives and migration frames store them.
+    template<typename T>
+    void WriteValue(std::ostream &out, const T &value) {
+        out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    template<typename T>
+    bool ReadValue(std::istream &in, T &value) {
+        return static_cast<bool>(in.read(reinterpret_cast<char *>(&value), sizeof(T)));
+    }
+
+    inline void WriteString(std::ostream &out, const std::string &value) {
+        WriteValue(out, static_cast<uint32_t>(value.size()));
+        out.write(value.data(), value.size());
+    }
+
+    // False past maxSize or the end of the stream.  Grows the string as bytes
+    // arrive, so a corrupt length costs no more than what is actually there.
+    inline bool ReadString(std::istream &in, std::string &value, uint32_t maxSize = UINT32_MAX) {
+        const uint32_t Chunk = 64 * 1024;
+        uint32_t size = 0;
+        if (!ReadValue(in, size) || size > maxSize) {
+            return false;
+        }
+        value.clear();
+        while (value.size() < size) {
+            size_t offset = value.size();
+            size_t length = std::min<size_t>(size - offset, Chunk);
+            value.resize(offset + length);
+            if (!in.read(&value[offset], length)) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
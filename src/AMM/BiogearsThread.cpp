@@ -1,72 +1,53 @@
 #include "BiogearsThread.h"
 
+#include <unistd.h>
+
 using namespace biogears;
 
 namespace AMM {
+    namespace {
+        // Inputs begun on this thread; an advance made by an input never waits on itself
+        thread_local int ownInputs = 0;
+
+        // How far ahead of the engine a live scenario's actions are scheduled, in simulated seconds
+        const double LiveScenarioHorizon = 30.0;
+    }
+
+    // Runs inside AdvanceModelTime; every transition goes to the thread's
+    // event ring and is published from there.
     class EventHandler : public SEEventHandler {
     public:
-        // State flags
-        bool irreversible = false;
-        bool startOfExhale = false;
-        bool startOfInhale = false;
-
-        EventHandler(Logger *logger) : SEEventHandler() {}
+        explicit EventHandler(BiogearsThread *thread) : SEEventHandler(), m_thread(thread) {}
 
         virtual void HandleAnesthesiaMachineEvent(CDM::enumAnesthesiaMachineEvent::value type, bool active,
-                                                  const SEScalarTime *time = nullptr) {}
+                                                  const SEScalarTime *time = nullptr) {
+            m_thread->QueueEvent(PhysiologyEvent::ANESTHESIA_MACHINE, type, active, time);
+        }
 
         virtual void
         HandlePatientEvent(CDM::enumPatientEvent::value type, bool active, const SEScalarTime *time = nullptr) {
-            if (active) {
-                switch (type) {
-                    case CDM::enumPatientEvent::IrreversibleState:
-                        LOG_INFO << " Patient has entered irreversible state";
-                        irreversible = true;
-                        break;
-                    case CDM::enumPatientEvent::StartOfCardiacCycle:
-                        break;
-                    case CDM::enumPatientEvent::StartOfExhale:
-                        startOfExhale = true;
-                        startOfInhale = false;
-                        break;
-                    case CDM::enumPatientEvent::StartOfInhale:
-                        startOfInhale = true;
-                        startOfExhale = false;
-                        break;
-                    default:
-                        LOG_INFO << " Patient has entered state : " << type;
-                        break;
-                }
-            } else {
-                switch (type) {
-                    case CDM::enumPatientEvent::StartOfCardiacCycle:
-                        break;
-                    case CDM::enumPatientEvent::StartOfExhale:
-                        startOfExhale = false;
-                        break;
-                    case CDM::enumPatientEvent::StartOfInhale:
-                        startOfInhale = false;
-                        break;
-                    default:
-                        LOG_INFO << " Patient has exited state : " << type;
-                        break;
-                }
-            }
+            m_thread->QueueEvent(PhysiologyEvent::PATIENT, type, active, time);
         }
+
+    private:
+        BiogearsThread *m_thread;
     };
 
     std::vector <std::string> BiogearsThread::highFrequencyNodes;
+    std::map<std::string, std::vector<std::string>> BiogearsThread::nodeDependencies;
     std::map<std::string, double (BiogearsThread::*)()> BiogearsThread::nodePathTable;
 
     BiogearsThread::BiogearsThread(const std::string &logFile) {
         try {
-            m_pe = biogears::CreateBioGearsEngine("biogears.log");
+            m_pe = biogears::CreateBioGearsEngine(logFile);
         }
         catch (std::exception &e) {
             LOG_ERROR << "Error starting engine: " << e.what();
         }
 
-        PopulateNodePathTable();
+        // The table is shared, so a second engine must not rebuild it under a running one
+        static std::once_flag nodePathTableBuilt;
+        std::call_once(nodePathTableBuilt, [this] { PopulateNodePathTable(); });
 
         running = false;
     }
@@ -74,6 +55,7 @@ namespace AMM {
     BiogearsThread::~BiogearsThread() {
         running = false;
         m_pe = nullptr;
+        delete myEventHandler;
         std::this_thread::sleep_for(std::chrono::milliseconds(100));
     }
 
@@ -140,6 +122,14 @@ namespace AMM {
         nodePathTable["Respiratory_LeftLung_Tidal_Volume"] = &BiogearsThread::GetLeftLungTidalVolume;
         nodePathTable["Respiratory_RightLung_Tidal_Volume"] =
                 &BiogearsThread::GetRightLungTidalVolume;
+        nodePathTable["Respiratory_LeftLung_ChestRise_Percent"] = &BiogearsThread::GetLeftLungChestRise;
+        nodePathTable["Respiratory_RightLung_ChestRise_Percent"] = &BiogearsThread::GetRightLungChestRise;
+        nodePathTable["Respiratory_LeftLung_IE_Ratio"] = &BiogearsThread::GetLeftLungIERatio;
+        nodePathTable["Respiratory_RightLung_IE_Ratio"] = &BiogearsThread::GetRightLungIERatio;
+        nodePathTable["Respiratory_LeftLung_Minute_Ventilation"] =
+                &BiogearsThread::GetLeftLungMinuteVentilation;
+        nodePathTable["Respiratory_RightLung_Minute_Ventilation"] =
+                &BiogearsThread::GetRightLungMinuteVentilation;
 
         nodePathTable["Respiratory_PulmonaryResistance"] = &BiogearsThread::GetPulmonaryResistance;
 
@@ -234,6 +224,14 @@ namespace AMM {
                               "Respiratory_CarbonDioxide_Exhaled",
                               "Respiratory_LungTotal_Volume",
                               "Respiratory_Respiration_Rate"};
+
+        nodeDependencies.clear();
+        nodeDependencies["Cardiovascular_BloodLossPercentage"] = {"Cardiovascular_BloodVolume"};
+        nodeDependencies["Respiratory_Respiration_Rate_MOD"] = {"Respiratory_Respiration_Rate_RAW",
+                                                                "Cardiovascular_BloodLossPercentage"};
+        nodeDependencies["Substance_Lactate_Concentration_mmol"] = {"Substance_Lactate_Concentration"};
+        nodeDependencies["BloodChemistry_BloodPH_MOD"] = {"Substance_Lactate_Concentration_mmol"};
+        nodeDependencies["BloodChemistry_BloodPH"] = {"Substance_Lactate_Concentration_mmol"};
     }
 
     double BiogearsThread::GetLoggingStatus() {
@@ -249,7 +247,13 @@ namespace AMM {
     }
 
     void BiogearsThread::Shutdown() {
+        m_mutex.lock();
+        recorder.Stop();
+        m_mutex.unlock();
 
+        // Queued saves finish first; the completion callbacks may need the engine lock
+        stateWriter.Stop();
+        checkpoints.Stop();
     }
 
     void BiogearsThread::StartSimulation() {
@@ -264,31 +268,8 @@ namespace AMM {
         }
     }
 
-    bool BiogearsThread::LoadPatient(const std::string &patientFile) {
-        if (m_pe == nullptr) {
-            LOG_ERROR << "Unable to load state, Biogears has not been initialized.";
-            return false;
-        }
-
-        LOG_INFO << "Loading patient file " << patientFile;
-        m_mutex.lock();
-        try {
-            if (!m_pe->InitializeEngine(patientFile)) {
-                LOG_ERROR << "Error loading patient";
-                m_mutex.unlock();
-                return false;
-            }
-        }
-        catch (std::exception &e) {
-            LOG_ERROR << "Exception loading patient: " << e.what();
-            m_mutex.unlock();
-            return false;
-        }
-        m_mutex.unlock();
-
-        LOG_DEBUG << "Preloading substances";
+    void BiogearsThread::PreloadSubstances() {
         // preload substances
-        m_mutex.lock();
         sodium = m_pe->GetSubstanceManager().GetSubstance("Sodium");
         glucose = m_pe->GetSubstanceManager().GetSubstance("Glucose");
         creatinine = m_pe->GetSubstanceManager().GetSubstance("Creatinine");
@@ -315,71 +296,51 @@ namespace AMM {
         rightLung = m_pe->GetCompartments().GetGasCompartment(BGE::PulmonaryCompartment::RightLung);
         bladder = m_pe->GetCompartments().GetLiquidCompartment(BGE::UrineCompartment::Bladder);
 
-        // m_patient = m_pe->GetPatient();
-
-        m_mutex.unlock();
+        leftBreaths.Reset();
+        rightBreaths.Reset();
+        trends.Clear();
+        ++engineStep;
 
-        startingBloodVolume = 5400.00;
-        currentBloodVolume = startingBloodVolume;
+        // Handles into the old engine state; resolved again on next use
+        for (auto &node : substanceNodes) {
+            node.substance = nullptr;
+            node.compartment = nullptr;
+            node.quantity = nullptr;
+        }
+        alarms.Reset(m_pe->GetSimulationTime(TimeUnit::s));
+    }
 
-        if (logging_enabled) {
-            std::string logFilename = Utility::getTimestampedFilename("./logs/AMM_Output_", ".csv");
-            LOG_INFO << "Initializing log file: " << logFilename;
-
-            std::fstream fs;
-            fs.open(logFilename, std::ios::out);
-            fs.close();
-
-            m_pe->GetEngineTrack()->GetDataRequestManager().Clear();
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                    "HeartRate", biogears::FrequencyUnit::Per_min);
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                    "MeanArterialPressure", biogears::PressureUnit::mmHg);
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                    "SystolicArterialPressure", biogears::PressureUnit::mmHg);
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                    "DiastolicArterialPressure", biogears::PressureUnit::mmHg);
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                    "RespirationRate", biogears::FrequencyUnit::Per_min);
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                    "TidalVolume", biogears::VolumeUnit::mL);
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                    "TotalLungVolume", biogears::VolumeUnit::mL);
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreateGasCompartmentDataRequest().Set(
-                    BGE::PulmonaryCompartment::LeftLung, "Volume");
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreateGasCompartmentDataRequest().Set(
-                    BGE::PulmonaryCompartment::RightLung, "Volume");
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                    "OxygenSaturation");
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreateGasCompartmentDataRequest().Set(
-                    BGE::PulmonaryCompartment::Trachea, "InFlow");
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                    "BloodVolume", biogears::VolumeUnit::mL);
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                    "ArterialBloodPH");
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreateSubstanceDataRequest().Set(
-                    *lactate, "BloodConcentration", biogears::MassPerVolumeUnit::ug_Per_mL);
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                    "UrineProductionRate", biogears::VolumePerTimeUnit::mL_Per_min);
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreateGasCompartmentDataRequest().Set(
-                    BGE::PulmonaryCompartment::Trachea, *O2, "PartialPressure");
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreateGasCompartmentDataRequest().Set(
-                    BGE::PulmonaryCompartment::Trachea, *CO2, "PartialPressure");
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreateGasCompartmentDataRequest().Set(
-                    BGE::PulmonaryCompartment::Trachea, "Pressure", biogears::PressureUnit::cmH2O);
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                    "BaseExcess", biogears::AmountPerVolumeUnit::mmol_Per_L);
-            m_pe->GetEngineTrack()->GetDataRequestManager().SetResultsFilename(logFilename);
+    bool BiogearsThread::LoadPatient(const std::string &patientFile) {
+        if (m_pe == nullptr) {
+            LOG_ERROR << "Unable to load state, Biogears has not been initialized.";
+            return false;
         }
 
+        LOG_INFO << "Loading patient file " << patientFile;
+        m_mutex.lock();
         try {
-            LOG_DEBUG << "Attaching event handler";
-            myEventHandler = new EventHandler(m_pe->GetLogger());
-            m_pe->SetEventHandler(myEventHandler);
-        } catch (std::exception &e) {
-            LOG_ERROR << "Error attaching event handler: " << e.what();
+            if (!m_pe->InitializeEngine(patientFile)) {
+                LOG_ERROR << "Error loading patient";
+                m_mutex.unlock();
+                return false;
+            }
+        }
+        catch (std::exception &e) {
+            LOG_ERROR << "Exception loading patient: " << e.what();
+            m_mutex.unlock();
+            return false;
         }
+        m_mutex.unlock();
 
+        LOG_DEBUG << "Preloading substances";
+        m_mutex.lock();
+        PreloadSubstances();
+        m_mutex.unlock();
+        checkpoints.Clear();
+
+        startingBloodVolume = 5400.00;
+        currentBloodVolume = startingBloodVolume;
+        AttachEngine();
         return true;
     }
 
@@ -395,8 +356,21 @@ namespace AMM {
         LOG_INFO << "Loading state file " << stateFile << " at position " << sec << " seconds";
         m_mutex.lock();
         try {
+            // Prefer the binary archive when it was made from this exact state file
+            bool loaded = false;
+            std::string archiveFile = StateArchive::ArchivePath(stateFile);
+            if (StateArchive::IsCurrent(archiveFile, stateFile)) {
+                std::unique_ptr<CDM::PhysiologyEngineStateData> state = StateArchive::Load(archiveFile);
+                if (state != nullptr) {
+                    LOG_INFO << "Loading binary state archive " << archiveFile;
+                    loaded = m_pe->LoadState(*state, startTime);
+                }
+                if (!loaded) {
+                    LOG_WARNING << "Unable to load binary state archive, falling back to " << stateFile;
+                }
+            }
 
-            if (!m_pe->LoadState(stateFile, startTime)) {
+            if (!loaded && !m_pe->LoadState(stateFile, startTime)) {
                 LOG_ERROR << "Error loading state";
                 m_mutex.unlock();
                 return false;
@@ -410,97 +384,48 @@ namespace AMM {
         m_mutex.unlock();
 
         LOG_DEBUG << "Preloading substances";
-        // preload substances
         m_mutex.lock();
-        sodium = m_pe->GetSubstanceManager().GetSubstance("Sodium");
-        glucose = m_pe->GetSubstanceManager().GetSubstance("Glucose");
-        creatinine = m_pe->GetSubstanceManager().GetSubstance("Creatinine");
-        calcium = m_pe->GetSubstanceManager().GetSubstance("Calcium");
-        bicarbonate = m_pe->GetSubstanceManager().GetSubstance("Bicarbonate");
-        albumin = m_pe->GetSubstanceManager().GetSubstance("Albumin");
-        CO2 = m_pe->GetSubstanceManager().GetSubstance("CarbonDioxide");
-        N2 = m_pe->GetSubstanceManager().GetSubstance("Nitrogen");
-        O2 = m_pe->GetSubstanceManager().GetSubstance("Oxygen");
-        CO = m_pe->GetSubstanceManager().GetSubstance("CarbonMonoxide");
-        Hb = m_pe->GetSubstanceManager().GetSubstance("Hemoglobin");
-        HbO2 = m_pe->GetSubstanceManager().GetSubstance("Oxyhemoglobin");
-        HbCO2 = m_pe->GetSubstanceManager().GetSubstance("Carbaminohemoglobin");
-        HbCO = m_pe->GetSubstanceManager().GetSubstance("Carboxyhemoglobin");
-        HbO2CO2 = m_pe->GetSubstanceManager().GetSubstance("OxyCarbaminohemoglobin");
-
-        potassium = m_pe->GetSubstanceManager().GetSubstance("Potassium");
-        chloride = m_pe->GetSubstanceManager().GetSubstance("Chloride");
-        lactate = m_pe->GetSubstanceManager().GetSubstance("Lactate");
-
-        // preload compartments
-        carina = m_pe->GetCompartments().GetGasCompartment(BGE::PulmonaryCompartment::Trachea);
-        leftLung = m_pe->GetCompartments().GetGasCompartment(BGE::PulmonaryCompartment::LeftLung);
-        rightLung = m_pe->GetCompartments().GetGasCompartment(BGE::PulmonaryCompartment::RightLung);
-        bladder = m_pe->GetCompartments().GetLiquidCompartment(BGE::UrineCompartment::Bladder);
+        PreloadSubstances();
         m_mutex.unlock();
+        checkpoints.Clear();
 
         startingBloodVolume = 5400.00;
         currentBloodVolume = startingBloodVolume;
+        AttachEngine();
+        return true;
+    }
+
+    bool BiogearsThread::ResumeState(const CDM::PhysiologyEngineStateData &state, double simTime,
+                                     double startingVolume) {
+        if (!LoadState(state, simTime)) {
+            return false;
+        }
+        startingBloodVolume = startingVolume;
+        if (myEventHandler == nullptr) {
+            AttachEngine();
+        }
+        return true;
+    }
 
+    double BiogearsThread::GetStartingBloodVolume() const {
+        return startingBloodVolume;
+    }
+
+    void BiogearsThread::AttachEngine() {
         if (logging_enabled) {
-            std::string logFilename = Utility::getTimestampedFilename("./logs/AMM_Output_", ".csv");
-            LOG_INFO << "Initializing log file: " << logFilename;
-
-            std::fstream fs;
-            fs.open(logFilename, std::ios::out);
-            fs.close();
-
-            m_pe->GetEngineTrack()->GetDataRequestManager().Clear();
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                    "HeartRate", biogears::FrequencyUnit::Per_min);
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                    "MeanArterialPressure", biogears::PressureUnit::mmHg);
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                    "SystolicArterialPressure", biogears::PressureUnit::mmHg);
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                    "DiastolicArterialPressure", biogears::PressureUnit::mmHg);
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                    "RespirationRate", biogears::FrequencyUnit::Per_min);
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                    "TidalVolume", biogears::VolumeUnit::mL);
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                    "TotalLungVolume", biogears::VolumeUnit::mL);
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreateGasCompartmentDataRequest().Set(
-                    BGE::PulmonaryCompartment::LeftLung, "Volume");
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreateGasCompartmentDataRequest().Set(
-                    BGE::PulmonaryCompartment::RightLung, "Volume");
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                    "OxygenSaturation");
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreateGasCompartmentDataRequest().Set(
-                    BGE::PulmonaryCompartment::Trachea, "InFlow");
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                    "BloodVolume", biogears::VolumeUnit::mL);
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                    "ArterialBloodPH");
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreateSubstanceDataRequest().Set(
-                    *lactate, "BloodConcentration", biogears::MassPerVolumeUnit::ug_Per_mL);
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                    "UrineProductionRate", biogears::VolumePerTimeUnit::mL_Per_min);
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreateGasCompartmentDataRequest().Set(
-                    BGE::PulmonaryCompartment::Trachea, *O2, "PartialPressure");
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreateGasCompartmentDataRequest().Set(
-                    BGE::PulmonaryCompartment::Trachea, *CO2, "PartialPressure");
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreateGasCompartmentDataRequest().Set(
-                    BGE::PulmonaryCompartment::Trachea, "Pressure", biogears::PressureUnit::cmH2O);
-            m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                    "BaseExcess", biogears::AmountPerVolumeUnit::mmol_Per_L);
-            m_pe->GetEngineTrack()->GetDataRequestManager().SetResultsFilename(logFilename);
+            StartRecording();
         }
 
         try {
             LOG_DEBUG << "Attaching event handler";
-            myEventHandler = new EventHandler(m_pe->GetLogger());
+            // One handler serves every state this thread loads
+            if (myEventHandler == nullptr) {
+                myEventHandler = new EventHandler(this);
+            }
             m_pe->SetEventHandler(myEventHandler);
         } catch (std::exception &e) {
             LOG_ERROR << "Error attaching event handler: " << e.what();
         }
-
-        return true;
     }
 
     bool BiogearsThread::SaveState(const std::string &stateFile) {
@@ -508,13 +433,144 @@ namespace AMM {
             LOG_ERROR << "Unable to save state, Biogears has not been initialized.";
             return false;
         }
+        // Only the in-memory snapshot is taken under the lock, serialization
+        // and file I/O happen on the writer thread.
+        std::unique_ptr<CDM::PhysiologyEngineStateData> state;
+        m_mutex.lock();
+        try {
+            state = m_pe->SaveState("");
+        } catch (std::exception &e) {
+            LOG_ERROR << "Unable to capture engine state: " << e.what();
+        }
+        m_mutex.unlock();
+
+        if (state == nullptr) {
+            return false;
+        }
+        stateWriter.Submit(stateFile, std::move(state), binary_states_enabled, stateSavedCallback);
+        return true;
+    }
+
+    std::unique_ptr<CDM::PhysiologyEngineStateData> BiogearsThread::CaptureState(double &simTime) {
+        std::unique_ptr<CDM::PhysiologyEngineStateData> state;
+        if (m_pe == nullptr) {
+            LOG_ERROR << "Unable to capture state, Biogears has not been initialized.";
+            return state;
+        }
+        m_mutex.lock();
+        try {
+            simTime = m_pe->GetSimulationTime(biogears::TimeUnit::s);
+            state = m_pe->SaveState("");
+        } catch (std::exception &e) {
+            LOG_ERROR << "Unable to capture engine state: " << e.what();
+        }
+        m_mutex.unlock();
+        return state;
+    }
+
+    std::shared_ptr<const CDM::PhysiologyEngineStateData> BiogearsThread::GetLatestCheckpoint(double &simTime,
+                                                                                              uint64_t *sequence) {
+        return checkpoints.Find(std::numeric_limits<double>::max(), simTime, sequence);
+    }
+
+    uint64_t BiogearsThread::GetLatestCheckpointSequence(double &simTime) {
+        return checkpoints.GetLatest(simTime);
+    }
+
+    bool BiogearsThread::LoadState(const CDM::PhysiologyEngineStateData &state, double simTime) {
+        if (m_pe == nullptr) {
+            LOG_ERROR << "Unable to load state, Biogears has not been initialized.";
+            return false;
+        }
+
+        biogears::SEScalarTime startTime;
+        startTime.SetValue(simTime, biogears::TimeUnit::s);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        try {
+            if (!m_pe->LoadState(state, &startTime)) {
+                LOG_ERROR << "Error loading state";
+                return false;
+            }
+            PreloadSubstances();
+        } catch (std::exception &e) {
+            LOG_ERROR << "Exception loading state: " << e.what();
+            return false;
+        }
+        checkpoints.Clear();
+        return true;
+    }
+
+    void BiogearsThread::SetStateSavedCallback(StateWriter::Completion callback) {
+        stateSavedCallback = std::move(callback);
+    }
+
+    bool BiogearsThread::Rewind(double seconds) {
+        uint64_t generation = cancelGeneration;
+        if (m_pe == nullptr) {
+            LOG_ERROR << "Unable to rewind, Biogears has not been initialized.";
+            return false;
+        }
+
         m_mutex.lock();
-        m_pe->SaveStateToFile(stateFile);
-        // m_pe->SaveState(stateFile);
+        double currentTime = m_pe->GetSimulationTime(biogears::TimeUnit::s);
+        m_mutex.unlock();
+
+        double targetTime = std::max(0.0, currentTime - seconds);
+        double checkpointTime = 0.0;
+        std::shared_ptr<const CDM::PhysiologyEngineStateData> state = checkpoints.Find(targetTime, checkpointTime);
+        if (state == nullptr) {
+            LOG_ERROR << "No checkpoint available at or before " << targetTime << "s, unable to rewind.";
+            return false;
+        }
+
+        LOG_INFO << "Rewinding from " << currentTime << "s to " << targetTime << "s using the checkpoint at "
+                 << checkpointTime << "s";
+        auto begin = std::chrono::high_resolution_clock::now();
+        biogears::SEScalarTime startTime;
+        startTime.SetValue(checkpointTime, biogears::TimeUnit::s);
+
+        m_mutex.lock();
+        try {
+            if (!m_pe->LoadState(*state, &startTime)) {
+                LOG_ERROR << "Error loading checkpoint";
+                m_mutex.unlock();
+                return false;
+            }
+            PreloadSubstances();
+        }
+        catch (std::exception &e) {
+            LOG_ERROR << "Exception rewinding: " << e.what();
+            m_mutex.unlock();
+            return false;
+        }
         m_mutex.unlock();
+
+        // The timeline after the target no longer happened
+        checkpoints.DiscardAfter(targetTime);
+        irreversible = irreversibleSent = false;
+
+        // Fast-forward from the checkpoint to the exact target time, a chunk at a time
+        bool reached = true;
+        if (targetTime > checkpointTime) {
+            rewinding = true;
+            reached = AdvanceTime(targetTime - checkpointTime, generation);
+            rewinding = false;
+        }
+        if (!reached) {
+            LOG_WARNING << "Rewind stopped short of " << targetTime << "s, at " << GetEngineTime() << "s.";
+            return false;
+        }
+
+        auto end = std::chrono::high_resolution_clock::now();
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin);
+        LOG_INFO << "Rewound to " << targetTime << "s in " << elapsed.count() * 1e-9 << "s.";
         return true;
     }
 
+    void BiogearsThread::SetCheckpoints(double interval, size_t depth, size_t memoryLimit) {
+        checkpoints.Configure(interval, depth, memoryLimit);
+    }
+
     bool BiogearsThread::Execute(std::function<std::unique_ptr<biogears::PhysiologyEngine>(
             std::unique_ptr < biogears::PhysiologyEngine > && )>
                                  func) {
@@ -528,16 +584,379 @@ namespace AMM {
 
     void BiogearsThread::SetLogging(bool log) {
         logging_enabled = log;
+        if (!logging_enabled) {
+            m_mutex.lock();
+            recorder.Stop();
+            m_mutex.unlock();
+        } else if (running && !recorder.IsRecording()) {
+            StartRecording();
+        }
+    }
+
+    void BiogearsThread::QueueEvent(PhysiologyEvent::Source source, int type, bool active, const SEScalarTime *time) {
+        PhysiologyEvent event;
+        event.source = source;
+        event.type = type;
+        event.active = active;
+        event.simTime = time != nullptr ? time->GetValue(TimeUnit::s) : m_pe->GetSimulationTime(TimeUnit::s);
+        if (!events.TryPush(event)) {
+            ++droppedEvents;
+        }
+    }
+
+    bool BiogearsThread::PopEvent(PhysiologyEvent &event) {
+        return events.TryPop(event);
+    }
+
+    uint64_t BiogearsThread::GetDroppedEvents() const {
+        return droppedEvents;
+    }
+
+    void BiogearsThread::SetLoggedFields(const std::string &fields) {
+        loggedFields = fields;
+        if (recorder.IsRecording()) {
+            StartRecording();
+        }
+    }
+
+    bool BiogearsThread::IsSubstanceNodePath(const std::string &nodePath, std::string &substance,
+                                             std::string &compartment) {
+        const std::string prefix = "Substance_";
+        const std::string suffix = "_Concentration";
+        if (nodePath.size() <= prefix.size() + suffix.size() || nodePath.compare(0, prefix.size(), prefix) != 0 ||
+            nodePath.compare(nodePath.size() - suffix.size(), suffix.size(), suffix) != 0) {
+            return false;
+        }
+
+        // Compartment names have no underscores, substance names might
+        std::string name = nodePath.substr(prefix.size(), nodePath.size() - prefix.size() - suffix.size());
+        std::size_t split = name.rfind('_');
+        if (split == std::string::npos || split == 0 || split == name.size() - 1) {
+            return false;
+        }
+        substance = name.substr(0, split);
+        compartment = name.substr(split + 1);
+        return true;
+    }
+
+    int BiogearsThread::ResolveSubstanceNode(const std::string &nodePath) {
+        auto existing = substanceNodeIndex.find(nodePath);
+        if (existing != substanceNodeIndex.end()) {
+            return existing->second;
+        }
+
+        SubstanceNode node;
+        if (m_pe == nullptr || !IsSubstanceNodePath(nodePath, node.substanceName, node.compartmentName)) {
+            return -1;
+        }
+        if (m_pe->GetSubstanceManager().GetSubstance(node.substanceName) == nullptr) {
+            LOG_WARNING << "Unknown substance " << node.substanceName << " in " << nodePath;
+            return -1;
+        }
+        if (!m_pe->GetCompartments().HasLiquidCompartment(node.compartmentName)) {
+            LOG_WARNING << "Unknown compartment " << node.compartmentName << " in " << nodePath;
+            return -1;
+        }
+
+        substanceNodes.push_back(node);
+        int index = static_cast<int>(substanceNodes.size() - 1);
+        substanceNodeIndex[nodePath] = index;
+        return index;
+    }
+
+    int BiogearsThread::FindSubstanceNode(const std::string &nodePath) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return ResolveSubstanceNode(nodePath);
+    }
+
+    double BiogearsThread::GetSubstanceNode(int index) {
+        SubstanceNode &node = substanceNodes[index];
+        if (node.quantity == nullptr) {
+            // Until the substance is in the patient there is nothing to read
+            if (node.substance == nullptr) {
+                node.substance = m_pe->GetSubstanceManager().GetSubstance(node.substanceName);
+            }
+            if (node.compartment == nullptr) {
+                node.compartment = m_pe->GetCompartments().GetLiquidCompartment(node.compartmentName);
+            }
+            if (node.substance == nullptr || node.compartment == nullptr ||
+                !node.compartment->HasSubstanceQuantity(*node.substance)) {
+                return 0.0;
+            }
+            node.quantity = node.compartment->GetSubstanceQuantity(*node.substance);
+        }
+        return node.quantity->GetConcentration().GetValue(biogears::MassPerVolumeUnit::ug_Per_mL);
+    }
+
+    std::vector<std::string> BiogearsThread::ResolveNodePaths(const std::string &pattern) {
+        std::vector<std::string> nodes;
+        bool prefix = !pattern.empty() && pattern.back() == '*';
+        std::string match = prefix ? pattern.substr(0, pattern.size() - 1) : pattern;
+        std::string substance, compartment;
+        if (!prefix && (nodePathTable.find(match) != nodePathTable.end() ||
+                        IsSubstanceNodePath(match, substance, compartment))) {
+            nodes.push_back(match);
+            return nodes;
+        }
+
+        // Anything that is not an exact node path is taken as a prefix
+        for (auto it = nodePathTable.lower_bound(match);
+             it != nodePathTable.end() && !it->first.compare(0, match.size(), match); ++it) {
+            nodes.push_back(it->first);
+        }
+        if (nodes.empty()) {
+            LOG_WARNING << "No nodepaths match " << pattern;
+        }
+        return nodes;
+    }
+
+    void BiogearsThread::StartRecording() {
+        // (node path, rate in Hz), a rate of 0 records every tick
+        std::vector<std::pair<std::string, double>> fields;
+        if (loggedFields.empty()) {
+            for (const auto &node : defaultLoggedNodes) {
+                fields.emplace_back(node, 0.0);
+            }
+        } else {
+            std::vector<std::string> entries;
+            boost::split(entries, loggedFields, boost::is_any_of(", \t\r\n"), boost::token_compress_on);
+            for (auto &entry : entries) {
+                if (entry.empty()) {
+                    continue;
+                }
+                double rate = 0.0;
+                std::size_t at = entry.find('@');
+                if (at != std::string::npos) {
+                    rate = atof(entry.substr(at + 1).c_str());
+                    entry = entry.substr(0, at);
+                }
+                for (const auto &node : ResolveNodePaths(entry)) {
+                    fields.emplace_back(node, rate);
+                }
+            }
+        }
+
+        // The old recorder is flushed and closed before its nodes stop being evaluated
+        m_mutex.lock();
+        double timeStep = m_pe->GetTimeStep(biogears::TimeUnit::s);
+        recorder.Stop();
+        recordedTables.clear();
+        m_mutex.unlock();
+
+        // Fields sharing a rate share a table, and are only evaluated on the ticks they are recorded
+        ReleaseSnapshotNodes(SnapshotUser::RECORDER);
+        std::vector<RecordedTable> tables;
+        for (const auto &field : fields) {
+            int divisor = 1;
+            if (field.second > 0.0 && timeStep > 0.0) {
+                divisor = std::max(1, static_cast<int>(std::round(1.0 / (field.second * timeStep))));
+            }
+            int index = RegisterSnapshotNode(field.first, SnapshotUser::RECORDER, divisor);
+            if (index < 0) {
+                continue;
+            }
+
+            auto table = std::find_if(tables.begin(), tables.end(),
+                                      [divisor](const RecordedTable &t) { return t.divisor == divisor; });
+            if (table == tables.end()) {
+                RecordedTable created;
+                created.divisor = divisor;
+                if (divisor == 1) {
+                    created.name = "physiology";
+                } else {
+                    std::ostringstream name;
+                    name << "physiology_" << 1.0 / (divisor * timeStep) << "Hz";
+                    created.name = name.str();
+                }
+                table = tables.insert(tables.end(), created);
+            }
+            if (std::find(table->nodes.begin(), table->nodes.end(), index) == table->nodes.end()) {
+                table->nodes.push_back(index);
+                table->columns.push_back(field.first);
+            }
+        }
+
+        std::string recordingFile = Utility::getTimestampedFilename("./logs/AMM_Output_", ".amm");
+        m_mutex.lock();
+        recorder.ClearTables();
+        for (auto &table : tables) {
+            recorder.AddTable(table.name, table.columns);
+            table.row.resize(table.nodes.size());
+            LOG_INFO << "Recording " << table.columns.size() << " fields to table " << table.name;
+        }
+        recordedTables.swap(tables);
+        recorder.Start(recordingFile);
+        m_mutex.unlock();
+    }
+
+    void BiogearsThread::SetTrends(const std::string &nodes, const std::vector<double> &windows) {
+        std::vector<std::string> names;
+        std::vector<int> indices;
+        std::vector<std::string> entries;
+        boost::split(entries, nodes, boost::is_any_of(", \t\r\n"), boost::token_compress_on);
+        ReleaseSnapshotNodes(SnapshotUser::TRENDS);
+        for (const auto &entry : entries) {
+            if (entry.empty()) {
+                continue;
+            }
+            for (const auto &node : ResolveNodePaths(entry)) {
+                int index = RegisterSnapshotNode(node, SnapshotUser::TRENDS);
+                if (index >= 0 && std::find(indices.begin(), indices.end(), index) == indices.end()) {
+                    names.push_back(node);
+                    indices.push_back(index);
+                }
+            }
+        }
+
+        m_mutex.lock();
+        trends.Configure(names, indices, windows, m_pe->GetTimeStep(biogears::TimeUnit::s));
+        m_mutex.unlock();
+        if (!names.empty()) {
+            LOG_INFO << "Trending " << names.size() << " nodes over " << windows.size() << " windows";
+        }
+    }
+
+    void BiogearsThread::GetTrends(std::vector<std::pair<std::string, double>> &values) {
+        m_mutex.lock();
+        trends.GetTrends(values);
+        m_mutex.unlock();
+    }
+
+    void BiogearsThread::SetAlarmRules(const std::vector<AlarmEngine::Rule> &rules) {
+        std::vector<AlarmEngine::Rule> resolved;
+        std::vector<int> indices;
+        ReleaseSnapshotNodes(SnapshotUser::ALARMS);
+        for (const auto &rule : rules) {
+            int index = RegisterSnapshotNode(rule.node, SnapshotUser::ALARMS);
+            if (index < 0) {
+                LOG_WARNING << "Alarm rule " << rule.name << " ignored, unknown node " << rule.node;
+                continue;
+            }
+            resolved.push_back(rule);
+            indices.push_back(index);
+        }
+
+        m_mutex.lock();
+        alarms.Configure(resolved, indices, m_pe->GetTimeStep(biogears::TimeUnit::s));
+        m_mutex.unlock();
+    }
+
+    void BiogearsThread::TakeAlarms(std::vector<AlarmEngine::Transition> &transitions) {
+        m_mutex.lock();
+        alarms.TakeTransitions(transitions);
+        m_mutex.unlock();
+    }
+
+    void BiogearsThread::RecordTick(double simTime) {
+        for (uint32_t t = 0; t < recordedTables.size(); ++t) {
+            RecordedTable &table = recordedTables[t];
+            if (snapshotTick % table.divisor != 0) {
+                continue;
+            }
+            for (size_t i = 0; i < table.nodes.size(); ++i) {
+                table.row[i] = snapshot[table.nodes[i]];
+            }
+            recorder.Record(t, simTime, table.row.data());
+        }
+    }
+
+    int BiogearsThread::RegisterSnapshotNode(const std::string &nodePath, SnapshotUser user, int divisor) {
+        std::pair<SnapshotUser, int> request(user, std::max(divisor, 1));
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return AddSnapshotNode(nodePath, request);
+    }
+
+    int BiogearsThread::AddSnapshotNode(const std::string &nodePath, const std::pair<SnapshotUser, int> &request) {
+        // Getters reading values cached by others need them fresh on the same ticks;
+        // a node added after its dependencies gets a later index, so they run first
+        auto dependencies = nodeDependencies.find(nodePath);
+        if (dependencies != nodeDependencies.end()) {
+            for (const auto &dependency : dependencies->second) {
+                AddSnapshotNode(dependency, request);
+            }
+        }
+
+        for (size_t i = 0; i < snapshotPaths.size(); ++i) {
+            if (snapshotPaths[i] == nodePath) {
+                auto &divisors = snapshotDivisors[i];
+                if (std::find(divisors.begin(), divisors.end(), request) == divisors.end()) {
+                    divisors.push_back(request);
+                }
+                return static_cast<int>(i);
+            }
+        }
+
+        double (BiogearsThread::*getter)() = nullptr;
+        int substanceNode = -1;
+        auto entry = nodePathTable.find(nodePath);
+        if (entry != nodePathTable.end()) {
+            getter = entry->second;
+        } else {
+            substanceNode = ResolveSubstanceNode(nodePath);
+            if (substanceNode < 0) {
+                LOG_ERROR << "Unable to snapshot unknown nodepath " << nodePath;
+                return -1;
+            }
+        }
+
+        snapshotPaths.push_back(nodePath);
+        snapshotGetters.push_back(getter);
+        snapshotSubstanceNodes.push_back(substanceNode);
+        snapshotDivisors.push_back({request});
+        snapshot.push_back(0.0);
+        return static_cast<int>(snapshot.size() - 1);
+    }
+
+    void BiogearsThread::ReleaseSnapshotNodes(SnapshotUser user) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto &divisors : snapshotDivisors) {
+            divisors.erase(std::remove_if(divisors.begin(), divisors.end(),
+                                          [user](const std::pair<SnapshotUser, int> &request) {
+                                              return request.first == user;
+                                          }), divisors.end());
+        }
+    }
+
+    const std::vector<double> &BiogearsThread::GetSnapshot() const {
+        return snapshot;
+    }
+
+    void BiogearsThread::UpdateSnapshot() {
+        ++snapshotTick;
+        for (size_t i = 0; i < snapshotGetters.size(); ++i) {
+            bool due = false;
+            for (const auto &request : snapshotDivisors[i]) {
+                due = due || snapshotTick % request.second == 0;
+            }
+            if (due) {
+                snapshot[i] = snapshotGetters[i] != nullptr ? (this->*snapshotGetters[i])()
+                                                            : GetSubstanceNode(snapshotSubstanceNodes[i]);
+            }
+        }
+    }
+
+    void BiogearsThread::SetBinaryStates(bool binaryStates) {
+        binary_states_enabled = binaryStates;
     }
 
     bool BiogearsThread::ExecuteXMLCommand(const std::string &cmd) {
-        char *tmpname = strdup("/tmp/tmp_amm_xml_XXXXXX");
+        // Unique per call, a what-if branch may run one alongside the live engine
+        char tmpname[] = "/tmp/tmp_amm_xml_XXXXXX";
+        int fd = mkstemp(tmpname);
+        if (fd < 0) {
+            LOG_ERROR << "Unable to create temp file.";
+            return false;
+        }
+        close(fd);
+
         std::ofstream out(tmpname);
         if (out.is_open()) {
             out << cmd;
 
             out.close();
-            if (!LoadScenarioFile(tmpname)) {
+            bool loaded = LoadScenarioFile(tmpname);
+            remove(tmpname);
+            if (!loaded) {
                 LOG_ERROR << "Unable to load scenario file from temp.";
                 return false;
             } else {
@@ -547,6 +966,7 @@ namespace AMM {
             LOG_ERROR << "Unable to open file.";
         }
 
+        remove(tmpname);
         return true;
     }
 
@@ -558,7 +978,9 @@ namespace AMM {
 // Load a scenario from an XML file, apply conditions and iterate through the actions
 // This bypasses the standard BioGears ExecuteScenario method to avoid resetting the BioGears
 // engine
-    bool BiogearsThread::LoadScenarioFile(const std::string &scenarioFile) {
+    bool BiogearsThread::LoadScenarioFile(const std::string &scenarioFile, bool live) {
+        // A CancelAdvance from here on stops the rest of this scenario
+        uint64_t generation = cancelGeneration;
         if (m_pe == nullptr) {
             LOG_ERROR << "Unable to load scenario, Biogears has not been initialized.";
             return false;
@@ -570,12 +992,24 @@ namespace AMM {
         }
 
 
+        // Actions are read and run one at a time; only the header is loaded up front
+        ScenarioReader reader;
+        if (!reader.Open(scenarioFile)) {
+            return false;
+        }
+        std::unique_ptr<CDM::ScenarioData> header = ScenarioReader::Parse(reader.GetHeader());
         biogears::SEScenario sce(m_pe->GetSubstanceManager());
-        sce.Load(scenarioFile);
+        if (header == nullptr || !sce.Load(*header)) {
+            LOG_ERROR << "Unable to load scenario " << scenarioFile;
+            return false;
+        }
 
         if (scenarioLoading) {
             if (sce.HasEngineStateFile()) {
-                if (!m_pe->LoadState(sce.GetEngineStateFile())) {
+                m_mutex.lock();
+                bool loaded = m_pe->LoadState(sce.GetEngineStateFile());
+                m_mutex.unlock();
+                if (!loaded) {
                     LOG_ERROR << "Unable to load state file.";
                     return false;
                 }
@@ -585,7 +1019,11 @@ namespace AMM {
                     std::vector<const SECondition *> conditions;
                     for (SECondition *c : sip.GetConditions())
                         conditions.push_back(c);// Copy to const
-                    if (!m_pe->InitializeEngine(sip.GetPatientFile(), &conditions, &sip.GetConfiguration())) {
+                    m_mutex.lock();
+                    bool initialized = m_pe->InitializeEngine(sip.GetPatientFile(), &conditions,
+                                                              &sip.GetConfiguration());
+                    m_mutex.unlock();
+                    if (!initialized) {
 
                         LOG_ERROR << "Unable to load patient file.";
                         return false;
@@ -594,7 +1032,10 @@ namespace AMM {
                     std::vector<const SECondition *> conditions;
                     for (SECondition *c : sip.GetConditions())
                         conditions.push_back(c);// Copy to const
-                    if (!m_pe->InitializeEngine(sip.GetPatient(), &conditions, &sip.GetConfiguration())) {
+                    m_mutex.lock();
+                    bool initialized = m_pe->InitializeEngine(sip.GetPatient(), &conditions, &sip.GetConfiguration());
+                    m_mutex.unlock();
+                    if (!initialized) {
                         LOG_ERROR << "Unable to load conditions.";
                         return false;
                     }
@@ -602,133 +1043,237 @@ namespace AMM {
             }
 
             LOG_DEBUG << "Preloading substances";
-            // preload substances
             m_mutex.lock();
-            sodium = m_pe->GetSubstanceManager().GetSubstance("Sodium");
-            glucose = m_pe->GetSubstanceManager().GetSubstance("Glucose");
-            creatinine = m_pe->GetSubstanceManager().GetSubstance("Creatinine");
-            calcium = m_pe->GetSubstanceManager().GetSubstance("Calcium");
-            bicarbonate = m_pe->GetSubstanceManager().GetSubstance("Bicarbonate");
-            albumin = m_pe->GetSubstanceManager().GetSubstance("Albumin");
-            CO2 = m_pe->GetSubstanceManager().GetSubstance("CarbonDioxide");
-            N2 = m_pe->GetSubstanceManager().GetSubstance("Nitrogen");
-            O2 = m_pe->GetSubstanceManager().GetSubstance("Oxygen");
-            CO = m_pe->GetSubstanceManager().GetSubstance("CarbonMonoxide");
-            Hb = m_pe->GetSubstanceManager().GetSubstance("Hemoglobin");
-            HbO2 = m_pe->GetSubstanceManager().GetSubstance("Oxyhemoglobin");
-            HbCO2 = m_pe->GetSubstanceManager().GetSubstance("Carbaminohemoglobin");
-            HbCO = m_pe->GetSubstanceManager().GetSubstance("Carboxyhemoglobin");
-            HbO2CO2 = m_pe->GetSubstanceManager().GetSubstance("OxyCarbaminohemoglobin");
-
-            potassium = m_pe->GetSubstanceManager().GetSubstance("Potassium");
-            chloride = m_pe->GetSubstanceManager().GetSubstance("Chloride");
-            lactate = m_pe->GetSubstanceManager().GetSubstance("Lactate");
-
-            // preload compartments
-            carina = m_pe->GetCompartments().GetGasCompartment(BGE::PulmonaryCompartment::Trachea);
-            leftLung = m_pe->GetCompartments().GetGasCompartment(BGE::PulmonaryCompartment::LeftLung);
-            rightLung = m_pe->GetCompartments().GetGasCompartment(BGE::PulmonaryCompartment::RightLung);
-            bladder = m_pe->GetCompartments().GetLiquidCompartment(BGE::UrineCompartment::Bladder);
+            PreloadSubstances();
             m_mutex.unlock();
+            checkpoints.Clear();
 
             startingBloodVolume = 5400.00;
             currentBloodVolume = startingBloodVolume;
-
-            if (logging_enabled) {
-                std::string logFilename = Utility::getTimestampedFilename("./logs/AMM_Output_", ".csv");
-                LOG_INFO << "Initializing log file: " << logFilename;
-
-                std::fstream fs;
-                fs.open(logFilename, std::ios::out);
-                fs.close();
-
-                m_pe->GetEngineTrack()->GetDataRequestManager().Clear();
-                m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                        "HeartRate", biogears::FrequencyUnit::Per_min);
-                m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                        "MeanArterialPressure", biogears::PressureUnit::mmHg);
-                m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                        "SystolicArterialPressure", biogears::PressureUnit::mmHg);
-                m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                        "DiastolicArterialPressure", biogears::PressureUnit::mmHg);
-                m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                        "RespirationRate", biogears::FrequencyUnit::Per_min);
-                m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                        "TidalVolume", biogears::VolumeUnit::mL);
-                m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                        "TotalLungVolume", biogears::VolumeUnit::mL);
-                m_pe->GetEngineTrack()->GetDataRequestManager().CreateGasCompartmentDataRequest().Set(
-                        BGE::PulmonaryCompartment::LeftLung, "Volume");
-                m_pe->GetEngineTrack()->GetDataRequestManager().CreateGasCompartmentDataRequest().Set(
-                        BGE::PulmonaryCompartment::RightLung, "Volume");
-                m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                        "OxygenSaturation");
-                m_pe->GetEngineTrack()->GetDataRequestManager().CreateGasCompartmentDataRequest().Set(
-                        BGE::PulmonaryCompartment::Trachea, "InFlow");
-                m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                        "BloodVolume", biogears::VolumeUnit::mL);
-                m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                        "ArterialBloodPH");
-                m_pe->GetEngineTrack()->GetDataRequestManager().CreateSubstanceDataRequest().Set(
-                        *lactate, "BloodConcentration", biogears::MassPerVolumeUnit::ug_Per_mL);
-                m_pe->GetEngineTrack()->GetDataRequestManager().CreatePhysiologyDataRequest().Set(
-                        "UrineProductionRate", biogears::VolumePerTimeUnit::mL_Per_min);
-                m_pe->GetEngineTrack()->GetDataRequestManager().CreateGasCompartmentDataRequest().Set(
-                        BGE::PulmonaryCompartment::Trachea, *O2, "PartialPressure");
-                m_pe->GetEngineTrack()->GetDataRequestManager().CreateGasCompartmentDataRequest().Set(
-                        BGE::PulmonaryCompartment::Trachea, *CO2, "PartialPressure");
-                m_pe->GetEngineTrack()->GetDataRequestManager().CreateGasCompartmentDataRequest().Set(
-                        BGE::PulmonaryCompartment::Trachea, "Pressure", biogears::PressureUnit::cmH2O);
-                m_pe->GetEngineTrack()->GetDataRequestManager().SetResultsFilename(logFilename);
-            }
-
-            try {
-                LOG_DEBUG << "Attaching event handler";
-                myEventHandler = new EventHandler(m_pe->GetLogger());
-                m_pe->SetEventHandler(myEventHandler);
-            } catch (std::exception &e) {
-                LOG_ERROR << "Error attaching event handler: " << e.what();
-            }
+            AttachEngine();
             scenarioLoading = false;
         }
 
         LOG_INFO << "Executing actions";
         SEAdvanceTime *adv;
+        double startTime = 0.0;
+        if (live) {
+            m_mutex.lock();
+            startTime = m_pe->GetSimulationTime(TimeUnit::s);
+            m_mutex.unlock();
+        }
         // Now run the scenario actions
-        for (SEAction *a : sce.GetActions()) {
-            adv = dynamic_cast<SEAdvanceTime *>(a);
-            if (adv != nullptr) {
-                m_mutex.lock();
-                try {
-                    auto begin = std::chrono::high_resolution_clock::now();
-                    LOG_INFO << "Simulating " << adv->GetTime(TimeUnit::s) << " seconds...";
-                    m_pe->AdvanceModelTime(adv->GetTime(TimeUnit::s), TimeUnit::s);
-                    auto end = std::chrono::high_resolution_clock::now();
-                    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin);
-                    LOG_INFO << "Done simulating time advancement. Simulated " << adv->GetTime(TimeUnit::s) << "s in "
-                             << elapsed.count() * 1e-9 << "s.";
-                }
-                catch (std::exception &e) {
-                    LOG_ERROR << "Error advancing time: " << e.what();
-                }
-                m_mutex.unlock();
-            } else {
+        std::string document;
+        while (reader.Next(document)) {
+            if (cancelGeneration != generation) {
+                LOG_WARNING << "Scenario cancelled, skipping the remaining actions.";
+                break;
+            }
+
+            std::unique_ptr<SEAction> a = ScenarioReader::ParseAction(document, m_pe->GetSubstanceManager());
+            if (a == nullptr) {
+                LOG_ERROR << "Unable to read action " << reader.GetActionCount() << " of " << scenarioFile;
+                continue;
+            }
+
+            adv = dynamic_cast<SEAdvanceTime *>(a.get());
+            if (live && adv != nullptr) {
+                // AdvanceTimeTick schedules the rest as the engine gets near it
+                std::unique_ptr<LiveScenarioFeed> feed(
+                        new LiveScenarioFeed(std::move(reader), scenarioFile, startTime + adv->GetTime(TimeUnit::s),
+                                             LiveScenarioHorizon));
                 m_mutex.lock();
-                try {
-                    if (!m_pe->ProcessAction(*a)) {
-                        LOG_ERROR << "Unable to process action.";
-                    }
-                }
-                catch (std::exception &e) {
-                    LOG_ERROR << "Error processing action: " << e.what();
-                }
+                liveScenario = feed->Feed(startTime, m_pe->GetSubstanceManager(), scheduler) ? std::move(feed)
+                                                                                               : nullptr;
+                liveScenarioGeneration = generation;
                 m_mutex.unlock();
+                break;
+            } else if (adv != nullptr) {
+                AdvanceTime(adv->GetTime(TimeUnit::s), generation);
+            } else if (!ProcessAction(*a)) {
+                LOG_ERROR << "Unable to process action.";
             }
         }
         LOG_INFO << "Done loading scenario and executing actions.";
         return true;
     }
 
+    bool BiogearsThread::ProcessAction(const SEAction &action) {
+        bool processed = false;
+        m_mutex.lock();
+        try {
+            processed = m_pe->ProcessAction(action);
+        }
+        catch (std::exception &e) {
+            LOG_ERROR << "Error processing action: " << e.what();
+        }
+        m_mutex.unlock();
+        return processed;
+    }
+
+    bool BiogearsThread::AdvanceTime(double seconds) {
+        return AdvanceTime(seconds, cancelGeneration);
+    }
+
+    bool BiogearsThread::AdvanceTime(double seconds, uint64_t generation) {
+        // One second of simulation holds the engine for a few tens of
+        // milliseconds, short enough for physmods to get in between.
+        const double chunkSeconds = 1.0;
+        const auto progressInterval = std::chrono::seconds(5);
+
+        advanceDone = 0.0;
+        advanceTotal = seconds;
+        advancing = true;
+        LOG_INFO << "Simulating " << seconds << " seconds...";
+
+        auto begin = std::chrono::steady_clock::now();
+        auto lastProgress = begin;
+        double done = 0.0;
+        bool completed = true;
+        while (done < seconds) {
+            if (!WaitForTurn(generation)) {
+                LOG_WARNING << "Time advancement cancelled after " << done << " of " << seconds << " seconds.";
+                completed = false;
+                break;
+            }
+
+            double chunk = std::min(chunkSeconds, seconds - done);
+            if (!AdvanceModelTime(chunk)) {
+                completed = false;
+                break;
+            }
+            done += chunk;
+            advanceDone = done;
+            if (advanceObserver) {
+                advanceObserver(GetEngineTime());
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            if (now - lastProgress >= progressInterval && done < seconds) {
+                double elapsed = std::chrono::duration<double>(now - begin).count();
+                LOG_INFO << "Simulated " << done << " of " << seconds << " seconds, about "
+                         << elapsed / done * (seconds - done) << "s remaining.";
+                lastProgress = now;
+            }
+        }
+
+        // Inputs that waited on the last chunk go before the scenario's next actions
+        if (completed) {
+            completed = WaitForTurn(generation);
+        }
+
+        if (completed) {
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+            LOG_INFO << "Done simulating time advancement. Simulated " << seconds << "s in " << elapsed << "s.";
+        }
+        advancing = false;
+        return completed;
+    }
+
+    bool BiogearsThread::AdvanceModelTime(double seconds) {
+        bool advanced = true;
+        m_mutex.lock();
+        try {
+            m_pe->AdvanceModelTime(seconds, TimeUnit::s);
+            ++engineStep;
+        }
+        catch (std::exception &e) {
+            LOG_ERROR << "Error advancing time: " << e.what();
+            advanced = false;
+        }
+        m_mutex.unlock();
+        return advanced;
+    }
+
+    void BiogearsThread::CancelAdvance() {
+        {
+            std::lock_guard<std::mutex> lock(handoffMutex);
+            ++cancelGeneration;
+        }
+        handoff.notify_all();
+        scheduler.Clear();
+    }
+
+    void BiogearsThread::BeginInput() {
+        std::lock_guard<std::mutex> lock(handoffMutex);
+        ++pendingInputs;
+        ++ownInputs;
+    }
+
+    void BiogearsThread::EndInput() {
+        {
+            std::lock_guard<std::mutex> lock(handoffMutex);
+            --pendingInputs;
+            --ownInputs;
+        }
+        handoff.notify_all();
+    }
+
+    bool BiogearsThread::WaitForTurn(uint64_t generation) {
+        double simTime = GetEngineTime();
+        std::unique_lock<std::mutex> lock(handoffMutex);
+        int own = ownInputs;
+        // A hold only paces advances made outside any input
+        auto limited = [&] { return own == 0 && simTime >= advanceLimit; };
+        if (limited()) {
+            held = true;
+            heldAt = simTime;
+            handoff.notify_all();
+        }
+        handoff.wait(lock, [&] {
+            return cancelGeneration != generation || (pendingInputs == own && !limited());
+        });
+        held = false;
+        return cancelGeneration == generation;
+    }
+
+    void BiogearsThread::HoldAdvanceAt(double simTime) {
+        {
+            std::lock_guard<std::mutex> lock(handoffMutex);
+            advanceLimit = simTime;
+        }
+        handoff.notify_all();
+    }
+
+    void BiogearsThread::ReleaseHold() {
+        HoldAdvanceAt(std::numeric_limits<double>::infinity());
+    }
+
+    void BiogearsThread::WaitForHold(double simTime) {
+        std::unique_lock<std::mutex> lock(handoffMutex);
+        handoff.wait(lock, [&] { return !backgroundWork || (held && heldAt >= simTime - 1e-9); });
+    }
+
+    void BiogearsThread::SetBackgroundWork(bool active) {
+        {
+            std::lock_guard<std::mutex> lock(handoffMutex);
+            backgroundWork = active;
+        }
+        handoff.notify_all();
+    }
+
+    bool BiogearsThread::HasBackgroundWork() {
+        std::lock_guard<std::mutex> lock(handoffMutex);
+        return backgroundWork;
+    }
+
+    void BiogearsThread::SetAdvanceObserver(std::function<void(double)> observer) {
+        advanceObserver = std::move(observer);
+    }
+
+    size_t BiogearsThread::GetScheduledActionCount() {
+        return scheduler.GetPendingCount();
+    }
+
+    bool BiogearsThread::IsAdvancing() const {
+        return advancing;
+    }
+
+    void BiogearsThread::GetAdvanceProgress(double &done, double &total) const {
+        done = advanceDone;
+        total = advanceTotal;
+    }
+
     void BiogearsThread::AdvanceTimeTick() {
         if (m_pe == nullptr) {
             LOG_ERROR << "Unable to advance time, Biogears has not been initialized.";
@@ -740,21 +1285,55 @@ namespace AMM {
             return;
         }
 
-        if (myEventHandler != nullptr) {
-            if (myEventHandler->irreversible && !irreversible) {
-                irreversible = true;
-            }
-
-            startOfInhale = myEventHandler->startOfInhale;
-            startOfExhale = myEventHandler->startOfExhale;
+        // A rewind is fast-forwarding the engine to its target
+        if (rewinding) {
+            return;
         }
 
         m_mutex.lock();
         try {
+            double now = m_pe->GetSimulationTime(TimeUnit::s);
+            if (liveScenario != nullptr &&
+                (liveScenarioGeneration != cancelGeneration ||
+                 !liveScenario->Feed(now, m_pe->GetSubstanceManager(), scheduler))) {
+                liveScenario.reset();
+            }
+            dueActions.clear();
+            scheduler.TakeDue(now, dueActions);
+            for (const auto &action : dueActions) {
+                if (!m_pe->ProcessAction(*action)) {
+                    LOG_ERROR << "Unable to process scheduled action.";
+                }
+            }
+            dueActions.clear();
+
             m_pe->AdvanceModelTime();
-            if (logging_enabled) {
-                if ((lastFrame % loggingFrequency) == 0) {
-                    m_pe->GetEngineTrack()->TrackData(m_pe->GetSimulationTime(biogears::TimeUnit::s));
+            ++engineStep;
+
+            double simTime = m_pe->GetSimulationTime(biogears::TimeUnit::s);
+            leftBreaths.Sample(simTime, leftLung->GetVolume(biogears::VolumeUnit::mL));
+            rightBreaths.Sample(simTime, rightLung->GetVolume(biogears::VolumeUnit::mL));
+            UpdateSnapshot();
+            trends.Sample(snapshot);
+            alarms.Evaluate(snapshot, simTime);
+
+            if (recorder.IsRecording()) {
+                RecordTick(simTime);
+            }
+
+            // Only the in-memory snapshot is taken here, it is compressed off the tick
+            if (checkpoints.IsDue(simTime)) {
+                auto begin = std::chrono::high_resolution_clock::now();
+                checkpoints.Add(simTime, m_pe->SaveState(""));
+                double stall = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::high_resolution_clock::now() - begin).count() * 1e-9;
+                // The tick budget is one engine step of wall time
+                double budget = m_pe->GetTimeStep(biogears::TimeUnit::s);
+                if (stall > budget) {
+                    LOG_WARNING << "Checkpoint at " << simTime << "s held the tick for " << stall * 1000.0
+                                << "ms, over the " << budget * 1000.0 << "ms budget.";
+                } else {
+                    LOG_DEBUG << "Checkpoint at " << simTime << "s took " << stall * 1000.0 << "ms.";
                 }
             }
         }
@@ -772,6 +1351,11 @@ namespace AMM {
         return lastFrame / 50;
     }
 
+    double BiogearsThread::GetEngineTime() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_pe != nullptr ? m_pe->GetSimulationTime(TimeUnit::s) : 0.0;
+    }
+
     double BiogearsThread::GetPatientTime() {
         return 0.0;
         // return m_pe->GetSimulationTime(biogears::TimeUnit::s);
@@ -784,6 +1368,11 @@ namespace AMM {
             return (this->*(entry->second))();
         }
 
+        int substanceNode = FindSubstanceNode(nodePath);
+        if (substanceNode >= 0) {
+            return GetSubstanceNode(substanceNode);
+        }
+
         LOG_ERROR << "Unable to access nodepath " << nodePath;
         return 0;
     }
@@ -973,8 +1562,7 @@ namespace AMM {
     }
 
     double BiogearsThread::GetTotalProtein() {
-        biogears::SEComprehensiveMetabolicPanel metabolicPanel;
-        m_pe->GetPatientAssessment(metabolicPanel);
+        UpdateAssessment(AssessmentPanel::METABOLIC_PANEL);
         biogears::SEScalarMassPerVolume protein = metabolicPanel.GetTotalProtein();
         return protein.GetValue(biogears::MassPerVolumeUnit::g_Per_dL);
     }
@@ -1058,48 +1646,211 @@ namespace AMM {
     }
 
     double BiogearsThread::GetBaseExcessRaw() {
-            biogears::SEArterialBloodGasAnalysis abga;
-            m_pe->GetPatientAssessment(abga);
-            biogears::SEScalarAmountPerVolume be = abga.GetBaseExcess();
+            UpdateAssessment(AssessmentPanel::BLOOD_GAS);
+            biogears::SEScalarAmountPerVolume be = bloodGas.GetBaseExcess();
             return be.GetValue(biogears::AmountPerVolumeUnit::mmol_Per_L);
     }
 
     double BiogearsThread::GetBicarbonateRaw() {
-        biogears::SEArterialBloodGasAnalysis abga;
-        m_pe->GetPatientAssessment(abga);
-        biogears::SEScalarAmountPerVolume bc = abga.GetStandardBicarbonate();
+        UpdateAssessment(AssessmentPanel::BLOOD_GAS);
+        biogears::SEScalarAmountPerVolume bc = bloodGas.GetStandardBicarbonate();
         return bc.GetValue(biogears::AmountPerVolumeUnit::mmol_Per_L);
     }
 
     double BiogearsThread::GetCO2() {
-        biogears::SEComprehensiveMetabolicPanel metabolicPanel;
-        m_pe->GetPatientAssessment(metabolicPanel);
+        UpdateAssessment(AssessmentPanel::METABOLIC_PANEL);
         biogears::SEScalarAmountPerVolume CO2 = metabolicPanel.GetCO2();
         return CO2.GetValue(biogears::AmountPerVolumeUnit::mmol_Per_L);
     }
 
     double BiogearsThread::GetPotassium() {
-        biogears::SEComprehensiveMetabolicPanel metabolicPanel;
-        m_pe->GetPatientAssessment(metabolicPanel);
+        UpdateAssessment(AssessmentPanel::METABOLIC_PANEL);
         biogears::SEScalarAmountPerVolume potassium = metabolicPanel.GetPotassium();
         return potassium.GetValue(biogears::AmountPerVolumeUnit::mmol_Per_L);
     }
 
     double BiogearsThread::GetChloride() {
-        biogears::SEComprehensiveMetabolicPanel metabolicPanel;
-        m_pe->GetPatientAssessment(metabolicPanel);
+        UpdateAssessment(AssessmentPanel::METABOLIC_PANEL);
         biogears::SEScalarAmountPerVolume chloride = metabolicPanel.GetChloride();
         return chloride.GetValue(biogears::AmountPerVolumeUnit::mmol_Per_L);
     }
 
 // PLT - Platelet Count - ct/uL
     double BiogearsThread::GetPlateletCount() {
-        biogears::SECompleteBloodCount CBC;
-        m_pe->GetPatientAssessment(CBC);
-        biogears::SEScalarAmountPerVolume plateletCount = CBC.GetPlateletCount();
+        UpdateAssessment(AssessmentPanel::BLOOD_COUNT);
+        biogears::SEScalarAmountPerVolume plateletCount = bloodCount.GetPlateletCount();
         return plateletCount.GetValue(biogears::AmountPerVolumeUnit::ct_Per_uL) / 1000;
     }
 
+    bool BiogearsThread::ParseAssessmentPanel(const std::string &name, AssessmentPanel &panel) {
+        std::string upper = boost::algorithm::to_upper_copy(name);
+        if (upper == "CMP" || upper == "COMPREHENSIVEMETABOLICPANEL") {
+            panel = AssessmentPanel::METABOLIC_PANEL;
+        } else if (upper == "CBC" || upper == "COMPLETEBLOODCOUNT") {
+            panel = AssessmentPanel::BLOOD_COUNT;
+        } else if (upper == "ABG" || upper == "ARTERIALBLOODGASANALYSIS") {
+            panel = AssessmentPanel::BLOOD_GAS;
+        } else if (upper == "UA" || upper == "URINALYSIS") {
+            panel = AssessmentPanel::URINALYSIS;
+        } else if (upper == "PFT" || upper == "PULMONARYFUNCTIONTEST") {
+            panel = AssessmentPanel::PULMONARY_FUNCTION;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    biogears::SEPatientAssessment &BiogearsThread::UpdateAssessment(AssessmentPanel panel) {
+        biogears::SEPatientAssessment *assessment = nullptr;
+        switch (panel) {
+            case AssessmentPanel::METABOLIC_PANEL:
+                assessment = &metabolicPanel;
+                break;
+            case AssessmentPanel::BLOOD_COUNT:
+                assessment = &bloodCount;
+                break;
+            case AssessmentPanel::BLOOD_GAS:
+                assessment = &bloodGas;
+                break;
+            case AssessmentPanel::URINALYSIS:
+                assessment = &urinalysis;
+                break;
+            case AssessmentPanel::PULMONARY_FUNCTION:
+                assessment = &pulmonaryFunction;
+                break;
+        }
+
+        // Once per engine step, however many nodes read the panel
+        uint64_t &step = assessmentSteps[static_cast<int>(panel)];
+        if (step != engineStep) {
+            m_pe->GetPatientAssessment(*assessment);
+            step = engineStep;
+        }
+        return *assessment;
+    }
+
+    namespace {
+        void AppendAssessmentValue(std::ostringstream &out, const char *name, const char *unit,
+                                   const std::function<double()> &value) {
+            try {
+                double v = value();
+                out << "<Value name='" << name << "' unit='" << unit << "' value='" << v << "'/>";
+            } catch (std::exception &e) {
+                // Not computed by this engine
+            }
+        }
+    }
+
+    std::string BiogearsThread::GetAssessment(AssessmentPanel panel) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::ostringstream out;
+        UpdateAssessment(panel);
+        double simTime = m_pe->GetSimulationTime(TimeUnit::s);
+        switch (panel) {
+            case AssessmentPanel::METABOLIC_PANEL:
+                out << "<Assessment type='CMP' simtime='" << simTime << "'>";
+                AppendAssessmentValue(out, "Albumin", "g/dL", [this]() {
+                    return metabolicPanel.GetAlbumin().GetValue(MassPerVolumeUnit::g_Per_dL);
+                });
+                AppendAssessmentValue(out, "BUN", "mg/dL", [this]() {
+                    return metabolicPanel.GetBUN().GetValue(MassPerVolumeUnit::mg_Per_dL);
+                });
+                AppendAssessmentValue(out, "Calcium", "mg/dL", [this]() {
+                    return metabolicPanel.GetCalcium().GetValue(MassPerVolumeUnit::mg_Per_dL);
+                });
+                AppendAssessmentValue(out, "Chloride", "mmol/L", [this]() {
+                    return metabolicPanel.GetChloride().GetValue(AmountPerVolumeUnit::mmol_Per_L);
+                });
+                AppendAssessmentValue(out, "CO2", "mmol/L", [this]() {
+                    return metabolicPanel.GetCO2().GetValue(AmountPerVolumeUnit::mmol_Per_L);
+                });
+                AppendAssessmentValue(out, "Creatinine", "mg/dL", [this]() {
+                    return metabolicPanel.GetCreatinine().GetValue(MassPerVolumeUnit::mg_Per_dL);
+                });
+                AppendAssessmentValue(out, "Glucose", "mg/dL", [this]() {
+                    return metabolicPanel.GetGlucose().GetValue(MassPerVolumeUnit::mg_Per_dL);
+                });
+                AppendAssessmentValue(out, "Potassium", "mmol/L", [this]() {
+                    return metabolicPanel.GetPotassium().GetValue(AmountPerVolumeUnit::mmol_Per_L);
+                });
+                AppendAssessmentValue(out, "Sodium", "mmol/L", [this]() {
+                    return metabolicPanel.GetSodium().GetValue(AmountPerVolumeUnit::mmol_Per_L);
+                });
+                AppendAssessmentValue(out, "TotalBilirubin", "mg/dL", [this]() {
+                    return metabolicPanel.GetTotalBilirubin().GetValue(MassPerVolumeUnit::mg_Per_dL);
+                });
+                AppendAssessmentValue(out, "TotalProtein", "g/dL", [this]() {
+                    return metabolicPanel.GetTotalProtein().GetValue(MassPerVolumeUnit::g_Per_dL);
+                });
+                break;
+            case AssessmentPanel::BLOOD_COUNT:
+                out << "<Assessment type='CBC' simtime='" << simTime << "'>";
+                AppendAssessmentValue(out, "Hematocrit", "fraction", [this]() {
+                    return bloodCount.GetHematocrit().GetValue();
+                });
+                AppendAssessmentValue(out, "Hemoglobin", "g/dL", [this]() {
+                    return bloodCount.GetHemoglobin().GetValue(MassPerVolumeUnit::g_Per_dL);
+                });
+                AppendAssessmentValue(out, "PlateletCount", "ct/uL", [this]() {
+                    return bloodCount.GetPlateletCount().GetValue(AmountPerVolumeUnit::ct_Per_uL);
+                });
+                AppendAssessmentValue(out, "RedBloodCellCount", "ct/uL", [this]() {
+                    return bloodCount.GetRedBloodCellCount().GetValue(AmountPerVolumeUnit::ct_Per_uL);
+                });
+                AppendAssessmentValue(out, "WhiteBloodCellCount", "ct/uL", [this]() {
+                    return bloodCount.GetWhiteBloodCellCount().GetValue(AmountPerVolumeUnit::ct_Per_uL);
+                });
+                break;
+            case AssessmentPanel::BLOOD_GAS:
+                out << "<Assessment type='ABG' simtime='" << simTime << "'>";
+                AppendAssessmentValue(out, "pH", "", [this]() {
+                    return bloodGas.GetpH().GetValue();
+                });
+                AppendAssessmentValue(out, "PartialPressureOfOxygen", "mmHg", [this]() {
+                    return bloodGas.GetPartialPressureOfOxygen().GetValue(PressureUnit::mmHg);
+                });
+                AppendAssessmentValue(out, "PartialPressureOfCarbonDioxide", "mmHg", [this]() {
+                    return bloodGas.GetPartialPressureOfCarbonDioxide().GetValue(PressureUnit::mmHg);
+                });
+                AppendAssessmentValue(out, "BaseExcess", "mmol/L", [this]() {
+                    return bloodGas.GetBaseExcess().GetValue(AmountPerVolumeUnit::mmol_Per_L);
+                });
+                AppendAssessmentValue(out, "StandardBicarbonate", "mmol/L", [this]() {
+                    return bloodGas.GetStandardBicarbonate().GetValue(AmountPerVolumeUnit::mmol_Per_L);
+                });
+                AppendAssessmentValue(out, "OxygenSaturation", "fraction", [this]() {
+                    return bloodGas.GetOxygenSaturation().GetValue();
+                });
+                break;
+            case AssessmentPanel::URINALYSIS:
+                out << "<Assessment type='UA' simtime='" << simTime << "'>";
+                AppendAssessmentValue(out, "SpecificGravity", "", [this]() {
+                    return urinalysis.GetSpecificGravity().GetValue();
+                });
+                break;
+            case AssessmentPanel::PULMONARY_FUNCTION:
+                out << "<Assessment type='PFT' simtime='" << simTime << "'>";
+                AppendAssessmentValue(out, "TidalVolume", "mL", [this]() {
+                    return pulmonaryFunction.GetTidalVolume().GetValue(VolumeUnit::mL);
+                });
+                AppendAssessmentValue(out, "VitalCapacity", "mL", [this]() {
+                    return pulmonaryFunction.GetVitalCapacity().GetValue(VolumeUnit::mL);
+                });
+                AppendAssessmentValue(out, "TotalLungCapacity", "mL", [this]() {
+                    return pulmonaryFunction.GetTotalLungCapacity().GetValue(VolumeUnit::mL);
+                });
+                AppendAssessmentValue(out, "FunctionalResidualCapacity", "mL", [this]() {
+                    return pulmonaryFunction.GetFunctionalResidualCapacity().GetValue(VolumeUnit::mL);
+                });
+                AppendAssessmentValue(out, "InspiratoryCapacity", "mL", [this]() {
+                    return pulmonaryFunction.GetInspiratoryCapacity().GetValue(VolumeUnit::mL);
+                });
+                break;
+        }
+        out << "</Assessment>";
+        return out.str();
+    }
+
     double BiogearsThread::GetUrineProductionRate() {
         return m_pe->GetRenalSystem()->GetUrineProductionRate(biogears::VolumePerTimeUnit::mL_Per_min);
     }
@@ -1147,90 +1898,45 @@ namespace AMM {
 
 // Get Left Lung Volume - mL
     double BiogearsThread::GetLeftLungVolume() {
-        lung_vol_L = leftLung->GetVolume(biogears::VolumeUnit::mL);
-        return lung_vol_L;
+        return leftLung->GetVolume(biogears::VolumeUnit::mL);
     }
 
 // Get Right Lung Volume - mL
     double BiogearsThread::GetRightLungVolume() {
-        lung_vol_R = rightLung->GetVolume(biogears::VolumeUnit::mL);
-        return lung_vol_R;
+        return rightLung->GetVolume(biogears::VolumeUnit::mL);
     }
 
-// Calculate and fetch left lung tidal volume
+// Per lung breath measures, updated every engine timestep in AdvanceTimeTick
     double BiogearsThread::GetLeftLungTidalVolume() {
-        if (falling_L) {
-            if (lung_vol_L < new_min_L)
-                new_min_L = lung_vol_L;
-            else if (lung_vol_L > new_min_L + thresh) {
-                falling_L = false;
-                min_lung_vol_L = new_min_L;
-                new_min_L = 1500.0;
-                leftLungTidalVol = max_lung_vol_L - min_lung_vol_L;
-
-                chestrise_pct_L =
-                        leftLungTidalVol * 100 / 300; // scale tidal volume to percent of max chest rise
-                if (chestrise_pct_L > 100)
-                    chestrise_pct_L = 100; // clamp the value to 0 <= chestrise_pct <= 100
-                if (chestrise_pct_L < 0)
-                    chestrise_pct_L = 0;
-            }
-        } else {
-            if (lung_vol_L > new_max_L)
-                new_max_L = lung_vol_L;
-            else if (lung_vol_L < new_max_L - thresh) {
-                falling_L = true;
-                max_lung_vol_L = new_max_L;
-                new_max_L = 0.0;
-                leftLungTidalVol = max_lung_vol_L - min_lung_vol_L;
-
-                chestrise_pct_L =
-                        leftLungTidalVol * 100 / 300; // scale tidal volume to percent of max chest rise
-                if (chestrise_pct_L > 100)
-                    chestrise_pct_L = 100; // clamp the value to 0 <= chestrise_pct <= 100
-                if (chestrise_pct_L < 0)
-                    chestrise_pct_L = 0;
-            }
-        }
-        return leftLungTidalVol;
+        return leftBreaths.GetTidalVolume();
     }
 
-// Calculate and fetch right lung tidal volume
     double BiogearsThread::GetRightLungTidalVolume() {
-        if (falling_R) {
-            if (lung_vol_R < new_min_R)
-                new_min_R = lung_vol_R;
-            else if (lung_vol_R > new_min_R + thresh) {
-                falling_R = false;
-                min_lung_vol_R = new_min_R;
-                new_min_R = 1500.0;
-                leftLungTidalVol = max_lung_vol_R - min_lung_vol_R;
-
-                chestrise_pct_R =
-                        rightLungTidalVol * 100 / 300; // scale tidal volume to percent of max chest rise
-                if (chestrise_pct_R > 100)
-                    chestrise_pct_R = 100; // clamp the value to 0 <= chestrise_pct <= 100
-                if (chestrise_pct_R < 0)
-                    chestrise_pct_R = 0;
-            }
-        } else {
-            if (lung_vol_R > new_max_R)
-                new_max_R = lung_vol_R;
-            else if (lung_vol_R < new_max_R - thresh) {
-                falling_R = true;
-                max_lung_vol_R = new_max_R;
-                new_max_R = 0.0;
-                rightLungTidalVol = max_lung_vol_R - min_lung_vol_R;
-
-                chestrise_pct_R =
-                        rightLungTidalVol * 100 / 300; // scale tidal volume to percent of max chest rise
-                if (chestrise_pct_R > 100)
-                    chestrise_pct_R = 100; // clamp the value to 0 <= chestrise_pct <= 100
-                if (chestrise_pct_R < 0)
-                    chestrise_pct_R = 0;
-            }
-        }
-        return rightLungTidalVol;
+        return rightBreaths.GetTidalVolume();
+    }
+
+    double BiogearsThread::GetLeftLungChestRise() {
+        return leftBreaths.GetChestRisePercent();
+    }
+
+    double BiogearsThread::GetRightLungChestRise() {
+        return rightBreaths.GetChestRisePercent();
+    }
+
+    double BiogearsThread::GetLeftLungIERatio() {
+        return leftBreaths.GetIERatio();
+    }
+
+    double BiogearsThread::GetRightLungIERatio() {
+        return rightBreaths.GetIERatio();
+    }
+
+    double BiogearsThread::GetLeftLungMinuteVentilation() {
+        return leftBreaths.GetMinuteVentilation();
+    }
+
+    double BiogearsThread::GetRightLungMinuteVentilation() {
+        return rightBreaths.GetMinuteVentilation();
     }
 
 
@@ -1345,7 +2051,7 @@ namespace AMM {
                         LOG_DEBUG << "Infusing at " << rateVal << " mL per min";
                         infuse.GetRate().SetValue(rateVal, biogears::VolumePerTimeUnit::mL_Per_min);
                     }
-                    m_pe->ProcessAction(infuse);
+                    ProcessAction(infuse);
                 } else {
                     biogears::SESubstance *subs = m_pe->GetSubstanceManager().GetSubstance(substance);
                     biogears::SESubstanceInfusion infuse(*subs);
@@ -1379,7 +2085,7 @@ namespace AMM {
                         LOG_DEBUG << "Infusing at " << rateVal << " mL per min";
                         infuse.GetRate().SetValue(rateVal, biogears::VolumePerTimeUnit::mL_Per_min);
                     }
-                    m_pe->ProcessAction(infuse);
+                    ProcessAction(infuse);
                 }
             } else if (type == "bolus") {
                 const biogears::SESubstance *subs = m_pe->GetSubstanceManager().GetSubstance(substance);
@@ -1421,7 +2127,7 @@ namespace AMM {
                 // IV pump only uses IV administration for right now
                 bolus.SetAdminRoute(CDM::enumBolusAdministration::Intravenous);
 
-                m_pe->ProcessAction(bolus);
+                ProcessAction(bolus);
             }
         }
         catch (std::exception &e) {
@@ -1450,7 +2156,7 @@ namespace AMM {
                 LOG_DEBUG << "Infusing at " << rate << " mL per min";
                 infuse.GetRate().SetValue(rate, biogears::VolumePerTimeUnit::mL_Per_min);
             }
-            m_pe->ProcessAction(infuse);
+            ProcessAction(infuse);
         } catch (std::exception &e) {
             LOG_ERROR << "Error processing substance bolus action: " << e.what();
         }
@@ -1483,7 +2189,7 @@ namespace AMM {
                 LOG_DEBUG << "Infusing at " << rate << " mL per min";
                 infuse.GetRate().SetValue(rate, biogears::VolumePerTimeUnit::mL_Per_min);
             }
-            m_pe->ProcessAction(infuse);
+            ProcessAction(infuse);
         } catch (std::exception &e) {
             LOG_ERROR << "Error processing substance bolus action: " << e.what();
         }
@@ -1501,7 +2207,7 @@ namespace AMM {
             } else {
                 nd.GetDose().SetValue(dose, biogears::MassUnit::g);
             }
-            m_pe->ProcessAction(nd);
+            ProcessAction(nd);
         } catch (std::exception &e) {
             LOG_ERROR << "Error processing substance nasal dose action: " << e.what();
         }
@@ -1544,7 +2250,7 @@ namespace AMM {
                 paralyzed = true;
             }
 
-            m_pe->ProcessAction(bolus);
+            ProcessAction(bolus);
         } catch (std::exception &e) {
             LOG_ERROR << "Error processing substance bolus action: " << e.what();
         }
@@ -1555,7 +2261,7 @@ namespace AMM {
         try {
             biogears::SEAirwayObstruction obstruction;
             obstruction.GetSeverity().SetValue(severity);
-            m_pe->ProcessAction(obstruction);
+            ProcessAction(obstruction);
         }
         catch (std::exception &e) {
             LOG_ERROR << "Error processing airway obstruction action: " << e.what();
@@ -1566,7 +2272,7 @@ namespace AMM {
         try {
             SEAsthmaAttack asthmaAttack;
             asthmaAttack.GetSeverity().SetValue(severity);
-            m_pe->ProcessAction(asthmaAttack);
+            ProcessAction(asthmaAttack);
         }
         catch (std::exception &e) {
             LOG_ERROR << "Error processing asthma action: " << e.what();
@@ -1584,7 +2290,7 @@ namespace AMM {
                 tbi.SetType(CDM::enumBrainInjuryType::RightFocal);
             }
             tbi.GetSeverity().SetValue(severity);
-            m_pe->ProcessAction(tbi);
+            ProcessAction(tbi);
         }
         catch (std::exception &e) {
             LOG_ERROR << "Error processing brain injury action: " << e.what();
@@ -1597,7 +2303,7 @@ namespace AMM {
             hemorrhage.SetCompartment(location);
             hemorrhage.GetInitialRate().SetValue(flow, biogears::VolumePerTimeUnit::mL_Per_min);
             hemorrhage.SetMCIS();
-            m_pe->ProcessAction(hemorrhage);
+            ProcessAction(hemorrhage);
             //m_mutex.lock();
             //if (!) {
 //                LOG_ERROR << "Unable to process action.";
@@ -1617,7 +2323,7 @@ namespace AMM {
             biogears::SEPainStimulus PainStimulus;
             PainStimulus.SetLocation(location);
             PainStimulus.GetSeverity().SetValue(severity);
-            m_pe->ProcessAction(PainStimulus);
+            ProcessAction(PainStimulus);
         }
         catch (std::exception &e) {
             LOG_ERROR << "Error processing pain action: " << e.what();
@@ -1692,7 +2398,7 @@ namespace AMM {
         }
 
         try {
-            m_pe->ProcessAction(AMConfig);
+            ProcessAction(AMConfig);
         }
         catch (std::exception &e) {
             LOG_ERROR << "Error processing ventilator action: " << e.what();
@@ -1748,7 +2454,7 @@ namespace AMM {
         }
 
         try {
-            m_pe->ProcessAction(AMConfig);
+            ProcessAction(AMConfig);
         }
         catch (std::exception &e) {
             LOG_ERROR << "Error processing BVM action: " << e.what();
@@ -1832,6 +2538,10 @@ namespace AMM {
         } else {
             LOG_INFO << "Running:\t\t\t\tFalse";
         }
+        size_t pending = scheduler.GetPendingCount();
+        if (pending > 0) {
+            LOG_INFO << "Scheduled actions:\t\t" << pending << ", next at " << scheduler.GetNextTime() << "s";
+        }
     }
 
     double BiogearsThread::GetCerebralPerfusionPressure() {
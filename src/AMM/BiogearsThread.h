@@ -1,6 +1,12 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
 #include <ctime>
+#include <functional>
+#include <limits>
 #include <mutex>
 #include <sstream>
 #include <stdexcept>
@@ -111,12 +117,39 @@
 
 #include "amm/Utility.h"
 
+#include "StateArchive.h"
+#include "StateWriter.h"
+#include "ActionScheduler.h"
+#include "AlarmEngine.h"
+#include "BreathAnalyzer.h"
+#include "CheckpointRing.h"
+#include "PhysiologyRecorder.h"
+#include "ScenarioReader.h"
+#include "SpscRing.h"
+#include "TrendEngine.h"
+
 using namespace biogears;
 
 // Forward declare what we will use in our thread
 namespace AMM {
     class EventHandler;
 
+    // A patient or anesthesia machine event transition, in the order BioGears raised them
+    struct PhysiologyEvent {
+        enum Source : uint8_t {
+            PATIENT, ANESTHESIA_MACHINE
+        };
+
+        double simTime = 0.0;
+        Source source = PATIENT;
+        int type = 0;
+        bool active = false;
+    };
+
+    enum class AssessmentPanel {
+        METABOLIC_PANEL, BLOOD_COUNT, BLOOD_GAS, URINALYSIS, PULMONARY_FUNCTION
+    };
+
     class BiogearsThread {
     public:
         explicit BiogearsThread(const std::string &stateFile);
@@ -125,23 +158,105 @@ namespace AMM {
 
         bool LoadScenario(const std::string &scenarioFile);
 
-        bool LoadScenarioFile(const std::string &scenarioFile);
+        // When live, actions that follow an AdvanceTime are scheduled for that
+        // simulation time and run by AdvanceTimeTick instead of advancing the
+        // engine; they are read only a short way ahead of the engine.
+        bool LoadScenarioFile(const std::string &scenarioFile, bool live = false);
 
         bool LoadPatient(const std::string &patientFile);
 
         bool LoadState(const std::string &stateFile, double sec);
 
+        // Captures the engine state at the current tick and hands it to a
+        // background writer; returns once the snapshot has been taken.
         bool SaveState(const std::string &stateFile);
 
+        void SetStateSavedCallback(StateWriter::Completion callback);
+
+        // In-memory snapshot of the engine at the current step
+        std::unique_ptr<CDM::PhysiologyEngineStateData> CaptureState(double &simTime);
+
+        // The newest rewind checkpoint, without touching the engine; nullptr when there is none
+        std::shared_ptr<const CDM::PhysiologyEngineStateData> GetLatestCheckpoint(double &simTime,
+                                                                                  uint64_t *sequence = nullptr);
+
+        // Sequence number and time of the newest checkpoint without loading it, 0 when there is none
+        uint64_t GetLatestCheckpointSequence(double &simTime);
+
+        // Loads a snapshot without attaching events or recording, for engines
+        // that branch off another one
+        bool LoadState(const CDM::PhysiologyEngineStateData &state, double simTime);
+
+        // Loads a snapshot of another engine and carries on as that engine,
+        // with events and recording attached as for a state file.  An engine
+        // that is already attached keeps its handler, as on a rewind.
+        bool ResumeState(const CDM::PhysiologyEngineStateData &state, double simTime, double startingVolume);
+
+        // Blood volume blood loss is measured against
+        double GetStartingBloodVolume() const;
+
+        // Restores the newest checkpoint before (now - seconds) and advances
+        // the engine from there to exactly that time, in AdvanceTime chunks.
+        // Ticks are skipped until it gets there.
+        bool Rewind(double seconds);
+
+        void SetCheckpoints(double interval, size_t depth, size_t memoryLimit);
+
         bool ExecuteXMLCommand(const std::string &cmd);
 
         bool ExecuteCommand(const std::string &cmd);
 
+        // ProcessAction under the engine lock
+        bool ProcessAction(const biogears::SEAction &action);
+
+        // Advances the engine in one step under the lock, without progress reports
+        bool AdvanceModelTime(double seconds);
+
+        // Advances the engine in short chunks, handing the engine to pending
+        // inputs between them.  Returns false when cancelled or on error.
+        bool AdvanceTime(double seconds);
+
+        // Stops running advances at the next chunk boundary, along with the
+        // rest of the scenario they belong to, and drops scheduled actions
+        void CancelAdvance();
+
+        // Input handlers bracket their engine work with these.  An advance
+        // running on another thread waits between chunks until none is pending.
+        void BeginInput();
+
+        void EndInput();
+
+        // Replay pacing: an advance on another thread stops at the first chunk
+        // boundary at or past simTime until the hold moves or is released
+        void HoldAdvanceAt(double simTime);
+
+        void ReleaseHold();
+
+        // Blocks until a held advance has reached simTime, or the background work is done
+        void WaitForHold(double simTime);
+
+        // A scenario or rewind running on the manager's scenario thread
+        void SetBackgroundWork(bool active);
+
+        bool HasBackgroundWork();
+
+        size_t GetScheduledActionCount();
+
+        bool IsAdvancing() const;
+
+        // Called on the advancing thread after every AdvanceTime chunk, outside
+        // the engine lock, with the simulation time in seconds
+        void SetAdvanceObserver(std::function<void(double)> observer);
+
+        // Simulated seconds done and requested by the running AdvanceTime
+        void GetAdvanceProgress(double &done, double &total) const;
+
         bool Execute(std::function<std::unique_ptr<biogears::PhysiologyEngine>(
                 std::unique_ptr < biogears::PhysiologyEngine > && )>
                      func);
 
-        bool scenarioLoading = false;
+        // True until a scenario's initial state is loaded and its actions start
+        std::atomic<bool> scenarioLoading{false};
 
         void Shutdown();
 
@@ -153,6 +268,9 @@ namespace AMM {
 
         double GetSimulationTime();
 
+        // Simulation time of the engine itself, read under the engine lock
+        double GetEngineTime();
+
         double GetPatientTime();
 
         std::map<std::string, double (BiogearsThread::*)()> *GetNodePathTable();
@@ -248,6 +366,69 @@ namespace AMM {
 
         void SetLogging(bool log);
 
+        // Called by the event handler from inside AdvanceModelTime
+        void QueueEvent(PhysiologyEvent::Source source, int type, bool active, const SEScalarTime *time);
+
+        // Consumer side of the event ring; one thread only.
+        bool PopEvent(PhysiologyEvent &event);
+
+        // Events lost because the ring was full
+        uint64_t GetDroppedEvents() const;
+
+        // Comma separated node paths or prefixes (Cardiovascular_*), each
+        // optionally followed by @<Hz>; fields default to every tick.
+        void SetLoggedFields(const std::string &fields);
+
+        // The node paths named by pattern, or starting with it; a trailing * forces a prefix match
+        static std::vector<std::string> ResolveNodePaths(const std::string &pattern);
+
+        // Substance_<substance>_<compartment>_Concentration in ug/mL for any substance and
+        // liquid compartment, outside the node table.  Returns a handle for
+        // GetSubstanceNode, or -1 when the substance or compartment is unknown.
+        int FindSubstanceNode(const std::string &nodePath);
+
+        double GetSubstanceNode(int index);
+
+        static bool IsSubstanceNodePath(const std::string &nodePath, std::string &substance, std::string &compartment);
+
+        // CMP, CBC, ABG, UA or PFT, or the BioGears assessment name
+        static bool ParseAssessmentPanel(const std::string &name, AssessmentPanel &panel);
+
+        // <Assessment type simtime><Value name unit value/>...</Assessment>
+        std::string GetAssessment(AssessmentPanel panel);
+
+        // Rolling statistics of the given nodes or prefixes over windows in seconds
+        void SetTrends(const std::string &nodes, const std::vector<double> &windows);
+
+        void GetTrends(std::vector<std::pair<std::string, double>> &values);
+
+        // Replaces the alarm rules; rules on unknown nodes are dropped
+        void SetAlarmRules(const std::vector<AlarmEngine::Rule> &rules);
+
+        // Alarms raised or cleared since the last call, in order
+        void TakeAlarms(std::vector<AlarmEngine::Transition> &transitions);
+
+        // Who a snapshot node is evaluated for
+        enum class SnapshotUser {
+            RECORDER, TRENDS, ALARMS
+        };
+
+        // Adds a node to the per-tick snapshot and returns its index, or -1
+        // for an unknown node.  Indices stay valid for the life of the thread.
+        // The node is evaluated on every tick a multiple of one of the divisors
+        // it was registered with, so each user reads it on ticks it was fresh.
+        // Its nodeDependencies are registered alongside and evaluated first.
+        int RegisterSnapshotNode(const std::string &nodePath, SnapshotUser user, int divisor = 1);
+
+        // Drops the user's divisors, before it registers its nodes again
+        void ReleaseSnapshotNodes(SnapshotUser user);
+
+        // Node values as of the last AdvanceTimeTick; read under the same
+        // serialization as the tick.
+        const std::vector<double> &GetSnapshot() const;
+
+        void SetBinaryStates(bool binaryStates);
+
         void SetLastFrame(int lastFrame);
 
         void Status();
@@ -256,14 +437,14 @@ namespace AMM {
 
         static std::map<std::string, double (BiogearsThread::*)()> nodePathTable;
         static std::vector <std::string> highFrequencyNodes;
+        // Nodes whose getters read values cached by other getters, which have to run first
+        static std::map<std::string, std::vector<std::string>> nodeDependencies;
 
         bool paralyzed = false;
         bool paralyzedSent = false;
         bool irreversible = false;
         bool irreversibleSent = false;
-        bool startOfExhale = false;
-        bool startOfInhale = false;
-        EventHandler *myEventHandler;
+        EventHandler *myEventHandler = nullptr;
 
     private:
 
@@ -407,6 +588,18 @@ namespace AMM {
 
         double GetRightLungTidalVolume();
 
+        double GetLeftLungChestRise();
+
+        double GetRightLungChestRise();
+
+        double GetLeftLungIERatio();
+
+        double GetRightLungIERatio();
+
+        double GetLeftLungMinuteVentilation();
+
+        double GetRightLungMinuteVentilation();
+
         double GetLeftPleuralCavityVolume();
 
         double GetRightPleuralCavityVolume();
@@ -471,21 +664,63 @@ namespace AMM {
         const biogears::SELiquidCompartment *bladder;
 
     protected:
+        // Caller holds m_mutex
+        void PreloadSubstances();
+
+        // Recording and the event handler, once a state is loaded
+        void AttachEngine();
+
+        // Caller holds m_mutex
+        int AddSnapshotNode(const std::string &nodePath, const std::pair<SnapshotUser, int> &request);
+
+        // Caller holds m_mutex
+        void UpdateSnapshot();
+
+        void StartRecording();
+
+        // Caller holds m_mutex
+        void RecordTick(double simTime);
+
+        // Caller holds m_mutex
+        int ResolveSubstanceNode(const std::string &nodePath);
+
+        // Cancelled once cancelGeneration moves past generation
+        bool AdvanceTime(double seconds, uint64_t generation);
+
+        // Between chunks: waits out pending inputs, false once cancelled
+        bool WaitForTurn(uint64_t generation);
+
+        // Runs the assessment unless it already ran this engine step
+        biogears::SEPatientAssessment &UpdateAssessment(AssessmentPanel panel);
+
         std::mutex m_mutex;
         std::unique_ptr <biogears::PhysiologyEngine> m_pe;
         // biogears::SEPatient m_patient;
 
-        double thresh = 1.0;
-
-        bool falling_L;
-        double lung_vol_L, new_min_L, new_max_L, min_lung_vol_L, max_lung_vol_L;
-        double chestrise_pct_L;
-        double leftLungTidalVol;
-
-        bool falling_R;
-        double lung_vol_R, new_min_R, new_max_R, min_lung_vol_R, max_lung_vol_R;
-        double chestrise_pct_R;
-        double rightLungTidalVol;
+        BreathAnalyzer leftBreaths;
+        BreathAnalyzer rightBreaths;
+
+        struct SubstanceNode {
+            std::string substanceName;
+            std::string compartmentName;
+            const biogears::SESubstance *substance = nullptr;
+            const biogears::SELiquidCompartment *compartment = nullptr;
+            biogears::SELiquidSubstanceQuantity *quantity = nullptr;
+        };
+        std::vector<SubstanceNode> substanceNodes;
+        std::map<std::string, int> substanceNodeIndex;
+
+        // Cached assessment panels, valid while assessmentSteps matches engineStep
+        biogears::SEComprehensiveMetabolicPanel metabolicPanel;
+        biogears::SECompleteBloodCount bloodCount;
+        biogears::SEArterialBloodGasAnalysis bloodGas;
+        biogears::SEUrinalysis urinalysis;
+        biogears::SEPulmonaryFunctionTest pulmonaryFunction;
+        uint64_t engineStep = 1;
+        uint64_t assessmentSteps[5] = {};
+
+        TrendEngine trends;
+        AlarmEngine alarms;
 
         bool eventHandlerAttached = false;
 
@@ -499,10 +734,83 @@ namespace AMM {
 
         int lastFrame = 0;
 
-        // Log every 50th frame
-        int loggingFrequency = 50;
-
         bool logging_enabled = false;
 
+        // Write a compact binary archive next to every saved state file
+        bool binary_states_enabled = false;
+
+        CheckpointRing checkpoints;
+
+        std::vector<std::string> snapshotPaths;
+        std::vector<double (BiogearsThread::*)()> snapshotGetters;
+        // Substance node handle for entries without a getter
+        std::vector<int> snapshotSubstanceNodes;
+        // (user, divisor) pairs each node was registered with
+        std::vector<std::vector<std::pair<SnapshotUser, int>>> snapshotDivisors;
+        std::vector<double> snapshot;
+        uint64_t snapshotTick = 0;
+
+        std::atomic<bool> advancing{false};
+        std::atomic<bool> rewinding{false};
+        // Bumped by CancelAdvance; advances started before the bump stop
+        std::atomic<uint64_t> cancelGeneration{0};
+        std::atomic<double> advanceDone{0.0};
+        std::atomic<double> advanceTotal{0.0};
+        std::function<void(double)> advanceObserver;
+
+        std::mutex handoffMutex;
+        std::condition_variable handoff;
+        int pendingInputs = 0;
+        double advanceLimit = std::numeric_limits<double>::infinity();
+        bool held = false;
+        double heldAt = 0.0;
+        bool backgroundWork = false;
+
+        ActionScheduler scheduler;
+        // The unscheduled rest of a live scenario, dropped when it is cancelled
+        std::unique_ptr<LiveScenarioFeed> liveScenario;
+        uint64_t liveScenarioGeneration = 0;
+        std::vector<std::shared_ptr<const biogears::SEAction>> dueActions;
+
+        SpscRing<PhysiologyEvent> events{4096};
+        std::atomic<uint64_t> droppedEvents{0};
+
+        struct RecordedTable {
+            std::string name;
+            int divisor = 1;
+            std::vector<int> nodes;
+            std::vector<std::string> columns;
+            std::vector<double> row;
+        };
+        std::vector<RecordedTable> recordedTables;
+
+        // From the module configuration; empty records the defaults every tick
+        std::string loggedFields;
+
+        // Nodes recorded with -l when no fields are configured
+        std::vector<std::string> defaultLoggedNodes = {"Cardiovascular_HeartRate",
+                                                       "Cardiovascular_Arterial_Mean_Pressure",
+                                                       "Cardiovascular_Arterial_Systolic_Pressure",
+                                                       "Cardiovascular_Arterial_Diastolic_Pressure",
+                                                       "Respiratory_Respiration_Rate",
+                                                       "Respiratory_Tidal_Volume",
+                                                       "Respiratory_LungTotal_Volume",
+                                                       "Respiratory_LeftLung_Volume",
+                                                       "Respiratory_RightLung_Volume",
+                                                       "BloodChemistry_Oxygen_Saturation",
+                                                       "Respiratory_Inspiratory_Flow",
+                                                       "Cardiovascular_BloodVolume",
+                                                       "BloodChemistry_BloodPH_RAW",
+                                                       "Substance_Lactate_Concentration",
+                                                       "Renal_UrineProductionRate",
+                                                       "Respiratory_CarbonDioxide_Exhaled",
+                                                       "Respiratory_TotalPressure",
+                                                       "Substance_BaseExcess"};
+
+        PhysiologyRecorder recorder;
+
+        StateWriter stateWriter;
+        StateWriter::Completion stateSavedCallback;
+
     };
 }
@@ -0,0 +1,108 @@
+#include "BreathAnalyzer.h"
+
+#include <algorithm>
+
+namespace AMM {
+    BreathAnalyzer::BreathAnalyzer(double threshold, double fullChestRise) : m_threshold(threshold),
+                                                                            m_fullChestRise(fullChestRise) {
+        Reset();
+    }
+
+    void BreathAnalyzer::Reset() {
+        m_primed = false;
+        m_falling = false;
+        m_extreme = 0.0;
+        m_extremeTime = 0.0;
+        m_troughVolume = 0.0;
+        m_troughTime = 0.0;
+        m_peakVolume = 0.0;
+        m_peakTime = 0.0;
+        m_haveTrough = false;
+        m_havePeak = false;
+        m_tidalVolume = 0.0;
+        m_chestRise = 0.0;
+        m_ieRatio = 0.0;
+        m_minuteVentilation = 0.0;
+    }
+
+    bool BreathAnalyzer::Sample(double simTime, double volume) {
+        if (!m_primed) {
+            m_primed = true;
+            m_extreme = volume;
+            m_extremeTime = simTime;
+            return false;
+        }
+
+        if (!m_falling) {
+            if (volume > m_extreme) {
+                m_extreme = volume;
+                m_extremeTime = simTime;
+                return false;
+            }
+            if (volume > m_extreme - m_threshold) {
+                return false;
+            }
+
+            // Past a peak: end of inspiration
+            m_falling = true;
+            m_peakVolume = m_extreme;
+            m_peakTime = m_extremeTime;
+            m_extreme = volume;
+            m_extremeTime = simTime;
+            if (m_haveTrough) {
+                m_havePeak = true;
+                m_tidalVolume = m_peakVolume - m_troughVolume;
+                m_chestRise = std::min(std::max(m_tidalVolume * 100.0 / m_fullChestRise, 0.0), 100.0);
+            }
+            return false;
+        }
+
+        if (volume < m_extreme) {
+            m_extreme = volume;
+            m_extremeTime = simTime;
+            return false;
+        }
+        if (volume < m_extreme + m_threshold) {
+            return false;
+        }
+
+        // Past a trough: end of expiration, and of the breath that began at the last trough
+        m_falling = false;
+        bool completed = false;
+        if (m_havePeak) {
+            double inspiration = m_peakTime - m_troughTime;
+            double expiration = m_extremeTime - m_peakTime;
+            double period = m_extremeTime - m_troughTime;
+            if (expiration > 0.0) {
+                m_ieRatio = inspiration / expiration;
+            }
+            if (period > 0.0) {
+                m_minuteVentilation = m_tidalVolume * 60.0 / period;
+            }
+            completed = true;
+        }
+        m_troughVolume = m_extreme;
+        m_troughTime = m_extremeTime;
+        m_haveTrough = true;
+        m_havePeak = false;
+        m_extreme = volume;
+        m_extremeTime = simTime;
+        return completed;
+    }
+
+    double BreathAnalyzer::GetTidalVolume() const {
+        return m_tidalVolume;
+    }
+
+    double BreathAnalyzer::GetChestRisePercent() const {
+        return m_chestRise;
+    }
+
+    double BreathAnalyzer::GetIERatio() const {
+        return m_ieRatio;
+    }
+
+    double BreathAnalyzer::GetMinuteVentilation() const {
+        return m_minuteVentilation;
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+namespace AMM {
+    // Follows a lung volume signal sample by sample and reports the last
+    // complete breath.  Peaks and troughs are detected with a small
+    // hysteresis so flow noise at the turning points is ignored.
+    class BreathAnalyzer {
+    public:
+        // threshold is the volume change in mL that confirms a turn,
+        // fullChestRise the tidal volume in mL shown as 100% chest rise.
+        explicit BreathAnalyzer(double threshold = 1.0, double fullChestRise = 300.0);
+
+        void Reset();
+
+        // Volume in mL at simTime in seconds.  Returns true when the sample
+        // completed a breath.
+        bool Sample(double simTime, double volume);
+
+        // Volume inspired in the last breath, mL
+        double GetTidalVolume() const;
+
+        // Last tidal volume scaled to the full chest rise, 0 to 100
+        double GetChestRisePercent() const;
+
+        // Inspiratory over expiratory time of the last complete breath
+        double GetIERatio() const;
+
+        // Tidal volume over the last breath period, mL/min
+        double GetMinuteVentilation() const;
+
+    private:
+        double m_threshold;
+        double m_fullChestRise;
+
+        bool m_primed;
+        bool m_falling;
+        double m_extreme;
+        double m_extremeTime;
+
+        double m_troughVolume;
+        double m_troughTime;
+        double m_peakVolume;
+        double m_peakTime;
+        bool m_haveTrough;
+        bool m_havePeak;
+
+        double m_tidalVolume;
+        double m_chestRise;
+        double m_ieRatio;
+        double m_minuteVentilation;
+    };
+}
@@ -0,0 +1,217 @@
+#include "CheckpointRing.h"
+
+#include <algorithm>
+
+#include "StateArchive.h"
+
+#include "amm/BaseLogger.h"
+
+namespace AMM {
+    std::atomic<uint64_t> CheckpointRing::s_sequence{0};
+
+    CheckpointRing::~CheckpointRing() {
+        Stop();
+    }
+
+    void CheckpointRing::Stop() {
+        m_mutex.lock();
+        m_stopping = true;
+        m_pending.clear();
+        m_mutex.unlock();
+        m_pendingAvailable.notify_all();
+
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+    }
+
+    void CheckpointRing::Configure(double interval, size_t depth, size_t memoryLimit) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_interval = interval;
+        m_depth = std::max<size_t>(depth, 1);
+        m_memoryLimit = memoryLimit;
+        if (m_interval <= 0.0) {
+            m_checkpoints.clear();
+            m_pending.clear();
+            m_memoryUsage = 0;
+        } else {
+            Trim();
+        }
+    }
+
+    bool CheckpointRing::IsEnabled() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_interval > 0.0;
+    }
+
+    bool CheckpointRing::IsDue(double simTime) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_interval <= 0.0) {
+            return false;
+        }
+        return m_checkpoints.empty() || simTime - m_lastCheckpoint >= m_interval;
+    }
+
+    void CheckpointRing::Add(double simTime, std::unique_ptr<CDM::PhysiologyEngineStateData> state) {
+        if (state == nullptr) {
+            return;
+        }
+
+        auto checkpoint = std::make_shared<Checkpoint>();
+        checkpoint->simTime = simTime;
+        checkpoint->sequence = ++s_sequence;
+        checkpoint->state = std::move(state);
+
+        m_mutex.lock();
+        if (m_stopping) {
+            m_mutex.unlock();
+            return;
+        }
+        if (!m_thread.joinable()) {
+            m_thread = std::thread(&CheckpointRing::Run, this);
+        }
+        // Uncompressed snapshots count too, so a compressor that falls behind cannot outgrow the limit
+        checkpoint->charge = m_stateEstimate;
+        m_memoryUsage += checkpoint->charge;
+        m_checkpoints.push_back(checkpoint);
+        m_pending.push_back(checkpoint);
+        m_lastCheckpoint = simTime;
+        Trim();
+        m_mutex.unlock();
+        m_pendingAvailable.notify_one();
+    }
+
+    std::shared_ptr<const CDM::PhysiologyEngineStateData> CheckpointRing::Find(double simTime,
+                                                                              double &checkpointTime,
+                                                                              uint64_t *sequence) {
+        std::shared_ptr<Checkpoint> checkpoint;
+        std::shared_ptr<const CDM::PhysiologyEngineStateData> state;
+        m_mutex.lock();
+        for (auto it = m_checkpoints.rbegin(); it != m_checkpoints.rend(); ++it) {
+            if ((*it)->simTime <= simTime) {
+                checkpoint = *it;
+                state = checkpoint->state;
+                break;
+            }
+        }
+        m_mutex.unlock();
+
+        if (checkpoint == nullptr) {
+            return nullptr;
+        }
+        checkpointTime = checkpoint->simTime;
+        if (sequence != nullptr) {
+            *sequence = checkpoint->sequence;
+        }
+
+        // Not compressed yet, the snapshot can be used as is
+        if (state != nullptr) {
+            return state;
+        }
+
+        // The payload is never touched again once the snapshot has been released
+        std::string stateXml;
+        if (!StateArchive::Decompress(checkpoint->payload, checkpoint->stateSize, stateXml)) {
+            return nullptr;
+        }
+        return std::shared_ptr<const CDM::PhysiologyEngineStateData>(StateArchive::Parse(stateXml));
+    }
+
+    uint64_t CheckpointRing::GetLatest(double &checkpointTime) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_checkpoints.empty()) {
+            return 0;
+        }
+        checkpointTime = m_checkpoints.back()->simTime;
+        return m_checkpoints.back()->sequence;
+    }
+
+    void CheckpointRing::DiscardAfter(double simTime) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        while (!m_checkpoints.empty() && m_checkpoints.back()->simTime > simTime) {
+            m_memoryUsage -= m_checkpoints.back()->charge;
+            m_checkpoints.pop_back();
+        }
+        while (!m_pending.empty() && m_pending.back()->simTime > simTime) {
+            m_pending.pop_back();
+        }
+        if (!m_checkpoints.empty()) {
+            m_lastCheckpoint = m_checkpoints.back()->simTime;
+        }
+    }
+
+    void CheckpointRing::Clear() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_checkpoints.clear();
+        m_pending.clear();
+        m_memoryUsage = 0;
+    }
+
+    size_t CheckpointRing::GetCount() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_checkpoints.size();
+    }
+
+    size_t CheckpointRing::GetMemoryUsage() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_memoryUsage;
+    }
+
+    void CheckpointRing::Trim() {
+        // Always keep the newest checkpoint, whatever its size
+        while (m_checkpoints.size() > 1 &&
+               (m_checkpoints.size() > m_depth || (m_memoryLimit > 0 && m_memoryUsage > m_memoryLimit))) {
+            Release(m_checkpoints.front());
+            m_checkpoints.pop_front();
+        }
+    }
+
+    void CheckpointRing::Release(const std::shared_ptr<Checkpoint> &checkpoint) {
+        m_memoryUsage -= checkpoint->charge;
+        auto pending = std::find(m_pending.begin(), m_pending.end(), checkpoint);
+        if (pending != m_pending.end()) {
+            m_pending.erase(pending);
+        }
+    }
+
+    void CheckpointRing::Run() {
+        while (true) {
+            std::shared_ptr<Checkpoint> checkpoint;
+            std::shared_ptr<const CDM::PhysiologyEngineStateData> state;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_pendingAvailable.wait(lock, [this] { return m_stopping || !m_pending.empty(); });
+                if (m_stopping) {
+                    return;
+                }
+                checkpoint = m_pending.front();
+                m_pending.pop_front();
+                state = checkpoint->state;
+            }
+
+            std::string stateXml;
+            std::string payload;
+            if (!StateArchive::Serialize(*state, stateXml) || !StateArchive::Compress(stateXml, payload)) {
+                LOG_WARNING << "Unable to compress checkpoint at " << checkpoint->simTime << "s, keeping it as is.";
+                continue;
+            }
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            checkpoint->payload.swap(payload);
+            checkpoint->stateSize = stateXml.size();
+            checkpoint->state.reset();
+            m_stateEstimate = stateXml.size();
+
+            // Only recount checkpoints that are still in the ring
+            for (const auto &held : m_checkpoints) {
+                if (held == checkpoint) {
+                    m_memoryUsage -= checkpoint->charge;
+                    checkpoint->charge = checkpoint->payload.size();
+                    m_memoryUsage += checkpoint->charge;
+                    Trim();
+                    break;
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <biogears/cdm/CommonDataModel.h>
+#include <biogears/schema/cdm/EngineState.hxx>
+
+namespace AMM {
+    // Rolling set of in-memory engine snapshots used to rewind the simulation.
+    // Snapshots are captured on the engine thread and compressed on a
+    // background thread; the ring is bounded both by count and by the
+    // memory its snapshots hold.  A snapshot still waiting to be compressed
+    // is charged at the serialized size of the last one that was.  The
+    // compressor starts with the first checkpoint, so an idle engine can
+    // still be forked.
+    class CheckpointRing {
+    public:
+        CheckpointRing() = default;
+
+        ~CheckpointRing();
+
+        // Joins the compressor; checkpoints added afterwards are dropped.
+        void Stop();
+
+        // An interval of 0 disables checkpointing and drops what is held.
+        void Configure(double interval, size_t depth, size_t memoryLimit);
+
+        bool IsEnabled();
+
+        // True when the last checkpoint is at least one interval older than simTime.
+        bool IsDue(double simTime);
+
+        void Add(double simTime, std::unique_ptr<CDM::PhysiologyEngineStateData> state);
+
+        // Newest checkpoint taken at or before simTime, or nullptr when there is none.
+        std::shared_ptr<const CDM::PhysiologyEngineStateData> Find(double simTime, double &checkpointTime,
+                                                                   uint64_t *sequence = nullptr);
+
+        // Sequence number of the newest checkpoint, 0 when there is none.  Numbers
+        // grow across every ring, so a new checkpoint never repeats an old one.
+        uint64_t GetLatest(double &checkpointTime);
+
+        // Forget checkpoints newer than simTime, after rewinding past them.
+        void DiscardAfter(double simTime);
+
+        void Clear();
+
+        size_t GetCount();
+
+        size_t GetMemoryUsage();
+
+    private:
+        struct Checkpoint {
+            double simTime = 0.0;
+            uint64_t sequence = 0;
+            // Held until the background thread has compressed it
+            std::shared_ptr<const CDM::PhysiologyEngineStateData> state;
+            std::string payload;
+            size_t stateSize = 0;
+            // Bytes counted against the memory limit
+            size_t charge = 0;
+        };
+
+        void Run();
+
+        void Trim();
+
+        void Release(const std::shared_ptr<Checkpoint> &checkpoint);
+
+        std::deque<std::shared_ptr<Checkpoint>> m_checkpoints;
+        std::deque<std::shared_ptr<Checkpoint>> m_pending;
+        std::mutex m_mutex;
+        std::condition_variable m_pendingAvailable;
+        std::thread m_thread;
+        bool m_stopping = false;
+
+        double m_interval = 0.0;
+        size_t m_depth = 0;
+        size_t m_memoryLimit = 0;
+        size_t m_memoryUsage = 0;
+        size_t m_stateEstimate = 0;
+        double m_lastCheckpoint = 0.0;
+
+        static std::atomic<uint64_t> s_sequence;
+    };
+}
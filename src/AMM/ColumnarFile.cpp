@@ -0,0 +1,354 @@
+#include "ColumnarFile.h"
+
+#include <cstring>
+
+#include "BinaryIO.h"
+#include "amm/BaseLogger.h"
+
+namespace AMM {
+    namespace {
+        const char FileMagic[8] = {'A', 'M', 'M', 'C', 'O', 'L', 'S', '\0'};
+        const char TrailerMagic[8] = {'A', 'M', 'M', 'C', 'O', 'L', 'I', 'X'};
+
+        const uint32_t TableTag = 0x4C424154;  // "TABL"
+        const uint32_t ChunkTag = 0x4B4E4843;  // "CHNK"
+        const uint32_t IndexTag = 0x58444E49;  // "INDX"
+
+        // magic + version
+        const uint64_t HeaderSize = sizeof(FileMagic) + sizeof(uint32_t);
+        // tag + table + rows
+        const uint64_t ChunkHeaderSize = 3 * sizeof(uint32_t);
+
+        void WriteTableDefinition(std::ostream &out, uint32_t id, const std::string &name,
+                                  const std::vector<std::string> &columns) {
+            WriteValue(out, id);
+            WriteString(out, name);
+            WriteValue(out, static_cast<uint32_t>(columns.size()));
+            for (const auto &column : columns) {
+                WriteString(out, column);
+            }
+        }
+
+        bool ReadTableDefinition(std::istream &in, uint32_t &id, ColumnarReader::Table &table) {
+            uint32_t columns = 0;
+            if (!ReadValue(in, id) || !ReadString(in, table.name) || !ReadValue(in, columns)) {
+                return false;
+            }
+            table.columns.resize(columns);
+            for (auto &column : table.columns) {
+                if (!ReadString(in, column)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+
+    const uint32_t ColumnarWriter::FormatVersion;
+
+    ColumnarWriter::~ColumnarWriter() {
+        Close();
+    }
+
+    bool ColumnarWriter::Open(const std::string &file) {
+        Close();
+        m_out.open(file, std::ios::binary | std::ios::trunc);
+        if (!m_out.is_open()) {
+            LOG_ERROR << "Unable to open columnar file " << file;
+            return false;
+        }
+        m_columnCounts.clear();
+        m_tables.clear();
+        m_index.clear();
+
+        m_out.write(FileMagic, sizeof(FileMagic));
+        WriteValue(m_out, FormatVersion);
+        return static_cast<bool>(m_out);
+    }
+
+    bool ColumnarWriter::IsOpen() const {
+        return m_out.is_open();
+    }
+
+    uint32_t ColumnarWriter::AddTable(const std::string &name, const std::vector<std::string> &columns) {
+        auto id = static_cast<uint32_t>(m_columnCounts.size());
+        m_columnCounts.push_back(static_cast<uint32_t>(columns.size()));
+        // The index repeats the definitions so a reader never has to scan for them
+        m_tables.emplace_back(name, columns);
+
+        if (m_out.is_open()) {
+            WriteValue(m_out, TableTag);
+            WriteTableDefinition(m_out, id, name, columns);
+        }
+        return id;
+    }
+
+    bool ColumnarWriter::WriteChunk(uint32_t table, const double *rows, uint32_t rowCount) {
+        if (!m_out.is_open() || table >= m_columnCounts.size() || rowCount == 0) {
+            return false;
+        }
+
+        uint32_t columns = m_columnCounts[table];
+        IndexEntry entry;
+        entry.table = table;
+        entry.rows = rowCount;
+        entry.offset = static_cast<uint64_t>(m_out.tellp());
+        entry.firstKey = columns > 0 ? rows[0] : 0.0;
+        entry.lastKey = columns > 0 ? rows[(rowCount - 1) * columns] : 0.0;
+
+        // Transpose to column-major so a reader can pull one column without the rest
+        m_columnBuffer.resize(static_cast<size_t>(columns) * rowCount);
+        for (uint32_t c = 0; c < columns; ++c) {
+            double *column = &m_columnBuffer[static_cast<size_t>(c) * rowCount];
+            for (uint32_t r = 0; r < rowCount; ++r) {
+                column[r] = rows[static_cast<size_t>(r) * columns + c];
+            }
+        }
+
+        WriteValue(m_out, ChunkTag);
+        WriteValue(m_out, table);
+        WriteValue(m_out, rowCount);
+        m_out.write(reinterpret_cast<const char *>(m_columnBuffer.data()), m_columnBuffer.size() * sizeof(double));
+        if (!m_out) {
+            LOG_ERROR << "Unable to write columnar chunk";
+            return false;
+        }
+        m_index.push_back(entry);
+        return true;
+    }
+
+    bool ColumnarWriter::Close() {
+        if (!m_out.is_open()) {
+            return true;
+        }
+
+        auto indexOffset = static_cast<uint64_t>(m_out.tellp());
+        WriteValue(m_out, IndexTag);
+        WriteValue(m_out, static_cast<uint32_t>(m_tables.size()));
+        for (uint32_t id = 0; id < m_tables.size(); ++id) {
+            WriteTableDefinition(m_out, id, m_tables[id].first, m_tables[id].second);
+        }
+        WriteValue(m_out, static_cast<uint64_t>(m_index.size()));
+        for (const auto &entry : m_index) {
+            WriteValue(m_out, entry.table);
+            WriteValue(m_out, entry.rows);
+            WriteValue(m_out, entry.offset);
+            WriteValue(m_out, entry.firstKey);
+            WriteValue(m_out, entry.lastKey);
+        }
+        WriteValue(m_out, indexOffset);
+        m_out.write(TrailerMagic, sizeof(TrailerMagic));
+
+        bool written = static_cast<bool>(m_out);
+        m_out.close();
+        m_index.clear();
+        m_tables.clear();
+        return written;
+    }
+
+    bool ColumnarReader::Open(const std::string &file) {
+        m_in.open(file, std::ios::binary);
+        if (!m_in.is_open()) {
+            LOG_ERROR << "Unable to open columnar file " << file;
+            return false;
+        }
+
+        char magic[sizeof(FileMagic)];
+        uint32_t version = 0;
+        if (!m_in.read(magic, sizeof(magic)) || memcmp(magic, FileMagic, sizeof(magic)) != 0 ||
+            !ReadValue(m_in, version) || version != ColumnarWriter::FormatVersion) {
+            LOG_ERROR << "Not a readable columnar file: " << file;
+            return false;
+        }
+
+        if (ReadIndex()) {
+            return true;
+        }
+
+        LOG_WARNING << "Columnar file " << file << " has no index, it was not closed cleanly. Scanning chunks.";
+        return ScanChunks();
+    }
+
+    bool ColumnarReader::ReadIndex() {
+        m_in.clear();
+        m_in.seekg(0, std::ios::end);
+        auto fileSize = static_cast<uint64_t>(m_in.tellg());
+        uint64_t trailerSize = sizeof(uint64_t) + sizeof(TrailerMagic);
+        if (fileSize < HeaderSize + trailerSize) {
+            return false;
+        }
+
+        uint64_t indexOffset = 0;
+        char magic[sizeof(TrailerMagic)];
+        m_in.seekg(fileSize - trailerSize);
+        if (!ReadValue(m_in, indexOffset) || !m_in.read(magic, sizeof(magic)) ||
+            memcmp(magic, TrailerMagic, sizeof(magic)) != 0 || indexOffset >= fileSize) {
+            return false;
+        }
+
+        m_in.seekg(indexOffset);
+        uint32_t tag = 0;
+        uint32_t tableCount = 0;
+        if (!ReadValue(m_in, tag) || tag != IndexTag || !ReadValue(m_in, tableCount)) {
+            return false;
+        }
+
+        m_tables.assign(tableCount, Table());
+        for (uint32_t i = 0; i < tableCount; ++i) {
+            uint32_t id = 0;
+            Table table;
+            if (!ReadTableDefinition(m_in, id, table) || id >= tableCount) {
+                return false;
+            }
+            m_tables[id] = table;
+        }
+
+        uint64_t chunkCount = 0;
+        if (!ReadValue(m_in, chunkCount)) {
+            return false;
+        }
+        m_chunks.clear();
+        m_chunks.reserve(chunkCount);
+        for (uint64_t i = 0; i < chunkCount; ++i) {
+            Chunk chunk;
+            double firstKey = 0.0;
+            double lastKey = 0.0;
+            if (!ReadValue(m_in, chunk.table) || !ReadValue(m_in, chunk.rows) || !ReadValue(m_in, chunk.offset) ||
+                !ReadValue(m_in, firstKey) || !ReadValue(m_in, lastKey)) {
+                return false;
+            }
+            m_chunks.push_back(chunk);
+        }
+        return true;
+    }
+
+    bool ColumnarReader::ScanChunks() {
+        m_tables.clear();
+        m_chunks.clear();
+        m_in.clear();
+        m_in.seekg(HeaderSize);
+
+        uint32_t tag = 0;
+        while (ReadValue(m_in, tag)) {
+            if (tag == TableTag) {
+                uint32_t id = 0;
+                Table table;
+                if (!ReadTableDefinition(m_in, id, table)) {
+                    break;
+                }
+                if (id >= m_tables.size()) {
+                    m_tables.resize(id + 1);
+                }
+                m_tables[id] = table;
+            } else if (tag == ChunkTag) {
+                Chunk chunk;
+                chunk.offset = static_cast<uint64_t>(m_in.tellg()) - sizeof(tag);
+                if (!ReadValue(m_in, chunk.table) || !ReadValue(m_in, chunk.rows) ||
+                    chunk.table >= m_tables.size()) {
+                    break;
+                }
+                uint64_t size = static_cast<uint64_t>(m_tables[chunk.table].columns.size()) * chunk.rows *
+                                sizeof(double);
+                m_in.seekg(size, std::ios::cur);
+                m_chunks.push_back(chunk);
+            } else {
+                break;
+            }
+        }
+
+        // A chunk cut short by a crash is dropped
+        m_in.clear();
+        m_in.seekg(0, std::ios::end);
+        auto fileSize = static_cast<uint64_t>(m_in.tellg());
+        while (!m_chunks.empty()) {
+            const Chunk &last = m_chunks.back();
+            uint64_t end = last.offset + ChunkHeaderSize +
+                           static_cast<uint64_t>(m_tables[last.table].columns.size()) * last.rows * sizeof(double);
+            if (end <= fileSize) {
+                break;
+            }
+            m_chunks.pop_back();
+        }
+        return !m_tables.empty();
+    }
+
+    const std::vector<ColumnarReader::Table> &ColumnarReader::GetTables() const {
+        return m_tables;
+    }
+
+    int ColumnarReader::FindTable(const std::string &name) const {
+        for (size_t i = 0; i < m_tables.size(); ++i) {
+            if (m_tables[i].name == name) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    uint64_t ColumnarReader::GetRowCount(uint32_t table) const {
+        uint64_t rows = 0;
+        for (const auto &chunk : m_chunks) {
+            if (chunk.table == table) {
+                rows += chunk.rows;
+            }
+        }
+        return rows;
+    }
+
+    bool ColumnarReader::ReadTable(uint32_t table, std::vector<double> &rows) {
+        rows.clear();
+        if (table >= m_tables.size()) {
+            return false;
+        }
+
+        size_t columns = m_tables[table].columns.size();
+        rows.reserve(GetRowCount(table) * columns);
+        std::vector<double> buffer;
+        for (const auto &chunk : m_chunks) {
+            if (chunk.table != table) {
+                continue;
+            }
+
+            buffer.resize(columns * chunk.rows);
+            m_in.clear();
+            m_in.seekg(chunk.offset + ChunkHeaderSize);
+            if (!m_in.read(reinterpret_cast<char *>(buffer.data()), buffer.size() * sizeof(double))) {
+                LOG_ERROR << "Columnar chunk is truncated";
+                return false;
+            }
+
+            size_t first = rows.size();
+            rows.resize(first + buffer.size());
+            for (size_t c = 0; c < columns; ++c) {
+                for (size_t r = 0; r < chunk.rows; ++r) {
+                    rows[first + r * columns + c] = buffer[c * chunk.rows + r];
+                }
+            }
+        }
+        return true;
+    }
+
+    bool ColumnarReader::ReadColumn(uint32_t table, uint32_t column, std::vector<double> &values) {
+        values.clear();
+        if (table >= m_tables.size() || column >= m_tables[table].columns.size()) {
+            return false;
+        }
+
+        values.reserve(GetRowCount(table));
+        for (const auto &chunk : m_chunks) {
+            if (chunk.table != table) {
+                continue;
+            }
+
+            size_t first = values.size();
+            values.resize(first + chunk.rows);
+            m_in.clear();
+            m_in.seekg(chunk.offset + ChunkHeaderSize + static_cast<uint64_t>(column) * chunk.rows * sizeof(double));
+            if (!m_in.read(reinterpret_cast<char *>(&values[first]), chunk.rows * sizeof(double))) {
+                LOG_ERROR << "Columnar chunk is truncated";
+                return false;
+            }
+        }
+        return true;
+    }
+}
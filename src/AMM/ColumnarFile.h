@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace AMM {
+    // Chunked columnar file of fixed-width doubles.  A file holds one or more
+    // tables; each chunk stores a block of rows of one table column by column,
+    // and an index of chunks (with the key range of the first column) is
+    // appended on close.  A file that was never closed is still readable, the
+    // reader falls back to scanning the chunks.
+    class ColumnarWriter {
+    public:
+        static const uint32_t FormatVersion = 1;
+
+        ColumnarWriter() = default;
+
+        ~ColumnarWriter();
+
+        bool Open(const std::string &file);
+
+        bool IsOpen() const;
+
+        // The first column of every table is its row key, usually simulation time.
+        uint32_t AddTable(const std::string &name, const std::vector<std::string> &columns);
+
+        // rows holds rowCount rows of the table's column count, row-major.
+        bool WriteChunk(uint32_t table, const double *rows, uint32_t rowCount);
+
+        // Writes the chunk index and trailer.
+        bool Close();
+
+    private:
+        struct IndexEntry {
+            uint32_t table;
+            uint32_t rows;
+            uint64_t offset;
+            double firstKey;
+            double lastKey;
+        };
+
+        std::ofstream m_out;
+        std::vector<uint32_t> m_columnCounts;
+        std::vector<std::pair<std::string, std::vector<std::string>>> m_tables;
+        std::vector<IndexEntry> m_index;
+        std::vector<double> m_columnBuffer;
+    };
+
+    class ColumnarReader {
+    public:
+        struct Table {
+            std::string name;
+            std::vector<std::string> columns;
+        };
+
+        bool Open(const std::string &file);
+
+        const std::vector<Table> &GetTables() const;
+
+        // -1 when there is no table of that name
+        int FindTable(const std::string &name) const;
+
+        uint64_t GetRowCount(uint32_t table) const;
+
+        // Every row of the table, row-major.
+        bool ReadTable(uint32_t table, std::vector<double> &rows);
+
+        // One column of the table, reading only that column from each chunk.
+        bool ReadColumn(uint32_t table, uint32_t column, std::vector<double> &values);
+
+    private:
+        struct Chunk {
+            uint32_t table;
+            uint32_t rows;
+            uint64_t offset;
+        };
+
+        bool ReadIndex();
+
+        bool ScanChunks();
+
+        std::ifstream m_in;
+        std::vector<Table> m_tables;
+        std::vector<Chunk> m_chunks;
+    };
+}
@@ -0,0 +1,148 @@
+#include "ForecastService.h"
+
+#include <algorithm>
+#include <limits>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "amm/BaseLogger.h"
+
+namespace AMM {
+    namespace {
+        // How long a preempted forecaster stays off the CPU
+        const auto PreemptBackoff = std::chrono::milliseconds(200);
+    }
+
+    ForecastService::ForecastService() {
+    }
+
+    ForecastService::~ForecastService() {
+        Stop();
+    }
+
+    void ForecastService::Start(const Settings &settings, Source source, WhatIfPredictor::Completion done) {
+        Stop();
+
+        m_settings = settings;
+        m_settings.interval = std::max(1.0, m_settings.interval);
+        m_settings.cpuBudget = std::min(1.0, std::max(0.01, m_settings.cpuBudget));
+        m_source = std::move(source);
+        m_done = std::move(done);
+        m_lastForecast = -std::numeric_limits<double>::infinity();
+        m_stopping = false;
+        m_running = true;
+        m_thread = std::thread(&ForecastService::Run, this);
+        LOG_INFO << "Forecasting " << m_settings.horizon << "s ahead every " << m_settings.period << "s within "
+                 << m_settings.cpuBudget * 100 << "% of a core";
+    }
+
+    void ForecastService::Stop() {
+        if (!m_thread.joinable()) {
+            return;
+        }
+        m_mutex.lock();
+        m_stopping = true;
+        m_mutex.unlock();
+        m_wake.notify_all();
+        m_thread.join();
+        m_running = false;
+    }
+
+    bool ForecastService::IsRunning() const {
+        return m_running;
+    }
+
+    void ForecastService::Notify(double simTime) {
+        m_simTime = simTime;
+        if (simTime - m_lastForecast >= m_settings.period || simTime < m_lastForecast) {
+            m_wake.notify_one();
+        }
+    }
+
+    void ForecastService::Preempt() {
+        if (!m_preempted.exchange(true)) {
+            ++m_preemptions;
+        }
+    }
+
+    uint64_t ForecastService::GetForecastCount() const {
+        return m_forecasts;
+    }
+
+    uint64_t ForecastService::GetPreemptionCount() const {
+        return m_preemptions;
+    }
+
+    void ForecastService::Run() {
+#ifdef __linux__
+        // Per-thread on Linux; the live engine keeps its normal priority
+        setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+#endif
+
+        WhatIfPredictor::Request request;
+        request.seconds = m_settings.horizon;
+        request.interval = m_settings.interval;
+        request.nodes = m_settings.nodes;
+
+        double lastCheckpoint = -1.0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                // A timeout as well, Notify does not take the lock
+                m_wake.wait_for(lock, std::chrono::seconds(1), [this] {
+                    return m_stopping || m_simTime - m_lastForecast >= m_settings.period ||
+                           m_simTime < m_lastForecast;
+                });
+                if (m_stopping) {
+                    return;
+                }
+                if (m_simTime - m_lastForecast < m_settings.period && m_simTime >= m_lastForecast) {
+                    continue;
+                }
+            }
+            m_lastForecast = m_simTime.load();
+
+            double simTime = 0.0;
+            std::shared_ptr<const CDM::PhysiologyEngineStateData> state = m_source(simTime);
+            if (state == nullptr || simTime == lastCheckpoint) {
+                // Nothing new to run ahead from yet
+                continue;
+            }
+            lastCheckpoint = simTime;
+
+            request.id = "forecast_" + std::to_string(m_forecasts + 1);
+            WhatIfPredictor::Prediction prediction;
+            m_preempted = false;
+            m_stepStart = std::chrono::steady_clock::now();
+            WhatIfPredictor::Predict(*state, simTime, request, prediction, [this] { return Proceed(); });
+            if (m_stopping) {
+                return;
+            }
+            if (prediction.completed) {
+                ++m_forecasts;
+                if (m_done) {
+                    m_done(prediction);
+                }
+            }
+        }
+    }
+
+    bool ForecastService::Proceed() {
+        // Idle long enough that the last step used only the budgeted share
+        auto work = std::chrono::steady_clock::now() - m_stepStart;
+        auto idle = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                work * ((1.0 - m_settings.cpuBudget) / m_settings.cpuBudget));
+        if (m_preempted.exchange(false)) {
+            idle = std::max<std::chrono::steady_clock::duration>(idle, PreemptBackoff);
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_wake.wait_for(lock, idle, [this] { return m_stopping.load(); });
+        m_stepStart = std::chrono::steady_clock::now();
+        return !m_stopping;
+    }
+}
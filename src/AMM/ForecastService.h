@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "WhatIfPredictor.h"
+
+namespace AMM {
+    // Keeps a rolling look-ahead of the live engine.  Every period of
+    // simulation time a low-priority thread takes the newest state snapshot
+    // and runs it ahead with no intervention.  The thread holds itself to a
+    // share of one core and backs off whenever the live tick reports it ran
+    // late, so forecasting never competes with the live engine for time.
+    class ForecastService {
+    public:
+        struct Settings {
+            double horizon = 300.0;
+            double interval = 10.0;
+            double period = 60.0;
+            // Fraction of one core
+            double cpuBudget = 0.5;
+            std::vector<std::string> nodes;
+        };
+
+        // The newest snapshot of the live engine and its simulation time, or nullptr
+        using Source = std::function<std::shared_ptr<const CDM::PhysiologyEngineStateData>(double &simTime)>;
+
+        ForecastService();
+
+        ~ForecastService();
+
+        // Restarts the forecaster with new settings
+        void Start(const Settings &settings, Source source, WhatIfPredictor::Completion done);
+
+        void Stop();
+
+        bool IsRunning() const;
+
+        // Tick thread; cheap.  Wakes the forecaster when a forecast is due.
+        void Notify(double simTime);
+
+        // Tick thread, after a late tick; the forecaster pauses before its next step.
+        void Preempt();
+
+        uint64_t GetForecastCount() const;
+
+        uint64_t GetPreemptionCount() const;
+
+    private:
+        void Run();
+
+        // Sleeps off the budget for the last step and any preemption
+        bool Proceed();
+
+        Settings m_settings;
+        Source m_source;
+        WhatIfPredictor::Completion m_done;
+
+        std::thread m_thread;
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::atomic<bool> m_running{false};
+        std::atomic<bool> m_stopping{false};
+        std::atomic<double> m_simTime{0.0};
+        std::atomic<bool> m_preempted{false};
+        std::atomic<uint64_t> m_forecasts{0};
+        std::atomic<uint64_t> m_preemptions{0};
+
+        std::atomic<double> m_lastForecast{0.0};
+        std::chrono::steady_clock::time_point m_stepStart;
+    };
+}
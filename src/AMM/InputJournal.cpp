@@ -0,0 +1,145 @@
+#include "InputJournal.h"
+
+#include <cstring>
+
+#include "BinaryIO.h"
+#include "amm/BaseLogger.h"
+
+namespace AMM {
+    namespace {
+        const char JournalMagic[8] = {'A', 'M', 'M', 'J', 'R', 'N', 'L', '\0'};
+
+        // Flush to disk every so often so a crashed session still leaves a usable journal
+        const uint64_t FlushInterval = 500;
+    }
+
+    const uint32_t InputJournal::FormatVersion;
+
+    void WriteJournalEntry(std::ostream &out, const JournalEntry &entry) {
+        WriteValue(out, static_cast<uint8_t>(entry.type));
+        WriteValue(out, entry.engineTime);
+        WriteValue(out, static_cast<uint8_t>(entry.scenario ? 1 : 0));
+        switch (entry.type) {
+            case JournalEntryType::TICK:
+                WriteValue(out, entry.frame);
+                WriteValue(out, entry.time);
+                break;
+            case JournalEntryType::SIMULATION_CONTROL:
+                WriteValue(out, entry.control);
+                WriteValue(out, entry.frame);
+                break;
+            default:
+                WriteString(out, entry.first);
+                WriteString(out, entry.second);
+                break;
+        }
+    }
+
+    bool ReadJournalEntry(std::istream &in, JournalEntry &entry) {
+        entry = JournalEntry();
+        uint8_t type = 0;
+        uint8_t scenario = 0;
+        if (!ReadValue(in, type) || !ReadValue(in, entry.engineTime) || !ReadValue(in, scenario)) {
+            return false;
+        }
+        entry.scenario = scenario != 0;
+
+        entry.type = static_cast<JournalEntryType>(type);
+        switch (entry.type) {
+            case JournalEntryType::TICK:
+                return ReadValue(in, entry.frame) && ReadValue(in, entry.time);
+            case JournalEntryType::SIMULATION_CONTROL:
+                return ReadValue(in, entry.control) && ReadValue(in, entry.frame);
+            case JournalEntryType::COMMAND:
+            case JournalEntryType::PHYSIOLOGY_MODIFICATION:
+            case JournalEntryType::INSTRUMENT_DATA:
+            case JournalEntryType::MODULE_CONFIGURATION:
+                return ReadString(in, entry.first) && ReadString(in, entry.second);
+        }
+
+        LOG_ERROR << "Input journal is corrupt, unknown entry type " << static_cast<int>(type);
+        return false;
+    }
+
+    InputJournal::~InputJournal() {
+        Close();
+    }
+
+    bool InputJournal::Open(const std::string &journalFile, const std::string &stateFile) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_out.is_open()) {
+            m_out.close();
+        }
+
+        m_out.open(journalFile, std::ios::binary | std::ios::trunc);
+        if (!m_out.is_open()) {
+            LOG_ERROR << "Unable to open input journal " << journalFile;
+            return false;
+        }
+
+        m_out.write(JournalMagic, sizeof(JournalMagic));
+        WriteValue(m_out, FormatVersion);
+        WriteString(m_out, stateFile);
+        m_out.flush();
+        m_entries = 0;
+        LOG_INFO << "Recording inputs to " << journalFile;
+        return true;
+    }
+
+    void InputJournal::Close() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_out.is_open()) {
+            m_out.close();
+            LOG_INFO << "Closed input journal after " << m_entries << " entries.";
+        }
+    }
+
+    bool InputJournal::IsOpen() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_out.is_open();
+    }
+
+    void InputJournal::Record(const JournalEntry &entry) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_out.is_open()) {
+            return;
+        }
+
+        WriteJournalEntry(m_out, entry);
+
+        if (++m_entries % FlushInterval == 0 || entry.type != JournalEntryType::TICK) {
+            m_out.flush();
+        }
+    }
+
+    bool JournalReader::Open(const std::string &journalFile) {
+        m_in.open(journalFile, std::ios::binary);
+        if (!m_in.is_open()) {
+            LOG_ERROR << "Unable to open input journal " << journalFile;
+            return false;
+        }
+
+        char magic[sizeof(JournalMagic)];
+        uint32_t version = 0;
+        if (!m_in.read(magic, sizeof(magic)) || memcmp(magic, JournalMagic, sizeof(magic)) != 0 ||
+            !ReadValue(m_in, version) || !ReadString(m_in, m_stateFile)) {
+            LOG_ERROR << "Not an input journal: " << journalFile;
+            return false;
+        }
+
+        if (version != InputJournal::FormatVersion) {
+            LOG_ERROR << "Input journal " << journalFile << " has format version " << version << ", expected "
+                      << InputJournal::FormatVersion;
+            return false;
+        }
+        return true;
+    }
+
+    const std::string &JournalReader::GetStateFile() const {
+        return m_stateFile;
+    }
+
+    bool JournalReader::Next(JournalEntry &entry) {
+        return ReadJournalEntry(m_in, entry);
+    }
+}
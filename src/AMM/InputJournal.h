@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+
+namespace AMM {
+    enum class JournalEntryType : uint8_t {
+        TICK = 1,
+        COMMAND = 2,
+        SIMULATION_CONTROL = 3,
+        PHYSIOLOGY_MODIFICATION = 4,
+        INSTRUMENT_DATA = 5,
+        MODULE_CONFIGURATION = 6
+    };
+
+    // One input as the manager received it.  Which fields are used depends on
+    // the type: ticks use frame/time, simulation controls use control/frame
+    // (timestamp), everything else carries up to two strings.
+    struct JournalEntry {
+        JournalEntryType type = JournalEntryType::TICK;
+        // Engine time the input was applied at, and whether a scenario was
+        // advancing on its own thread then; replay holds the scenario there
+        double engineTime = 0.0;
+        bool scenario = false;
+        uint64_t frame = 0;
+        double time = 0.0;
+        uint32_t control = 0;
+        std::string first;
+        std::string second;
+    };
+
+    // The journal's encoding of one entry, also used to hand inputs to another process
+    void WriteJournalEntry(std::ostream &out, const JournalEntry &entry);
+
+    bool ReadJournalEntry(std::istream &in, JournalEntry &entry);
+
+    // Compact binary record of every input that drove a session, in the
+    // order the manager handled them, so the session can be replayed.
+    class InputJournal {
+    public:
+        static const uint32_t FormatVersion = 2;
+
+        InputJournal() = default;
+
+        ~InputJournal();
+
+        bool Open(const std::string &journalFile, const std::string &stateFile);
+
+        void Close();
+
+        bool IsOpen();
+
+        // Safe to call from any DDS listener thread.
+        void Record(const JournalEntry &entry);
+
+    private:
+        std::ofstream m_out;
+        std::mutex m_mutex;
+        uint64_t m_entries = 0;
+    };
+
+    class JournalReader {
+    public:
+        bool Open(const std::string &journalFile);
+
+        // State file the recorded session started from
+        const std::string &GetStateFile() const;
+
+        bool Next(JournalEntry &entry);
+
+    private:
+        std::ifstream m_in;
+        std::string m_stateFile;
+    };
+}
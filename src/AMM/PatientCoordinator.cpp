@@ -0,0 +1,452 @@
+#include "PatientCoordinator.h"
+
+#include <cstdlib>
+#include <limits>
+#include <sstream>
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+
+namespace AMM {
+    PatientCoordinator::PatientCoordinator(const std::string &configFile) {
+        m_mgr = new DDSManager<PatientCoordinator>(configFile);
+        m_mgr->InitializeCommand();
+        m_mgr->InitializeEventRecord();
+
+        m_mgr->CreateCommandPublisher();
+        m_mgr->CreateEventRecordPublisher();
+        m_mgr->CreateCommandSubscriber(this, &AMM::PatientCoordinator::OnNewCommand);
+    }
+
+    PatientCoordinator::~PatientCoordinator() {
+        m_mgr->Shutdown();
+    }
+
+    std::string PatientCoordinator::Admit(const std::string &state, const std::string &id) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Patient patient;
+        patient.id = id;
+        while (patient.id.empty() || (id.empty() && m_patients.count(patient.id) > 0)) {
+            patient.id = "patient_" + std::to_string(++m_admitted);
+        }
+        if (m_patients.count(patient.id) > 0) {
+            LOG_ERROR << "Patient " << patient.id << " is already admitted";
+            return "";
+        }
+        patient.state = state;
+        m_patients[patient.id] = patient;
+        m_routingChanged = true;
+        LOG_INFO << "Admitted " << patient.id << " from " << state;
+        return patient.id;
+    }
+
+    bool PatientCoordinator::Discharge(const std::string &id) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto patient = m_patients.find(id);
+            if (patient == m_patients.end()) {
+                LOG_WARNING << "No patient " << id << " to discharge";
+                return false;
+            }
+            auto manager = m_managers.find(patient->second.manager);
+            if (manager != m_managers.end()) {
+                manager->second.patientId.clear();
+            }
+            ClearMigration(patient->second);
+            m_patients.erase(patient);
+            m_routingChanged = true;
+        }
+        SendCommand(sysPrefix + releasePrefix + id);
+        LOG_INFO << "Discharged " << id;
+        return true;
+    }
+
+    bool PatientCoordinator::Migrate(const std::string &id, const std::string &target) {
+        std::string command;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto patient = m_patients.find(id);
+            if (patient == m_patients.end() || !patient->second.confirmed || !patient->second.migratingTo.empty()) {
+                LOG_WARNING << "Patient " << id << " is not running on a manager, or is already moving";
+                return false;
+            }
+            double estimate = 0.0;
+            auto hostLoad = HostLoad(estimate);
+            command = StartMigration(patient->second, target, hostLoad, false);
+        }
+        if (command.empty()) {
+            LOG_WARNING << "No idle manager to migrate " << id << " to";
+            return false;
+        }
+        SendCommand(command);
+        return true;
+    }
+
+    void PatientCoordinator::Balance() {
+        std::vector<std::string> commands;
+        std::string routing;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto now = std::chrono::steady_clock::now();
+            for (auto it = m_managers.begin(); it != m_managers.end();) {
+                if (now - it->second.lastSeen < m_managerTimeout) {
+                    ++it;
+                    continue;
+                }
+                // The engine went with the process, so the patient starts over from its state
+                LOG_WARNING << "Manager " << it->first << " on " << it->second.host << " stopped answering";
+                for (auto &entry : m_patients) {
+                    if (entry.second.manager == it->first) {
+                        entry.second.manager.clear();
+                        entry.second.confirmed = false;
+                    }
+                }
+                for (auto &entry : m_patients) {
+                    if (entry.second.migratingTo == it->first) {
+                        ClearMigration(entry.second);
+                    }
+                }
+                it = m_managers.erase(it);
+                m_routingChanged = true;
+            }
+
+            double estimate = 0.0;
+            auto hostLoad = HostLoad(estimate);
+
+            for (auto &entry : m_patients) {
+                Patient &patient = entry.second;
+                if (patient.manager.empty()) {
+                    Manager *idle = nullptr;
+                    double lowest = std::numeric_limits<double>::max();
+                    for (auto &candidate : m_managers) {
+                        double load = hostLoad[candidate.second.host];
+                        if (candidate.second.patientId.empty() && load < lowest) {
+                            idle = &candidate.second;
+                            lowest = load;
+                        }
+                    }
+                    if (idle == nullptr) {
+                        continue;
+                    }
+                    // Held for the patient until the manager confirms or goes silent
+                    idle->patientId = patient.id;
+                    hostLoad[idle->host] += estimate;
+                    patient.manager = idle->id;
+                    patient.confirmed = false;
+                    m_routingChanged = true;
+                    LOG_INFO << "Assigning " << patient.id << " to " << idle->id << " on " << idle->host;
+                }
+                if (!patient.confirmed) {
+                    commands.push_back(sysPrefix + assignPrefix + patient.manager + ";" + patient.id + ";" +
+                                       patient.state);
+                }
+            }
+
+            for (auto &entry : m_patients) {
+                Patient &patient = entry.second;
+                if (!patient.migratingTo.empty() && now - patient.migrationStarted > m_migrationTimeout) {
+                    if (patient.targetLive) {
+                        // PE_MIGRATED was lost, but the target has the patient
+                        FinishMigration(patient);
+                    } else {
+                        LOG_WARNING << "Migration of " << patient.id << " to " << patient.migratingTo
+                                    << " timed out";
+                        ClearMigration(patient);
+                    }
+                }
+                auto manager = m_managers.find(patient.manager);
+                if (patient.confirmed && patient.migratingTo.empty() && manager != m_managers.end() &&
+                    manager->second.stepCost > m_overloadMs && now - patient.lastMigration > m_migrationCooldown) {
+                    std::string command = StartMigration(patient, "", hostLoad, true);
+                    if (!command.empty()) {
+                        commands.push_back(command);
+                    }
+                }
+            }
+
+            if (m_routingChanged) {
+                routing = RoutingTable();
+                m_routingChanged = false;
+            }
+        }
+
+        // Outside the lock, our own commands come back through OnNewCommand
+        for (const auto &command : commands) {
+            SendCommand(command);
+        }
+        SendCommand(sysPrefix + queryPrefix);
+        if (!routing.empty()) {
+            AMM::UUID erID;
+            erID.id(m_mgr->GenerateUuidString());
+            FMA_Location fma;
+            AMM::UUID agentID;
+            AMM::EventRecord er;
+            er.id(erID);
+            er.location(fma);
+            er.agent_id(agentID);
+            er.type("PATIENT_ROUTING");
+            er.data(routing);
+            m_mgr->WriteEventRecord(er);
+        }
+    }
+
+    void PatientCoordinator::Status() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        LOG_INFO << "Managers:\t\t\t" << m_managers.size();
+        for (const auto &entry : m_managers) {
+            const Manager &manager = entry.second;
+            LOG_INFO << "  " << manager.id << " on " << manager.host << ": "
+                     << (manager.patientId.empty() ? "idle" : manager.patientId) << ", " << manager.stepCost
+                     << "ms per tick" << (manager.running ? "" : " (paused)");
+        }
+        size_t waiting = 0;
+        for (const auto &entry : m_patients) {
+            if (entry.second.manager.empty()) {
+                ++waiting;
+            }
+        }
+        LOG_INFO << "Patients:\t\t\t" << m_patients.size() << " (" << waiting << " waiting for a manager)";
+    }
+
+    void PatientCoordinator::Shutdown() {
+        std::vector<std::string> patients;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (const auto &entry : m_patients) {
+                patients.push_back(entry.first);
+            }
+        }
+        for (const auto &id : patients) {
+            Discharge(id);
+        }
+    }
+
+    void PatientCoordinator::OnNewCommand(Command &cm, SampleInfo_t *) {
+        if (cm.message().compare(0, sysPrefix.size(), sysPrefix)) {
+            return;
+        }
+        std::string value = cm.message().substr(sysPrefix.size());
+        if (!value.compare(0, announcePrefix.size(), announcePrefix)) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            OnAnnounce(value.substr(announcePrefix.size()));
+        } else if (!value.compare(0, admitPrefix.size(), admitPrefix)) {
+            // <state>[;<patient id>]
+            std::vector<std::string> fields;
+            std::string admission = value.substr(admitPrefix.size());
+            boost::split(fields, admission, boost::is_any_of(";"));
+            Admit(fields[0], fields.size() > 1 ? fields[1] : "");
+        } else if (!value.compare(0, dischargePrefix.size(), dischargePrefix)) {
+            Discharge(value.substr(dischargePrefix.size()));
+        } else if (!value.compare(0, migratePrefix.size(), migratePrefix)) {
+            // <patient id>[;<module id>]
+            std::vector<std::string> fields;
+            std::string request = value.substr(migratePrefix.size());
+            boost::split(fields, request, boost::is_any_of(";"));
+            Migrate(fields[0], fields.size() > 1 ? fields[1] : "");
+        } else if (!value.compare(0, migratedPrefix.size(), migratedPrefix)) {
+            // <patient id>;<module id>;<milliseconds without ticking>
+            std::vector<std::string> fields;
+            std::string report = value.substr(migratedPrefix.size());
+            boost::split(fields, report, boost::is_any_of(";"));
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto patient = m_patients.find(fields[0]);
+            if (fields.size() >= 3 && patient != m_patients.end() && patient->second.migratingTo == fields[1]) {
+                LOG_INFO << "Migrated " << fields[0] << " to " << fields[1] << " with a " << fields[2]
+                         << "ms pause";
+                FinishMigration(patient->second);
+            }
+        } else if (!value.compare(0, migrateFailedPrefix.size(), migrateFailedPrefix)) {
+            // <patient id>;<reason>
+            std::vector<std::string> fields;
+            std::string report = value.substr(migrateFailedPrefix.size());
+            boost::split(fields, report, boost::is_any_of(";"));
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto patient = m_patients.find(fields[0]);
+            if (patient != m_patients.end() && !patient->second.migratingTo.empty()) {
+                LOG_WARNING << "Migration of " << fields[0] << " failed: " << (fields.size() > 1 ? fields[1] : "");
+                ClearMigration(patient->second);
+            }
+        }
+    }
+
+    void PatientCoordinator::SendCommand(const std::string &message) {
+        AMM::Command cmd;
+        cmd.message(message);
+        m_mgr->WriteCommand(cmd);
+    }
+
+    void PatientCoordinator::OnAnnounce(const std::string &announcement) {
+        // <module id>;<host>;<patient id>;<step cost>;<running>[;<term>]
+        std::vector<std::string> fields;
+        boost::split(fields, announcement, boost::is_any_of(";"));
+        if (fields.size() < 5 || fields[0].empty()) {
+            LOG_WARNING << "Malformed manager announcement: " << announcement;
+            return;
+        }
+        uint64_t term = fields.size() > 5 ? strtoull(fields[5].c_str(), nullptr, 10) : 0;
+
+        bool known = m_managers.count(fields[0]) > 0;
+        Manager &manager = m_managers[fields[0]];
+        if (known && term < manager.term) {
+            // A primary that has been taken over and has yet to hear about it
+            return;
+        }
+        manager.id = fields[0];
+        manager.term = term;
+        manager.host = fields[1];
+        manager.stepCost = atof(fields[3].c_str());
+        manager.running = fields[4] == "1";
+        manager.lastSeen = std::chrono::steady_clock::now();
+        if (!known) {
+            LOG_INFO << "Manager " << manager.id << " joined from " << manager.host;
+            m_routingChanged = true;
+        }
+
+        const std::string &announced = fields[2];
+        if (!announced.empty()) {
+            auto patient = m_patients.find(announced);
+            if (patient == m_patients.end()) {
+                // Left over from before the coordinator started; adopt it
+                Patient adopted;
+                adopted.id = announced;
+                adopted.manager = manager.id;
+                adopted.confirmed = true;
+                m_patients[announced] = adopted;
+                m_routingChanged = true;
+            } else if (patient->second.migratingTo == manager.id) {
+                // Stays with the source until it reports the move finished
+                patient->second.targetLive = true;
+                if (patient->second.manager.empty()) {
+                    FinishMigration(patient->second);
+                }
+            } else if (patient->second.manager == manager.id || patient->second.manager.empty()) {
+                m_routingChanged = m_routingChanged || !patient->second.confirmed;
+                patient->second.manager = manager.id;
+                patient->second.confirmed = true;
+            }
+            manager.patientId = announced;
+        } else {
+            // Idle, unless an assignment to it is still in flight
+            bool reserved = false;
+            for (auto &entry : m_patients) {
+                if (entry.second.migratingTo == manager.id) {
+                    reserved = true;
+                    entry.second.targetLive = false;
+                    manager.patientId = entry.first;
+                }
+                if (entry.second.manager == manager.id) {
+                    reserved = true;
+                    // A source that has handed its patient over waits for PE_MIGRATED
+                    if (entry.second.confirmed && entry.second.migratingTo.empty()) {
+                        LOG_WARNING << "Manager " << manager.id << " lost " << entry.first << ", reassigning";
+                        entry.second.confirmed = false;
+                    }
+                    manager.patientId = entry.first;
+                }
+            }
+            if (!reserved) {
+                manager.patientId.clear();
+            }
+        }
+    }
+
+    std::string PatientCoordinator::RoutingTable() {
+        std::ostringstream out;
+        out << "<Patients>";
+        for (const auto &entry : m_patients) {
+            const Patient &patient = entry.second;
+            auto manager = m_managers.find(patient.manager);
+            out << "<Patient id='" << patient.id << "' manager='" << patient.manager << "' host='"
+                << (manager != m_managers.end() ? manager->second.host : "") << "' confirmed='"
+                << (patient.confirmed ? "true" : "false") << "' migrating_to='" << patient.migratingTo << "'/>";
+        }
+        out << "</Patients>";
+        return out.str();
+    }
+
+    std::map<std::string, double> PatientCoordinator::HostLoad(double &estimate) {
+        // Load per host is what its engines cost per tick; an engine that has
+        // not been measured yet counts as the average of the measured ones
+        double measured = 0.0;
+        int measuredCount = 0;
+        for (const auto &entry : m_managers) {
+            if (!entry.second.patientId.empty() && entry.second.stepCost > 0.0) {
+                measured += entry.second.stepCost;
+                ++measuredCount;
+            }
+        }
+        estimate = measuredCount > 0 ? measured / measuredCount : 1.0;
+        std::map<std::string, double> hostLoad;
+        for (const auto &entry : m_managers) {
+            if (!entry.second.patientId.empty()) {
+                hostLoad[entry.second.host] += entry.second.stepCost > 0.0 ? entry.second.stepCost : estimate;
+            }
+        }
+        return hostLoad;
+    }
+
+    std::string PatientCoordinator::StartMigration(Patient &patient, const std::string &target,
+                                                   std::map<std::string, double> &hostLoad, bool automatic) {
+        auto current = m_managers.find(patient.manager);
+        if (current == m_managers.end()) {
+            return "";
+        }
+        double cost = current->second.stepCost;
+        // Worth moving only if the other host, with the patient, stays lighter than this one
+        double lowest = automatic ? hostLoad[current->second.host] - cost : std::numeric_limits<double>::max();
+        Manager *chosen = nullptr;
+        for (auto &candidate : m_managers) {
+            Manager &manager = candidate.second;
+            if (manager.id == current->first || !manager.patientId.empty() ||
+                (!target.empty() && manager.id != target) || (automatic && manager.host == current->second.host)) {
+                continue;
+            }
+            double load = hostLoad[manager.host];
+            if (load < lowest) {
+                chosen = &manager;
+                lowest = load;
+            }
+        }
+        if (chosen == nullptr) {
+            return "";
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        chosen->patientId = patient.id;
+        hostLoad[chosen->host] += cost;
+        hostLoad[current->second.host] -= cost;
+        patient.migratingTo = chosen->id;
+        patient.targetLive = false;
+        patient.migrationStarted = now;
+        patient.lastMigration = now;
+        m_routingChanged = true;
+        LOG_INFO << "Migrating " << patient.id << " (" << cost << "ms per tick) from " << current->first << " on "
+                 << current->second.host << " to " << chosen->id << " on " << chosen->host;
+        return sysPrefix + migrateInPrefix + chosen->id + ";" + patient.id;
+    }
+
+    void PatientCoordinator::FinishMigration(Patient &patient) {
+        auto source = m_managers.find(patient.manager);
+        if (source != m_managers.end() && source->second.patientId == patient.id) {
+            source->second.patientId.clear();
+        }
+        patient.manager = patient.migratingTo;
+        patient.confirmed = true;
+        patient.migratingTo.clear();
+        patient.targetLive = false;
+        m_routingChanged = true;
+    }
+
+    void PatientCoordinator::ClearMigration(Patient &patient) {
+        if (patient.migratingTo.empty()) {
+            return;
+        }
+        auto target = m_managers.find(patient.migratingTo);
+        if (target != m_managers.end() && target->second.patientId == patient.id) {
+            target->second.patientId.clear();
+        }
+        patient.migratingTo.clear();
+        patient.targetLive = false;
+        m_routingChanged = true;
+    }
+}
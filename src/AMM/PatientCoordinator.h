@@ -0,0 +1,117 @@
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "amm_std.h"
+
+namespace AMM {
+    // Spreads patients over the physiology engine managers on the DDS domain,
+    // one patient per manager process.  Managers answer PE_QUERY with
+    // PE_ANNOUNCE; a waiting patient goes to an idle manager on the host whose
+    // engines currently cost the least per tick.  Assignments are re-sent
+    // until the manager announces them, since commands are best effort.
+    // A patient whose engine is too slow where it is moves, running, to an
+    // idle manager on a lighter host; see PatientMigration.
+    class PatientCoordinator {
+    public:
+        struct Manager {
+            std::string id;
+            std::string host;
+            std::string patientId;
+            // Milliseconds per tick as measured by the manager
+            double stepCost = 0.0;
+            bool running = false;
+            // Raised when a standby takes the module over
+            uint64_t term = 0;
+            std::chrono::steady_clock::time_point lastSeen;
+        };
+
+        struct Patient {
+            std::string id;
+            // Under ./states on the manager's host, without the extension
+            std::string state;
+            // Empty while waiting for a manager
+            std::string manager;
+            bool confirmed = false;
+            // The manager it is moving to, held for it until the move finishes or fails
+            std::string migratingTo;
+            // The target has announced the patient
+            bool targetLive = false;
+            std::chrono::steady_clock::time_point migrationStarted;
+            std::chrono::steady_clock::time_point lastMigration;
+        };
+
+        explicit PatientCoordinator(const std::string &configFile = "config/pe_coordinator_amm.xml");
+
+        ~PatientCoordinator();
+
+        // Returns the patient id, patient_<n> unless one is given; empty when the id is taken
+        std::string Admit(const std::string &state, const std::string &id = "");
+
+        bool Discharge(const std::string &id);
+
+        // Moves a running patient to the given idle manager, or the one on the least loaded host
+        bool Migrate(const std::string &id, const std::string &target = "");
+
+        // Polls the managers, drops silent ones and sends outstanding assignments
+        void Balance();
+
+        void Status();
+
+        void Shutdown();
+
+        void OnNewCommand(Command &cm, SampleInfo_t *);
+
+        std::string sysPrefix = "[SYS]";
+        std::string announcePrefix = "PE_ANNOUNCE:";
+        std::string queryPrefix = "PE_QUERY";
+        std::string assignPrefix = "PE_ASSIGN:";
+        std::string releasePrefix = "PE_RELEASE:";
+        std::string admitPrefix = "PE_ADMIT:";
+        std::string dischargePrefix = "PE_DISCHARGE:";
+        std::string migratePrefix = "PE_MIGRATE:";
+        std::string migrateInPrefix = "PE_MIGRATE_IN:";
+        std::string migratedPrefix = "PE_MIGRATED:";
+        std::string migrateFailedPrefix = "PE_MIGRATE_FAILED:";
+
+    protected:
+        void SendCommand(const std::string &message);
+
+        // Caller holds m_mutex
+        void OnAnnounce(const std::string &announcement);
+
+        // Caller holds m_mutex
+        std::string RoutingTable();
+
+        // Caller holds m_mutex; milliseconds per tick of the engines on each host
+        std::map<std::string, double> HostLoad(double &estimate);
+
+        // Caller holds m_mutex; the command for the target, or empty when there is no better manager
+        std::string StartMigration(Patient &patient, const std::string &target,
+                                   std::map<std::string, double> &hostLoad, bool automatic);
+
+        // Caller holds m_mutex
+        void FinishMigration(Patient &patient);
+
+        // Caller holds m_mutex
+        void ClearMigration(Patient &patient);
+
+        DDSManager<PatientCoordinator> *m_mgr;
+        std::mutex m_mutex;
+
+        std::map<std::string, Manager> m_managers;
+        std::map<std::string, Patient> m_patients;
+        uint64_t m_admitted = 0;
+        bool m_routingChanged = true;
+
+        // A manager that misses this many seconds of queries is presumed gone
+        const std::chrono::seconds m_managerTimeout{15};
+        // Engines slower than this per tick (of 20ms) are moved when a lighter host has room
+        double m_overloadMs = 15.0;
+        const std::chrono::seconds m_migrationCooldown{60};
+        const std::chrono::seconds m_migrationTimeout{30};
+    };
+}
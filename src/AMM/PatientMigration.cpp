@@ -0,0 +1,253 @@
+#include "PatientMigration.h"
+
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "BinaryIO.h"
+#include "amm/BaseLogger.h"
+
+namespace AMM {
+    namespace {
+        // A deflated engine state is a few MB; anything much larger is not one of ours
+        const uint32_t MaxFrame = 32 * 1024 * 1024;
+
+        // Takes as long whichever byte differs
+        bool SameToken(const std::string &expected, const std::string &presented) {
+            if (expected.size() != presented.size()) {
+                return false;
+            }
+            unsigned char difference = 0;
+            for (size_t i = 0; i < expected.size(); ++i) {
+                difference |= static_cast<unsigned char>(expected[i] ^ presented[i]);
+            }
+            return difference == 0;
+        }
+    }
+
+    PatientMigration::PatientMigration(const std::string &token) : m_token(token) {}
+
+    PatientMigration::~PatientMigration() {
+        Close();
+    }
+
+    bool PatientMigration::Listen(const std::string &host, uint16_t &port) {
+        Close();
+        addrinfo hints{};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+        addrinfo *addresses = nullptr;
+        if (getaddrinfo(host.c_str(), nullptr, &hints, &addresses) != 0) {
+            LOG_ERROR << "Unable to resolve migration interface " << host;
+            return false;
+        }
+        sockaddr_in address = *reinterpret_cast<sockaddr_in *>(addresses->ai_addr);
+        freeaddrinfo(addresses);
+
+        m_listener = socket(AF_INET, SOCK_STREAM, 0);
+        if (m_listener < 0) {
+            LOG_ERROR << "Unable to open a migration socket: " << strerror(errno);
+            return false;
+        }
+        int reuse = 1;
+        setsockopt(m_listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        address.sin_port = htons(port);
+        socklen_t length = sizeof(address);
+        if (bind(m_listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 ||
+            listen(m_listener, 1) < 0 ||
+            getsockname(m_listener, reinterpret_cast<sockaddr *>(&address), &length) < 0) {
+            LOG_ERROR << "Unable to listen for a migration on " << host << ": " << strerror(errno);
+            Close();
+            return false;
+        }
+        port = ntohs(address.sin_port);
+        return true;
+    }
+
+    bool PatientMigration::Accept(int timeoutMs) {
+        pollfd listener{m_listener, POLLIN, 0};
+        if (m_listener < 0 || poll(&listener, 1, timeoutMs) <= 0) {
+            return false;
+        }
+        m_socket = accept(m_listener, nullptr, nullptr);
+        close(m_listener);
+        m_listener = -1;
+        if (m_socket < 0) {
+            return false;
+        }
+        int noDelay = 1;
+        setsockopt(m_socket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+        Message message;
+        std::string token;
+        if (!Receive(message, token, timeoutMs) || message != Message::HELLO || !SameToken(m_token, token)) {
+            LOG_WARNING << "Dropped a migration peer that did not present the shared token";
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    bool PatientMigration::Connect(const std::string &host, uint16_t port, int timeoutMs) {
+        Close();
+        addrinfo hints{};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo *addresses = nullptr;
+        if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0) {
+            LOG_ERROR << "Unable to resolve migration target " << host;
+            return false;
+        }
+
+        m_socket = socket(AF_INET, SOCK_STREAM, 0);
+        bool connected = false;
+        if (m_socket >= 0) {
+            // Sockets stay blocking; a connect that hangs is bounded by SO_SNDTIMEO
+            timeval timeout{timeoutMs / 1000, (timeoutMs % 1000) * 1000};
+            setsockopt(m_socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+            connected = connect(m_socket, addresses->ai_addr, addresses->ai_addrlen) == 0;
+            timeout = {0, 0};
+            setsockopt(m_socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        }
+        freeaddrinfo(addresses);
+        if (!connected) {
+            LOG_ERROR << "Unable to connect to migration target " << host << ":" << port << ": " << strerror(errno);
+            Close();
+            return false;
+        }
+        int noDelay = 1;
+        setsockopt(m_socket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        if (!SendFrame(Message::HELLO, m_token)) {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    bool PatientMigration::SendSnapshot(const Snapshot &snapshot) {
+        std::ostringstream body;
+        WriteString(body, snapshot.patientId);
+        WriteString(body, snapshot.moduleId);
+        WriteValue(body, snapshot.simTime);
+        WriteValue(body, snapshot.lastFrame);
+        WriteValue(body, snapshot.startingBloodVolume);
+        WriteValue(body, static_cast<uint8_t>(snapshot.running));
+        WriteValue(body, static_cast<uint8_t>(snapshot.paused));
+        WriteValue(body, snapshot.term);
+        WriteValue(body, snapshot.size);
+        WriteString(body, snapshot.payload);
+        return SendFrame(Message::SNAPSHOT, body.str());
+    }
+
+    bool PatientMigration::SendInput(const JournalEntry &entry) {
+        std::ostringstream body;
+        WriteJournalEntry(body, entry);
+        return SendFrame(Message::INPUT, body.str());
+    }
+
+    bool PatientMigration::Send(Message message) {
+        return SendFrame(message, "");
+    }
+
+    bool PatientMigration::Poll(int timeoutMs) {
+        pollfd connection{m_socket, POLLIN, 0};
+        return m_socket >= 0 && poll(&connection, 1, timeoutMs) > 0;
+    }
+
+    bool PatientMigration::Receive(Message &message, std::string &body, int timeoutMs) {
+        uint8_t type = 0;
+        uint32_t size = 0;
+        if (!ReadFully(reinterpret_cast<char *>(&type), sizeof(type), timeoutMs) ||
+            !ReadFully(reinterpret_cast<char *>(&size), sizeof(size), timeoutMs) || size > MaxFrame) {
+            return false;
+        }
+        body.resize(size);
+        if (size > 0 && !ReadFully(&body[0], size, timeoutMs)) {
+            return false;
+        }
+        message = static_cast<Message>(type);
+        return true;
+    }
+
+    bool PatientMigration::ParseSnapshot(const std::string &body, Snapshot &snapshot) {
+        std::istringstream in(body);
+        uint8_t running = 0;
+        uint8_t paused = 0;
+        bool parsed = ReadString(in, snapshot.patientId) && ReadString(in, snapshot.moduleId) &&
+                      ReadValue(in, snapshot.simTime) && ReadValue(in, snapshot.lastFrame) &&
+                      ReadValue(in, snapshot.startingBloodVolume) && ReadValue(in, running) &&
+                      ReadValue(in, paused) && ReadValue(in, snapshot.term) && ReadValue(in, snapshot.size) &&
+                      ReadString(in, snapshot.payload);
+        snapshot.running = running != 0;
+        snapshot.paused = paused != 0;
+        return parsed;
+    }
+
+    bool PatientMigration::ParseInput(const std::string &body, JournalEntry &entry) {
+        std::istringstream in(body);
+        return ReadJournalEntry(in, entry);
+    }
+
+    void PatientMigration::Close() {
+        if (m_socket >= 0) {
+            close(m_socket);
+            m_socket = -1;
+        }
+        if (m_listener >= 0) {
+            close(m_listener);
+            m_listener = -1;
+        }
+    }
+
+    bool PatientMigration::SendFrame(Message message, const std::string &body) {
+        if (m_socket < 0) {
+            return false;
+        }
+        std::string frame;
+        frame.reserve(body.size() + 5);
+        frame.push_back(static_cast<char>(message));
+        auto size = static_cast<uint32_t>(body.size());
+        frame.append(reinterpret_cast<const char *>(&size), sizeof(size));
+        frame.append(body);
+
+        size_t sent = 0;
+        while (sent < frame.size()) {
+            ssize_t n = send(m_socket, frame.data() + sent, frame.size() - sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            sent += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    bool PatientMigration::ReadFully(char *data, size_t size, int timeoutMs) {
+        size_t received = 0;
+        while (received < size) {
+            if (!Poll(timeoutMs)) {
+                return false;
+            }
+            ssize_t n = recv(m_socket, data + received, size - received, 0);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            received += static_cast<size_t>(n);
+        }
+        return true;
+    }
+}
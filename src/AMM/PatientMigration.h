@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "InputJournal.h"
+
+namespace AMM {
+    // One TCP connection that moves a running patient from the manager that
+    // has it (the source) to an idle one (the target).  The target listens.
+    // The source sends the paused engine's snapshot, then every input it
+    // receives for the patient, until the target reports it is LIVE; then it
+    // sends CUTOVER and forwards nothing more.  Either side may send ABORT.
+    // StandbyFeed uses the same messages to keep a standby manager in step.
+    // Every connection opens with HELLO carrying the managers' shared token;
+    // the listening side drops a peer that does not present it.
+    class PatientMigration {
+    public:
+        enum class Message : uint8_t {
+            SNAPSHOT = 1, INPUT = 2, LIVE = 3, CUTOVER = 4, ABORT = 5, HELLO = 6
+        };
+
+        struct Snapshot {
+            std::string patientId;
+            // The manager the engine comes from
+            std::string moduleId;
+            double simTime = 0.0;
+            uint64_t lastFrame = 0;
+            double startingBloodVolume = 0.0;
+            bool running = false;
+            bool paused = false;
+            // Failover term of the manager that sent it, see StandbyFeed
+            uint64_t term = 0;
+            // Deflated state XML and its inflated size
+            std::string payload;
+            uint64_t size = 0;
+        };
+
+        explicit PatientMigration(const std::string &token);
+
+        ~PatientMigration();
+
+        PatientMigration(const PatientMigration &) = delete;
+
+        PatientMigration &operator=(const PatientMigration &) = delete;
+
+        // Target side, on the interface host resolves to; a port of 0 picks a free one
+        bool Listen(const std::string &host, uint16_t &port);
+
+        // False on timeout, or for a peer without the token; a failed accept
+        // also closes the listener
+        bool Accept(int timeoutMs);
+
+        bool IsListening() const { return m_listener >= 0; }
+
+        // Source side
+        bool Connect(const std::string &host, uint16_t port, int timeoutMs);
+
+        bool SendSnapshot(const Snapshot &snapshot);
+
+        bool SendInput(const JournalEntry &entry);
+
+        bool Send(Message message);
+
+        // True when a message can be read within timeoutMs
+        bool Poll(int timeoutMs);
+
+        // False on error, on close, or when the message does not arrive within timeoutMs
+        bool Receive(Message &message, std::string &body, int timeoutMs);
+
+        static bool ParseSnapshot(const std::string &body, Snapshot &snapshot);
+
+        static bool ParseInput(const std::string &body, JournalEntry &entry);
+
+        void Close();
+
+    private:
+        bool SendFrame(Message message, const std::string &body);
+
+        bool ReadFully(char *data, size_t size, int timeoutMs);
+
+        std::string m_token;
+        int m_listener = -1;
+        int m_socket = -1;
+    };
+}
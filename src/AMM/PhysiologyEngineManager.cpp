@@ -1,5 +1,10 @@
 #include "PhysiologyEngineManager.h"
 
+#include <cmath>
+#include <cstdlib>
+
+#include <unistd.h>
+
 using namespace std;
 using namespace std::chrono;
 using namespace tinyxml2;
@@ -19,8 +24,29 @@ std::string get_filename_date(void) {
     return std::string(the_date);
 }
 
+std::string get_host_name(void) {
+    char host[256] = {};
+    gethostname(host, sizeof(host) - 1);
+    return std::string(host);
+}
+
 std::map <std::string, std::string> config;
 
+// Applies a configured value, naming the key if it does not parse.  False when the key is unset.
+template<typename Apply>
+bool read_config_value(const std::string &key, Apply apply) {
+    auto it = config.find(key);
+    if (it == config.end() || it->second.empty()) {
+        return false;
+    }
+    try {
+        apply(it->second);
+    } catch (std::exception &e) {
+        LOG_ERROR << "Invalid " << key << " setting '" << it->second << "': " << e.what();
+    }
+    return true;
+}
+
 namespace AMM {
     PhysiologyEngineManager::PhysiologyEngineManager() {
         static plog::ColorConsoleAppender <plog::TxtFormatter> consoleAppender;
@@ -54,6 +80,7 @@ namespace AMM {
 
         m_mgr->CreateEventRecordPublisher();
         m_mgr->CreateRenderModificationPublisher();
+        m_mgr->CreateCommandPublisher();
 
         m_mgr->CreateTickSubscriber(this, &AMM::PhysiologyEngineManager::OnNewTick);
         m_mgr->CreateSimulationControlSubscriber(this, &AMM::PhysiologyEngineManager::OnNewSimulationControl);
@@ -64,6 +91,24 @@ namespace AMM {
 
         m_uuid.id(m_mgr->GenerateUuidString());
 
+        const char *token = getenv("AMM_MIGRATION_TOKEN");
+        if (token != nullptr) {
+            migrationToken = token;
+        } else {
+            LOG_WARNING << "AMM_MIGRATION_TOKEN is not set, migrations and standby feeds accept any manager";
+        }
+
+        // Render payloads are built once and the samples reused for every emission
+        startOfInhaleRenderMod = &GetRenderModification("START_OF_INHALE");
+        startOfExhaleRenderMod = &GetRenderModification("START_OF_EXHALE");
+        GetRenderModification("PATIENT_STATE_IRREVERSIBLE");
+        GetRenderModification("PATIENT_STATE_PARALYZED");
+
+        FMA_Location fma;
+        AMM::UUID agentID;
+        eventRecord.location(fma);
+        eventRecord.agent_id(agentID);
+
         InitializeBiogears();
     }
 
@@ -95,6 +140,11 @@ namespace AMM {
     }
 
     PhysiologyEngineManager::~PhysiologyEngineManager() {
+        StopStandby();
+        StopMigration();
+        forecaster.Stop();
+        predictor.reset();
+        StopScenario();
         if (m_pe != nullptr) {
             m_mutex.lock();
             m_pe->Shutdown();
@@ -162,22 +212,307 @@ namespace AMM {
             LOG_WARNING << "Physiology engine not running, cannot publish data.";
             return;
         }
-        auto it = nodePathMap->begin();
-        while (it != nodePathMap->end()) {
-            if ((lastFrame % 10) == 0 || force) {
-                WriteNodeData(it->first);
+        if (publishPlanDirty) {
+            BuildPublishPlan();
+        }
+
+        bool full = (lastFrame % 10) == 0 || force;
+        size_t evaluated = 0;
+        for (auto &node : publishPlan) {
+            if (!full && !node.everyTick) {
+                continue;
+            }
+            double value;
+            try {
+                value = node.getter != nullptr ? (m_pe->*node.getter)() : m_pe->GetSubstanceNode(node.substanceNode);
+            } catch (std::exception &e) {
+                if (!node.failed) {
+                    LOG_WARNING << "Unable to evaluate node " << node.name << ", not publishing it: " << e.what();
+                    node.failed = true;
+                }
+                continue;
+            }
+            ++evaluated;
+
+            if (full && node.publish) {
+                nodeInstance.name(node.publishedName);
+                nodeInstance.value(value);
+                m_mgr->WritePhysiologyValue(nodeInstance);
             }
-            if ((std::find(m_pe->highFrequencyNodes.begin(), m_pe->highFrequencyNodes.end(), it->first) !=
-                 m_pe->highFrequencyNodes.end())) {
-                WriteHighFrequencyNodeData(it->first);
+            if (node.highFrequency) {
+                waveformInstance.name(node.publishedName);
+                waveformInstance.value(value);
+                m_mgr->WritePhysiologyWaveform(waveformInstance);
             }
-            ++it;
+        }
+        evaluatedNodes += evaluated;
+        skippedNodes += nodePathMap->size() - std::min(evaluated, nodePathMap->size());
+
+        if ((lastFrame % 50) == 0 || force) {
+            PublishTrends();
+        }
+    }
+
+    void PhysiologyEngineManager::BuildPublishPlan() {
+        m_mutex.lock();
+        bool all = publishAll;
+        std::set<std::string> wanted = defaultNodes;
+        for (const auto &subscriber : subscriptions) {
+            all = all || subscriber.second.count("*") > 0;
+            wanted.insert(subscriber.second.begin(), subscriber.second.end());
+        }
+        publishPlanDirty = false;
+        m_mutex.unlock();
+
+        publishPlan.clear();
+        std::map<std::string, size_t> planned;
+
+        // Dependencies go ahead of the nodes that read them
+        std::function<void(const std::string &, bool, bool)> add;
+        add = [&](const std::string &name, bool publish, bool everyTick) {
+            double (BiogearsThread::*getter)() = nullptr;
+            int substanceNode = -1;
+            auto entry = nodePathMap->find(name);
+            if (entry != nodePathMap->end()) {
+                getter = entry->second;
+            } else if ((substanceNode = m_pe->FindSubstanceNode(name)) < 0) {
+                return;
+            }
+            auto dependencies = BiogearsThread::nodeDependencies.find(name);
+            if (dependencies != BiogearsThread::nodeDependencies.end()) {
+                for (const auto &dependency : dependencies->second) {
+                    add(dependency, false, everyTick);
+                }
+            }
+
+            auto existing = planned.find(name);
+            if (existing != planned.end()) {
+                PublishedNode &node = publishPlan[existing->second];
+                node.publish = node.publish || publish;
+                node.everyTick = node.everyTick || everyTick;
+                node.highFrequency = node.highFrequency || (publish && everyTick);
+                return;
+            }
+
+            PublishedNode node;
+            node.name = name;
+            node.publishedName = patientId.empty() ? name : patientPrefix + patientId + "]" + name;
+            node.getter = getter;
+            node.substanceNode = substanceNode;
+            node.publish = publish;
+            node.everyTick = everyTick;
+            node.highFrequency = publish && everyTick;
+            node.failed = false;
+            planned[name] = publishPlan.size();
+            publishPlan.push_back(node);
+        };
+
+        for (const auto &entry : *nodePathMap) {
+            if (all || wanted.count(entry.first) > 0) {
+                bool highFrequency = std::find(BiogearsThread::highFrequencyNodes.begin(),
+                                               BiogearsThread::highFrequencyNodes.end(), entry.first) !=
+                                     BiogearsThread::highFrequencyNodes.end();
+                add(entry.first, true, highFrequency);
+            }
+        }
+        // Substance nodes are never part of everything, only published when asked for
+        for (const auto &name : wanted) {
+            if (name != "*" && nodePathMap->find(name) == nodePathMap->end()) {
+                add(name, true, false);
+            }
+        }
+
+        size_t published = std::count_if(publishPlan.begin(), publishPlan.end(),
+                                         [](const PublishedNode &node) { return node.publish; });
+        LOG_INFO << "Publishing " << published << " nodes, evaluating " << publishPlan.size();
+    }
+
+    void PhysiologyEngineManager::RequestWhatIf(const std::string &request) {
+        // Predictions run on a copy; replaying the journal should not spawn them again
+        if (replaying) {
+            return;
+        }
+        if (m_pe == nullptr || m_pe->scenarioLoading) {
+            LOG_ERROR << "Simulation has not been run, nothing to predict from.";
+            return;
+        }
+
+        tinyxml2::XMLDocument doc;
+        doc.Parse(request.c_str());
+        tinyxml2::XMLElement *root = doc.FirstChildElement("WhatIf");
+        if (doc.ErrorID() != 0 || root == nullptr) {
+            LOG_ERROR << "Invalid what-if request: " << request;
+            return;
+        }
+
+        WhatIfPredictor::Request whatIf;
+        const char *id = root->Attribute("id");
+        whatIf.id = id != nullptr ? id : "whatif_" + std::to_string(++whatIfCount);
+        // Echoed back in an attribute
+        whatIf.id.erase(std::remove_if(whatIf.id.begin(), whatIf.id.end(), [](char c) {
+            return !isalnum(static_cast<unsigned char>(c)) && c != '_' && c != '-';
+        }), whatIf.id.end());
+        whatIf.seconds = std::max(0.0, root->DoubleAttribute("minutes", 10.0) * 60.0);
+        whatIf.interval = std::max(1.0, root->DoubleAttribute("interval", 10.0));
+
+        const char *nodes = root->Attribute("nodes");
+        whatIf.nodes = ResolveNodeList(nodes != nullptr ? nodes : forecastNodes);
+
+        tinyxml2::XMLElement *intervention = root->FirstChildElement();
+        if (intervention != nullptr) {
+            tinyxml2::XMLPrinter printer(nullptr, true);
+            intervention->Accept(&printer);
+            std::string xml = printer.CStr();
+            if (std::string(intervention->Name()) == "PhysiologyModification") {
+                whatIf.apply = [this, xml](BiogearsThread &engine) {
+                    ExecutePhysiologyModification(&engine, xml);
+                };
+            } else {
+                whatIf.apply = [xml](BiogearsThread &engine) {
+                    engine.ExecuteXMLCommand(xml);
+                };
+            }
+        }
+
+        // Seeded from the newest checkpoint, so the live engine is not held to capture its state
+        if (checkpointInterval <= 0.0) {
+            LOG_ERROR << "What-if predictions need checkpoints, set checkpoint_interval above 0.";
+            return;
+        }
+        double simTime = 0.0;
+        std::vector<JournalEntry> inputs;
+        std::shared_ptr<const CDM::PhysiologyEngineStateData> state = GetCheckpointInputs(simTime, inputs);
+        if (state == nullptr) {
+            LOG_WARNING << "No checkpoint to predict " << whatIf.id << " from yet.";
+            return;
+        }
+        whatIf.startTime = m_pe->GetEngineTime();
+        for (const auto &input : inputs) {
+            if (input.type == JournalEntryType::PHYSIOLOGY_MODIFICATION ||
+                input.type == JournalEntryType::INSTRUMENT_DATA) {
+                whatIf.inputs.push_back(input);
+            }
+        }
+        whatIf.replay = [this](BiogearsThread &engine, const JournalEntry &input) {
+            ReplayOnBranch(engine, input);
+        };
+
+        if (predictor == nullptr) {
+            predictor.reset(new WhatIfPredictor());
+        }
+        if (!predictor->Submit(state, simTime, whatIf, [this](const WhatIfPredictor::Prediction &prediction) {
+            PublishPrediction("PATIENT_WHAT_IF", prediction);
+        })) {
+            LOG_WARNING << "Too many what-if predictions pending, dropping " << whatIf.id;
+            return;
+        }
+        LOG_INFO << "Predicting " << whatIf.id << " over " << whatIf.seconds << "s from " << simTime << "s";
+    }
+
+    void PhysiologyEngineManager::PublishPrediction(const std::string &type,
+                                                    const WhatIfPredictor::Prediction &prediction) {
+        // Own sample; the tick thread reuses eventRecord
+        AMM::UUID erID;
+        erID.id(m_mgr->GenerateUuidString());
+
+        FMA_Location fma;
+
+        AMM::EventRecord er;
+        er.id(erID);
+        er.location(fma);
+        er.agent_id(patientAgent);
+        er.type(type);
+        er.data(prediction.ToXml());
+        m_mgr->WriteEventRecord(er);
+    }
+
+    std::vector<std::string> PhysiologyEngineManager::ResolveNodeList(const std::string &nodes) {
+        std::vector<std::string> entries;
+        std::vector<std::string> resolved;
+        boost::split(entries, nodes, boost::is_any_of(", \t\r\n"), boost::token_compress_on);
+        for (const auto &entry : entries) {
+            if (!entry.empty()) {
+                for (const auto &node : BiogearsThread::ResolveNodePaths(entry)) {
+                    resolved.push_back(node);
+                }
+            }
+        }
+        return resolved;
+    }
+
+    void PhysiologyEngineManager::SubscribeNodes(const std::string &nodes, bool subscribe,
+                                                 const std::string &subscriber) {
+        std::vector<std::string> entries;
+        boost::split(entries, nodes, boost::is_any_of(", \t\r\n"), boost::token_compress_on);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::set<std::string> &subscribed = subscriptions[subscriber];
+        for (const auto &entry : entries) {
+            if (entry.empty()) {
+                continue;
+            }
+            if (entry == "*") {
+                // Everything, or nothing of this subscriber's
+                if (subscribe) {
+                    subscribed.insert(entry);
+                } else {
+                    subscribed.clear();
+                }
+                continue;
+            }
+            for (const auto &node : BiogearsThread::ResolveNodePaths(entry)) {
+                if (subscribe) {
+                    subscribed.insert(node);
+                } else {
+                    subscribed.erase(node);
+                }
+            }
+        }
+        if (subscribed.empty()) {
+            subscriptions.erase(subscriber);
+        }
+        publishPlanDirty = true;
+    }
+
+    void PhysiologyEngineManager::SetDefaultNodes(const std::string &nodes) {
+        std::vector<std::string> entries;
+        boost::split(entries, nodes, boost::is_any_of(", \t\r\n"), boost::token_compress_on);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        publishAll = true;
+        defaultNodes.clear();
+        for (const auto &entry : entries) {
+            if (entry.empty()) {
+                continue;
+            }
+            // Everything, whatever else is listed
+            if (entry == "*") {
+                publishAll = true;
+                defaultNodes.clear();
+                break;
+            }
+            publishAll = false;
+            for (const auto &node : BiogearsThread::ResolveNodePaths(entry)) {
+                defaultNodes.insert(node);
+            }
+        }
+        publishPlanDirty = true;
+    }
+
+    void PhysiologyEngineManager::PublishTrends() {
+        m_pe->GetTrends(trendValues);
+        for (const auto &trend : trendValues) {
+            trendInstance.name(trend.first);
+            trendInstance.value(trend.second);
+            m_mgr->WritePhysiologyValue(trendInstance);
         }
     }
 
     void PhysiologyEngineManager::
     ExecutePhysiologyModification(std::string pm) {
-        if (m_pe == nullptr) {
+        ExecutePhysiologyModification(m_pe, pm);
+    }
+
+    void PhysiologyEngineManager::ExecutePhysiologyModification(BiogearsThread *engine, const std::string &pm) {
+        if (engine == nullptr) {
             LOG_WARNING << "Physiology engine not running, cannot execute physiology modification.";
             return;
         }
@@ -199,17 +534,17 @@ namespace AMM {
 
                 } else if (pmType == "airwayobstruction") {
                     double pSev = stod(pRoot->FirstChildElement("Severity")->ToElement()->GetText());
-                    m_pe->SetAirwayObstruction(pSev);
+                    engine->SetAirwayObstruction(pSev);
                     return;
                 } else if (pmType == "apnea") {
                 } else if (pmType == "asthmaattack") {
                     double pSev = stod(pRoot->FirstChildElement("Severity")->ToElement()->GetText());
-                    m_pe->SetAsthmaAttack(pSev);
+                    engine->SetAsthmaAttack(pSev);
                     return;
                 } else if (pmType == "braininjury") {
                     double pSev = stod(pRoot->FirstChildElement("Severity")->ToElement()->GetText());
                     std::string pType = pRoot->FirstChildElement("Type")->ToElement()->GetText();
-                    m_pe->SetBrainInjury(pSev, pType);
+                    engine->SetBrainInjury(pSev, pType);
                     return;
                 } else if (pmType == "bronchoconstriction") {
                 } else if (pmType == "burn") {
@@ -225,26 +560,26 @@ namespace AMM {
                     double flow = stod(pFlow->GetText());
                     LOG_TRACE << "Flow is " << flow;
                     // std::string flowUnit = pFlow->Attribute("unit");
-                    m_pe->SetHemorrhage(pLoc, flow);
+                    engine->SetHemorrhage(pLoc, flow);
                     return;
                 } else if (pmType == "infection") {
                 } else if (pmType == "intubation") {
                 } else if (pmType == "mechanicalventilation") {
                 } else if (pmType == "needledecompression") {
                     std::string pLoc = pRoot->FirstChildElement("Location")->ToElement()->GetText();
-                    m_pe->SetNeedleDecompression(pLoc);
+                    engine->SetNeedleDecompression(pLoc);
                     return;
                 } else if (pmType == "occlusivedressing") {
                 } else if (pmType == "painstimulus") {
                     double pSev = stod(pRoot->FirstChildElement("Severity")->ToElement()->GetText());
                     std::string pLoc = pRoot->FirstChildElement("Location")->ToElement()->GetText();
-                    m_pe->SetPain(pLoc, pSev);
+                    engine->SetPain(pLoc, pSev);
                     return;
                 } else if (pmType == "pericardialeffusion") {
                 } else if (pmType == "sepsis") {
                     double pSev = stod(pRoot->FirstChildElement("Severity")->ToElement()->GetText());
                     std::string pLoc = pRoot->FirstChildElement("Location")->ToElement()->GetText();
-                    m_pe->SetSepsis(pLoc, pSev);
+                    engine->SetSepsis(pLoc, pSev);
                     return;
                 } else if (pmType == "substancebolus") {
                     std::string pSub = pRoot->FirstChildElement("Substance")->ToElement()->GetText();
@@ -271,7 +606,7 @@ namespace AMM {
                     tinyxml2::XMLElement *pAR = pRoot->FirstChildElement("AdminRoute")->ToElement();
                     std::string adminRoute = pAR->GetText();
 
-                    m_pe->SetSubstanceBolus(pSub, concentration, cUnit, dose, dUnit, adminRoute);
+                    engine->SetSubstanceBolus(pSub, concentration, cUnit, dose, dUnit, adminRoute);
 
                     return;
                 } else if (pmType == "substancecompoundinfusion") {
@@ -295,7 +630,7 @@ namespace AMM {
                     }
                     std::string rUnit = pRate->Attribute("unit");
 
-                    m_pe->SetSubstanceCompoundInfusion(pSub, bagVolume, bvUnit, rate, rUnit);
+                    engine->SetSubstanceCompoundInfusion(pSub, bagVolume, bvUnit, rate, rUnit);
                     return;
                 } else if (pmType == "substanceinfusion") {
                     std::string pSub = pRoot->FirstChildElement("Substance")->ToElement()->GetText();
@@ -317,7 +652,7 @@ namespace AMM {
                         rate = stod(pRate->GetText());
                     }
                     std::string rUnit = pRate->Attribute("unit");
-                    m_pe->SetSubstanceInfusion(pSub, concentration, cUnit, rate, rUnit);
+                    engine->SetSubstanceInfusion(pSub, concentration, cUnit, rate, rUnit);
                     return;
                 } else if (pmType == "substancenasaldose") {
                     std::string pSub = pRoot->FirstChildElement("Substance")->ToElement()->GetText();
@@ -331,7 +666,7 @@ namespace AMM {
                     }
                     std::string dUnit = pDose->Attribute("unit");
 
-                    m_pe->SetSubstanceNasalDose(pSub, dose, dUnit);
+                    engine->SetSubstanceNasalDose(pSub, dose, dUnit);
                     return;
                 } else if (pmType == "tensionpneumothorax") {
                 } else if (pmType == "urinate") {
@@ -359,7 +694,7 @@ namespace AMM {
                 return;
             }
 
-            this->SetLogging(logging_enabled);
+            ConfigureEngine();
 
             if (authoringMode) {
                 m_mutex.lock();
@@ -387,6 +722,7 @@ namespace AMM {
                 m_mutex.unlock();
             }
             nodePathMap = m_pe->GetNodePathTable();
+            publishPlanDirty = true;
         } else {
             LOG_ERROR << "Initialization failed because the sim is already running";
         }
@@ -396,87 +732,210 @@ namespace AMM {
     void PhysiologyEngineManager::StartTickSimulation() {
         LOG_INFO << "Starting tick simulation";
         running = true;
-        m_pe->running = true;
+        if (m_pe != nullptr) {
+            m_pe->running = true;
+        }
         paused = false;
     }
 
     void PhysiologyEngineManager::StopTickSimulation() {
+        StopScenario();
         m_mutex.lock();
         paused = true;
         running = false;
 
         if (m_pe == nullptr) {
             LOG_WARNING << "Physiology engine not running, all other settings reset.";
+            m_mutex.unlock();
             return;
         }
 
         LOG_INFO << "Deleting Physiology Engine thread";
+        BiogearsThread *engine = m_pe;
         m_pe = nullptr;
         m_mutex.unlock();
+
+        // Joins the engine's state writer and recorder, after any queued saves
+        engine->Shutdown();
         LOG_INFO << "Simulation stopped and reset.";
     }
 
+    void PhysiologyEngineManager::RunScenario(BiogearsThread *engine, const std::string &file) {
+        engine->LoadScenarioFile(file, liveScenarios);
+        engine->scenarioLoading = false;
+
+        m_mutex.lock();
+        nodePathMap = engine->GetNodePathTable();
+        publishPlanDirty = true;
+        m_mutex.unlock();
+    }
+
+    void PhysiologyEngineManager::StopScenario() {
+        if (!scenarioThread.joinable()) {
+            return;
+        }
+        // Finished work leaves its scheduled actions alone
+        if (scenarioEngine->HasBackgroundWork()) {
+            if (scenarioEngine->IsAdvancing()) {
+                LOG_INFO << "Cancelling the running scenario.";
+            }
+            scenarioEngine->CancelAdvance();
+        }
+        scenarioThread.join();
+        scenarioEngine = nullptr;
+    }
+
+    void PhysiologyEngineManager::StartBackground(std::function<void()> work) {
+        StopScenario();
+        BiogearsThread *engine = m_pe;
+        scenarioEngine = engine;
+        if (replaying || standby) {
+            // Until the next input shows where the recorded scenario was
+            engine->HoldAdvanceAt(0.0);
+        }
+        engine->SetBackgroundWork(true);
+        scenarioThread = std::thread([engine, work] {
+            work();
+            engine->SetBackgroundWork(false);
+        });
+    }
+
+    void PhysiologyEngineManager::PaceBackground(const JournalEntry &entry) {
+        if (!scenarioThread.joinable()) {
+            return;
+        }
+        if (entry.scenario) {
+            scenarioEngine->HoldAdvanceAt(entry.engineTime);
+            scenarioEngine->WaitForHold(entry.engineTime);
+        } else {
+            FinishBackground();
+        }
+    }
+
+    void PhysiologyEngineManager::FinishBackground() {
+        if (!scenarioThread.joinable()) {
+            return;
+        }
+        scenarioEngine->ReleaseHold();
+        scenarioThread.join();
+        scenarioEngine = nullptr;
+    }
+
     void PhysiologyEngineManager::StartSimulation() { m_pe->StartSimulation(); }
 
     void PhysiologyEngineManager::StopSimulation() { m_pe->StopSimulation(); }
 
-    void PhysiologyEngineManager::ProcessStates() {
-        if (m_pe->startOfInhale) {
-            // LOG_DEBUG << "Start of inhale, sending render mod";
-            AMM::RenderModification renderMod;
-            renderMod.data("<RenderModification type='START_OF_INHALE'/>");
-            m_mgr->WriteRenderModification(renderMod);
-            m_pe->startOfInhale = false;
-        } else if (m_pe->startOfExhale) {
-            // LOG_DEBUG << "Start of exhale, sending render mod";
-            AMM::RenderModification renderMod;
-            renderMod.data("<RenderModification type='START_OF_EXHALE'/>");
-            m_mgr->WriteRenderModification(renderMod);
-            m_pe->startOfExhale = false;
+    void PhysiologyEngineManager::PublishEvent(const PhysiologyEvent &event) {
+        if (standby) {
+            return;
+        }
+        std::string name;
+        if (event.source == PhysiologyEvent::PATIENT) {
+            auto type = static_cast<CDM::enumPatientEvent::value>(event.type);
+            switch (type) {
+                case CDM::enumPatientEvent::StartOfCardiacCycle:
+                    // Every beat; nothing downstream renders it
+                    return;
+                case CDM::enumPatientEvent::StartOfInhale:
+                case CDM::enumPatientEvent::StartOfExhale:
+                    // Only on a change of phase
+                    if (event.active && event.type != lastBreathPhase) {
+                        lastBreathPhase = event.type;
+                        m_mgr->WriteRenderModification(type == CDM::enumPatientEvent::StartOfInhale
+                                                       ? *startOfInhaleRenderMod : *startOfExhaleRenderMod);
+                    }
+                    return;
+                case CDM::enumPatientEvent::IrreversibleState:
+                    if (event.active && !m_pe->irreversibleSent) {
+                        LOG_INFO << "Patient has entered irreversible state";
+                        m_pe->irreversible = true;
+                        PublishEventRecord("PATIENT_STATE_IRREVERSIBLE", "", true);
+                        m_pe->irreversibleSent = true;
+                    }
+                    return;
+                default:
+                    name = "PATIENT_EVENT_" + CDM::enumPatientEvent(type);
+                    break;
+            }
+        } else {
+            auto type = static_cast<CDM::enumAnesthesiaMachineEvent::value>(event.type);
+            name = "ANESTHESIA_MACHINE_EVENT_" + CDM::enumAnesthesiaMachineEvent(type);
         }
 
-        if (m_pe->irreversible && !m_pe->irreversibleSent) {
-            LOG_DEBUG << "Patient has entered an irreversible state, sending render mod.";
+        LOG_INFO << name << (event.active ? " started" : " ended") << " at " << event.simTime << "s";
+        std::ostringstream data;
+        data << "<Event active='" << (event.active ? "true" : "false") << "' simtime='" << event.simTime << "'/>";
+        PublishEventRecord(name, data.str(), false);
+    }
 
-            AMM::UUID erID;
-            erID.id(m_mgr->GenerateUuidString());
+    AMM::RenderModification &PhysiologyEngineManager::GetRenderModification(const std::string &type) {
+        auto it = renderModifications.find(type);
+        if (it == renderModifications.end()) {
+            AMM::RenderModification renderMod;
+            renderMod.data("<RenderModification type='" + type + "'/>");
+            it = renderModifications.emplace(type, renderMod).first;
+        }
+        return it->second;
+    }
 
-            FMA_Location fma;
-            AMM::UUID agentID;
+    void PhysiologyEngineManager::PublishEventRecord(const std::string &type, const std::string &data, bool render) {
+        // The primary publishes these until the standby takes over
+        if (standby) {
+            return;
+        }
+        AMM::UUID erID;
+        erID.id(m_mgr->GenerateUuidString());
 
-            AMM::EventRecord er;
-            er.id(erID);
-            er.location(fma);
-            er.agent_id(agentID);
-            er.type("PATIENT_STATE_IRREVERSIBLE");
-            m_mgr->WriteEventRecord(er);
+        eventRecord.id(erID);
+        eventRecord.type(type);
+        eventRecord.data(data);
+        m_mgr->WriteEventRecord(eventRecord);
 
-            AMM::RenderModification renderMod;
+        if (render) {
+            AMM::RenderModification &renderMod = GetRenderModification(type);
             renderMod.event_id(erID);
-            renderMod.data("<RenderModification type='PATIENT_STATE_IRREVERSIBLE'/>");
             m_mgr->WriteRenderModification(renderMod);
-            m_pe->irreversibleSent = true;
         }
+    }
 
-        if (m_pe->paralyzed && !m_pe->paralyzedSent) {
-            LOG_DEBUG << "Patient is paralyzed but we haven't sent the render mod.";
-            AMM::UUID erID;
-            erID.id(m_mgr->GenerateUuidString());
+    void PhysiologyEngineManager::ProcessStates() {
+        // Everything raised since the last tick, oldest first
+        PhysiologyEvent event;
+        while (m_pe->PopEvent(event)) {
+            PublishEvent(event);
+        }
+
+        uint64_t dropped = m_pe->GetDroppedEvents();
+        if (dropped != reportedDroppedEvents) {
+            // A new engine thread starts counting again
+            if (dropped > reportedDroppedEvents) {
+                LOG_WARNING << "Physiology event ring overflowed, " << dropped << " events dropped.";
+            }
+            reportedDroppedEvents = dropped;
+        }
 
-            FMA_Location fma;
-            AMM::UUID agentID;
+        // Assessments run here, between engine steps, so each request sees a whole step
+        m_mutex.lock();
+        std::vector<AssessmentPanel> assessments;
+        assessments.swap(pendingAssessments);
+        m_mutex.unlock();
+        for (auto panel : assessments) {
+            PublishEventRecord("PATIENT_ASSESSMENT", m_pe->GetAssessment(panel), false);
+        }
 
-            AMM::EventRecord er;
-            er.id(erID);
-            er.location(fma);
-            er.agent_id(agentID);
-            er.type("PATIENT_STATE_PARALYZED");
-            m_mgr->WriteEventRecord(er);
+        m_pe->TakeAlarms(alarmTransitions);
+        for (const auto &alarm : alarmTransitions) {
+            LOG_INFO << "Alarm " << alarm.name << (alarm.active ? " raised" : " cleared") << ", " << alarm.node
+                     << " = " << alarm.value;
+            std::ostringstream data;
+            data << "<Alarm node='" << alarm.node << "' value='" << alarm.value << "' simtime='" << alarm.simTime
+                 << "'/>";
+            PublishEventRecord(alarm.active ? alarm.name : alarm.name + "_CLEARED", data.str(), false);
+        }
 
-            AMM::RenderModification renderMod;
-            renderMod.event_id(erID);
-            renderMod.data("<RenderModification type='PATIENT_STATE_PARALYZED'/>");
-            m_mgr->WriteRenderModification(renderMod);
+        if (m_pe->paralyzed && !m_pe->paralyzedSent) {
+            LOG_DEBUG << "Patient is paralyzed but we haven't sent the render mod.";
+            PublishEventRecord("PATIENT_STATE_PARALYZED", "", true);
             m_pe->paralyzedSent = true;
         }
     }
@@ -508,73 +967,518 @@ namespace AMM {
         }
     }
 
-    int PhysiologyEngineManager::GetTickCount() { return lastFrame; }
+    void PhysiologyEngineManager::ConfigureEngine() {
+        m_mutex.lock();
+        m_pe->SetLoggedFields(loggedFields);
+        m_pe->SetTrends(trendNodes, trendWindows);
+        m_pe->SetAlarmRules(alarmRules);
+        m_mutex.unlock();
+        this->SetLogging(logging_enabled);
+        this->SetBinaryStates(binary_states_enabled);
+
+        m_mutex.lock();
+        m_pe->SetStateSavedCallback([this](const std::string &savedFile, bool saved) {
+            PublishStateSaved(savedFile, saved);
+        });
+        m_pe->SetCheckpoints(checkpointInterval, checkpointDepth, checkpointMemoryMB * 1024 * 1024);
+        m_mutex.unlock();
+    }
+
+    void PhysiologyEngineManager::ReadEngineConfig() {
+        read_config_value("checkpoint_interval", [this](const std::string &value) {
+            checkpointInterval = std::stod(value);
+        });
+        read_config_value("checkpoint_depth", [this](const std::string &value) {
+            checkpointDepth = std::stoul(value);
+        });
+        read_config_value("checkpoint_memory_mb", [this](const std::string &value) {
+            checkpointMemoryMB = std::stoul(value);
+        });
+        if (!read_config_value("forecast_horizon", [this](const std::string &value) {
+            forecastSettings.horizon = std::stod(value);
+        })) {
+            forecastSettings.horizon = 0.0;
+        }
+        read_config_value("forecast_period", [this](const std::string &value) {
+            forecastSettings.period = std::stod(value);
+        });
+        read_config_value("forecast_interval", [this](const std::string &value) {
+            forecastSettings.interval = std::stod(value);
+        });
+        read_config_value("forecast_cpu_budget", [this](const std::string &value) {
+            forecastSettings.cpuBudget = std::stod(value);
+        });
+        read_config_value("migration_timeout", [this](const std::string &value) {
+            migrationTimeout = std::stod(value);
+        });
+        auto host = config.find("migration_host");
+        if (host != config.end()) {
+            migrationHost = host->second;
+        }
+        read_config_value("standby_liveliness", [this](const std::string &value) {
+            standbyLiveliness = std::stod(value);
+        });
+        read_config_value("trend_windows", [this](const std::string &value) {
+            std::vector<std::string> windows;
+            boost::split(windows, value, boost::is_any_of(", "), boost::token_compress_on);
+            std::vector<double> parsed;
+            for (const auto &window : windows) {
+                if (!window.empty()) {
+                    parsed.push_back(std::stod(window));
+                }
+            }
+            trendWindows = parsed;
+        });
+        LOG_INFO << "Checkpointing every " << checkpointInterval << "s, keeping " << checkpointDepth
+                 << " checkpoints in at most " << checkpointMemoryMB << "MB";
+
+        auto fields = config.find("log_fields");
+        if (fields != config.end()) {
+            loggedFields = fields->second;
+        }
+        auto trended = config.find("trend_nodes");
+        if (trended != config.end()) {
+            trendNodes = trended->second;
+        }
+        auto published = config.find("publish_nodes");
+        if (published != config.end()) {
+            SetDefaultNodes(published->second);
+        }
+        auto timeline = config.find("scenario_timeline");
+        if (timeline != config.end() && !timeline->second.empty()) {
+            liveScenarios = timeline->second != "advance";
+        }
+        auto rules = config.find("alarm_rules");
+        if (rules != config.end()) {
+            alarmRules.clear();
+            if (!rules->second.empty()) {
+                AlarmEngine::LoadRules(rules->second, alarmRules);
+            }
+        }
+        auto forecasted = config.find("forecast_nodes");
+        if (forecasted != config.end() && !forecasted->second.empty()) {
+            forecastNodes = forecasted->second;
+        }
+
+        UpdateForecaster();
 
-    void PhysiologyEngineManager::Status() {
         if (m_pe != nullptr) {
-            return m_pe->Status();
+            m_mutex.lock();
+            m_pe->SetCheckpoints(checkpointInterval, checkpointDepth, checkpointMemoryMB * 1024 * 1024);
+            m_pe->SetLoggedFields(loggedFields);
+            m_pe->SetTrends(trendNodes, trendWindows);
+            m_pe->SetAlarmRules(alarmRules);
+            m_mutex.unlock();
         }
     }
 
-    void PhysiologyEngineManager::Shutdown() {
-        SendShutdown();
+    void PhysiologyEngineManager::SaveState(const std::string &saveFile) {
+        LOG_INFO << "Saving state to " << saveFile;
+        m_mutex.lock();
+        bool captured = m_pe->SaveState(saveFile);
+        m_mutex.unlock();
 
-        LOG_DEBUG << "[PhysiologyManager] Shutting down physiology engine.";
-        m_pe->Shutdown();
+        if (!captured) {
+            PublishStateSaved(saveFile, false);
+        }
     }
 
-// Listener events
+    void PhysiologyEngineManager::PublishStateSaved(const std::string &saveFile, bool saved) {
+        // Called from the state writer thread once the file is on disk
+        AMM::UUID erID;
+        erID.id(m_mgr->GenerateUuidString());
 
-    void PhysiologyEngineManager::OnNewPhysiologyModification(AMM::PhysiologyModification &pm, SampleInfo_t *info) {
-        LOG_INFO << "Physiology modification received (type " << pm.type() << "): " << pm.data();
-        if (m_pe == nullptr || !running) {
-            LOG_WARNING << "Physiology engine not running, cannot execute physiology modification.";
-            return;
-        }
+        FMA_Location fma;
 
-        // If the payload is empty, use the type to execute an XML file.
-        // Otherwise, the payload is considered to be XML to execute.
-        if (pm.data().empty()) {
-            LOG_INFO << "Executing scenario file: " << pm.type();
+        AMM::EventRecord er;
+        er.id(erID);
+        er.location(fma);
+        er.agent_id(patientAgent);
+        er.type(saved ? "STATE_SAVED" : "STATE_SAVE_FAILED");
+        er.data(saveFile);
+        m_mgr->WriteEventRecord(er);
+    }
+
+    void PhysiologyEngineManager::SetBinaryStates(bool binaryStates) {
+        binary_states_enabled = binaryStates;
+        if (m_pe != nullptr) {
             m_mutex.lock();
-            m_pe->ExecuteCommand(pm.type());
+            m_pe->SetBinaryStates(binary_states_enabled);
             m_mutex.unlock();
-            return;
-        } else {
-            if (pm.type().empty() || pm.type() == "biogears") {
-                LOG_INFO << "Executing Biogears PhysMod XML patient action";
+        }
+    }
+
+    int PhysiologyEngineManager::GetTickCount() { return lastFrame; }
+
+    void PhysiologyEngineManager::Status() {
+        if (m_pe != nullptr) {
+            m_pe->Status();
+        }
+        if (m_pe != nullptr && m_pe->IsAdvancing()) {
+            double done, total;
+            m_pe->GetAdvanceProgress(done, total);
+            LOG_INFO << "Advancing scenario:\t\t" << done << " of " << total << "s";
+        }
+        if (forecaster.IsRunning()) {
+            LOG_INFO << "Forecasts:\t\t\t" << forecaster.GetForecastCount() << " ("
+                     << forecaster.GetPreemptionCount() << " preempted)";
+        }
+        if (predictor != nullptr && predictor->GetPendingCount() > 0) {
+            LOG_INFO << "What-if predictions:\t" << predictor->GetPendingCount();
+        }
+        if (!patientId.empty()) {
+            LOG_INFO << "Patient:\t\t\t" << patientId << " (" << stepCost << "ms per tick)";
+        }
+        LOG_INFO << "Nodes evaluated:\t\t" << evaluatedNodes;
+        LOG_INFO << "Nodes skipped:\t\t\t" << skippedNodes;
+    }
+
+    void PhysiologyEngineManager::UpdateForecaster() {
+        // Forecasts run ahead from rewind checkpoints, so they only run when checkpoints are enabled
+        if (forecastSettings.horizon > 0.0 && checkpointInterval > 0.0 && !replaying && !standby) {
+            forecastSettings.nodes = ResolveNodeList(forecastNodes);
+            forecaster.Start(forecastSettings, [this](double &simTime) {
                 m_mutex.lock();
-                m_pe->ExecuteXMLCommand(pm.data());
+                BiogearsThread *engine = m_pe;
                 m_mutex.unlock();
-                return;
-            }
-            LOG_INFO << "Executing AMM PhysMod XML patient action, type " << pm.type();
-            try {
-                ExecutePhysiologyModification(pm.data());
-            } catch (std::exception &e) {
-                LOG_ERROR << "Unable to apply physiology modification: " << e.what();
+                return engine != nullptr ? engine->GetLatestCheckpoint(simTime)
+                                         : std::shared_ptr<const CDM::PhysiologyEngineStateData>();
+            }, [this](const WhatIfPredictor::Prediction &prediction) {
+                PublishPrediction("PATIENT_FORECAST", prediction);
+            });
+        } else {
+            if (forecastSettings.horizon > 0.0 && checkpointInterval <= 0.0) {
+                LOG_WARNING << "Forecasting needs checkpoints, set checkpoint_interval above 0.";
             }
+            forecaster.Stop();
         }
     }
 
-    void PhysiologyEngineManager::OnNewSimulationControl(AMM::SimulationControl &simControl, SampleInfo_t *info) {
-        switch (simControl.type()) {
-            case AMM::ControlType::RUN: {
-                LOG_DEBUG << "SimControl recieved: Run sim.";
-                if (!running) {
-                    LOG_INFO << "Not running, calling starttick.";
-                    StartTickSimulation();
-                }
-                break;
-            }
-
-            case AMM::ControlType::HALT: {
-                LOG_DEBUG << "SimControl recieved: Halt sim";
-                if (running) {
-                    paused = true;
-                }
-                break;
-            }
+    void PhysiologyEngineManager::Shutdown() {
+        SendShutdown();
+        StopStandby();
+        StopMigration();
+        forecaster.Stop();
+        predictor.reset();
+        StopScenario();
+
+        // A replay that failed to open its journal never loaded an engine
+        if (m_pe != nullptr) {
+            LOG_DEBUG << "[PhysiologyManager] Shutting down physiology engine.";
+            m_pe->Shutdown();
+        }
+    }
+
+    bool PhysiologyEngineManager::StartJournal(const std::string &journalFile) {
+        return journal.Open(journalFile, stateFile);
+    }
+
+    void PhysiologyEngineManager::StopJournal() {
+        journal.Close();
+    }
+
+    PhysiologyEngineManager::InputScope::InputScope(PhysiologyEngineManager &manager)
+            : m_manager(manager), m_engine(nullptr) {
+        m_manager.inputMutex.lock();
+        m_engine = m_manager.m_pe;
+        if (m_engine != nullptr) {
+            m_engine->BeginInput();
+        }
+    }
+
+    PhysiologyEngineManager::InputScope::~InputScope() {
+        if (m_engine != nullptr) {
+            m_engine->EndInput();
+        }
+        m_manager.inputMutex.unlock();
+    }
+
+    bool PhysiologyEngineManager::AcceptInput(JournalEntry &entry, SampleInfo_t *info) {
+        // While replaying or following a primary, only the journal drives the engine
+        if ((replaying || standby) && info != nullptr) {
+            return false;
+        }
+        // Another manager holds this module now
+        if (fenced && info != nullptr) {
+            return false;
+        }
+
+        if (m_pe != nullptr) {
+            // A scenario still loading its state holds the engine; its advance starts after
+            if (!m_pe->scenarioLoading) {
+                entry.engineTime = m_pe->GetEngineTime();
+            }
+            entry.scenario = m_pe->HasBackgroundWork();
+        }
+
+        if (info != nullptr && entry.type != JournalEntryType::TICK &&
+            entry.type != JournalEntryType::MODULE_CONFIGURATION) {
+            std::lock_guard<std::mutex> lock(migrationMutex);
+            if (migrating) {
+                // Applied by the target, or here if the migration fails
+                migrationInputs.push_back(entry);
+                migrationInput.notify_one();
+                return false;
+            }
+            if (migrationOverlap && IsDuplicateInput(entry, false)) {
+                migrationInput.notify_all();
+                return false;
+            }
+        }
+
+        if (!replaying) {
+            journal.Record(entry);
+        }
+        standbyFeed.Record(entry);
+
+        TrackCheckpointInputs();
+        if (checkpointInputs.engine != nullptr) {
+            checkpointInputs.entries.push_back(entry);
+        }
+        return true;
+    }
+
+    void PhysiologyEngineManager::TrackCheckpointInputs() {
+        if (checkpointInterval <= 0.0) {
+            checkpointInputs.engine = nullptr;
+            checkpointInputs.entries.clear();
+            checkpointInputs.complete = false;
+            return;
+        }
+        if (m_pe != checkpointInputs.engine || checkpointInputs.entries.size() >= MaxCheckpointInputs) {
+            DiscardCheckpointInputs();
+        }
+        if (m_pe == nullptr) {
+            return;
+        }
+
+        double simTime = 0.0;
+        uint64_t sequence = m_pe->GetLatestCheckpointSequence(simTime);
+        // Older sequences turn up again after a rewind discards the newer checkpoints
+        if (sequence > checkpointInputs.sequence) {
+            auto &entries = checkpointInputs.entries;
+            while (!entries.empty() && entries.front().engineTime < simTime) {
+                entries.pop_front();
+            }
+            checkpointInputs.sequence = sequence;
+            checkpointInputs.complete = true;
+        }
+    }
+
+    void PhysiologyEngineManager::DiscardCheckpointInputs() {
+        double simTime = 0.0;
+        checkpointInputs.engine = m_pe;
+        checkpointInputs.sequence = m_pe != nullptr ? m_pe->GetLatestCheckpointSequence(simTime) : 0;
+        checkpointInputs.complete = false;
+        checkpointInputs.entries.clear();
+    }
+
+    std::shared_ptr<const CDM::PhysiologyEngineStateData>
+    PhysiologyEngineManager::GetCheckpointInputs(double &simTime, std::vector<JournalEntry> &inputs) {
+        TrackCheckpointInputs();
+        if (m_pe == nullptr || !checkpointInputs.complete) {
+            return nullptr;
+        }
+        uint64_t sequence = 0;
+        std::shared_ptr<const CDM::PhysiologyEngineStateData> state = m_pe->GetLatestCheckpoint(simTime, &sequence);
+        // A scenario thread may have taken a newer one in between
+        if (state == nullptr || sequence != checkpointInputs.sequence) {
+            return nullptr;
+        }
+        inputs.assign(checkpointInputs.entries.begin(), checkpointInputs.entries.end());
+        return state;
+    }
+
+    void PhysiologyEngineManager::ReplayOnBranch(BiogearsThread &engine, const JournalEntry &input) {
+        if (input.type == JournalEntryType::PHYSIOLOGY_MODIFICATION) {
+            if (input.second.empty()) {
+                engine.ExecuteCommand(input.first);
+            } else if (input.first.empty() || input.first == "biogears") {
+                engine.ExecuteXMLCommand(input.second);
+            } else {
+                try {
+                    ExecutePhysiologyModification(&engine, input.second);
+                } catch (std::exception &e) {
+                    LOG_ERROR << "Unable to apply physiology modification: " << e.what();
+                }
+            }
+        } else if (input.type == JournalEntryType::INSTRUMENT_DATA) {
+            if (input.first == "ventilator" || input.first == "erventilator") {
+                engine.SetVentilator(input.second);
+            } else if (input.first == "bvm_mask") {
+                engine.SetBVMMask(input.second);
+            } else if (input.first == "ivpump") {
+                engine.SetIVPump(input.second);
+            }
+        }
+    }
+
+    bool PhysiologyEngineManager::Replay(const std::string &journalFile) {
+        JournalReader reader;
+        if (!reader.Open(journalFile)) {
+            return false;
+        }
+
+        replaying = true;
+        if (reader.GetStateFile() != stateFile) {
+            LOG_INFO << "Journal was recorded from " << reader.GetStateFile() << ", reloading.";
+            StopTickSimulation();
+            authoringMode = false;
+            stateFile = reader.GetStateFile();
+            InitializeBiogears();
+        }
+
+        LOG_INFO << "Replaying input journal " << journalFile;
+        uint64_t ticks = 0;
+        uint64_t inputs = 0;
+        auto begin = std::chrono::high_resolution_clock::now();
+
+        // Inputs are fed through the same handlers, in recorded order, without waiting on ticks
+        JournalEntry entry;
+        while (reader.Next(entry)) {
+            PaceBackground(entry);
+            DispatchInput(entry);
+            if (entry.type == JournalEntryType::TICK) {
+                ++ticks;
+            } else {
+                ++inputs;
+            }
+        }
+        FinishBackground();
+
+        auto end = std::chrono::high_resolution_clock::now();
+        double elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count() * 1e-9;
+        LOG_INFO << "Replayed " << ticks << " ticks and " << inputs << " other inputs in " << elapsed << "s ("
+                 << (elapsed > 0 ? ticks / elapsed : 0) << " ticks/s).";
+        replaying = false;
+        return true;
+    }
+
+    void PhysiologyEngineManager::DispatchInput(const JournalEntry &entry) {
+        switch (entry.type) {
+            case JournalEntryType::TICK: {
+                AMM::Tick ti;
+                ti.frame(entry.frame);
+                ti.time(entry.time);
+                OnNewTick(ti, nullptr);
+                break;
+            }
+            case JournalEntryType::COMMAND: {
+                AMM::Command cm;
+                cm.message(entry.first);
+                HandleCommand(cm, nullptr, entry.second);
+                break;
+            }
+            case JournalEntryType::SIMULATION_CONTROL: {
+                AMM::SimulationControl simControl;
+                simControl.type(static_cast<AMM::ControlType>(entry.control));
+                simControl.timestamp(entry.frame);
+                OnNewSimulationControl(simControl, nullptr);
+                break;
+            }
+            case JournalEntryType::PHYSIOLOGY_MODIFICATION: {
+                AMM::PhysiologyModification pm;
+                pm.type(entry.first);
+                pm.data(entry.second);
+                OnNewPhysiologyModification(pm, nullptr);
+                break;
+            }
+            case JournalEntryType::INSTRUMENT_DATA: {
+                AMM::InstrumentData i;
+                i.instrument(entry.first);
+                i.payload(entry.second);
+                OnNewInstrumentData(i, nullptr);
+                break;
+            }
+            case JournalEntryType::MODULE_CONFIGURATION: {
+                AMM::ModuleConfiguration mc;
+                mc.name(entry.first);
+                mc.capabilities_configuration(entry.second);
+                OnNewModuleConfiguration(mc, nullptr);
+                break;
+            }
+        }
+    }
+
+// Listener events
+
+    void PhysiologyEngineManager::OnNewPhysiologyModification(AMM::PhysiologyModification &pm, SampleInfo_t *info) {
+        // Addressed by a [PATIENT:<id>] prefix on the type
+        std::string type = pm.type();
+        if (info != nullptr && !TakeAddressed(type)) {
+            return;
+        }
+        pm.type(type);
+
+        InputScope input(*this);
+        JournalEntry entry;
+        entry.type = JournalEntryType::PHYSIOLOGY_MODIFICATION;
+        entry.first = pm.type();
+        entry.second = pm.data();
+        if (!AcceptInput(entry, info)) {
+            return;
+        }
+
+        LOG_INFO << "Physiology modification received (type " << pm.type() << "): " << pm.data();
+        if (m_pe == nullptr || !running) {
+            LOG_WARNING << "Physiology engine not running, cannot execute physiology modification.";
+            return;
+        }
+
+        // If the payload is empty, use the type to execute an XML file.
+        // Otherwise, the payload is considered to be XML to execute.
+        if (pm.data().empty()) {
+            LOG_INFO << "Executing scenario file: " << pm.type();
+            m_mutex.lock();
+            m_pe->ExecuteCommand(pm.type());
+            m_mutex.unlock();
+            return;
+        } else {
+            if (pm.type().empty() || pm.type() == "biogears") {
+                LOG_INFO << "Executing Biogears PhysMod XML patient action";
+                m_mutex.lock();
+                m_pe->ExecuteXMLCommand(pm.data());
+                m_mutex.unlock();
+                return;
+            }
+            LOG_INFO << "Executing AMM PhysMod XML patient action, type " << pm.type();
+            try {
+                ExecutePhysiologyModification(pm.data());
+            } catch (std::exception &e) {
+                LOG_ERROR << "Unable to apply physiology modification: " << e.what();
+            }
+        }
+    }
+
+    void PhysiologyEngineManager::OnNewSimulationControl(AMM::SimulationControl &simControl, SampleInfo_t *info) {
+        InputScope input(*this);
+        JournalEntry entry;
+        entry.type = JournalEntryType::SIMULATION_CONTROL;
+        entry.control = static_cast<uint32_t>(simControl.type());
+        entry.frame = simControl.timestamp();
+        if (!AcceptInput(entry, info)) {
+            return;
+        }
+
+        switch (simControl.type()) {
+            case AMM::ControlType::RUN: {
+                LOG_DEBUG << "SimControl recieved: Run sim.";
+                if (m_pe != nullptr && m_pe->scenarioLoading) {
+                    LOG_WARNING << "Scenario is still loading its initial state, not starting.";
+                } else if (!running) {
+                    LOG_INFO << "Not running, calling starttick.";
+                    StartTickSimulation();
+                }
+                break;
+            }
+
+            case AMM::ControlType::HALT: {
+                LOG_DEBUG << "SimControl recieved: Halt sim";
+                if (running) {
+                    paused = true;
+                }
+                break;
+            }
 
 
             case AMM::ControlType::RESET: {
@@ -597,10 +1501,7 @@ namespace AMM {
                     std::string filenamedate = get_filename_date();
                     ss << "SavedState_" << filenamedate << "@" << (int) std::round(simTime) << "s."
                        << stateFilePrefix;
-                    LOG_INFO << "Saved state to " << ss.str();
-                    m_mutex.lock();
-                    m_pe->SaveState(ss.str());
-                    m_mutex.unlock();
+                    SaveState(ss.str());
                 } else {
                     LOG_ERROR << "Simulation has not been run, no state to save.";
                 }
@@ -611,32 +1512,58 @@ namespace AMM {
     }
 
     void PhysiologyEngineManager::OnNewCommand(Command &cm, SampleInfo_t *info) {
-        if (!cm.message().compare(0, sysPrefix.size(), sysPrefix)) {
-            std::string value = cm.message().substr(sysPrefix.size());
+        std::string sender;
+        if (info != nullptr) {
+            std::ostringstream writer;
+            writer << info->sample_identity.writer_guid();
+            sender = writer.str();
+        }
+        HandleCommand(cm, info, sender);
+    }
+
+    void PhysiologyEngineManager::HandleCommand(Command &cm, SampleInfo_t *info, const std::string &sender) {
+        std::string message = cm.message();
+        if (info != nullptr && fenced) {
+            return;
+        }
+        if (info != nullptr && standby) {
+            // Only the primary's answer to a fence matters while standing by
+            WatchPrimary(message);
+            return;
+        }
+        if (info != nullptr && HandleCoordinatorCommand(message)) {
+            return;
+        }
+        if (info != nullptr && !TakeAddressed(message)) {
+            return;
+        }
+
+        InputScope input(*this);
+        JournalEntry entry;
+        entry.type = JournalEntryType::COMMAND;
+        entry.first = message;
+        entry.second = sender;
+        if (!AcceptInput(entry, info)) {
+            return;
+        }
+
+        if (!message.compare(0, sysPrefix.size(), sysPrefix)) {
+            std::string value = message.substr(sysPrefix.size());
             if (value.compare("ENABLE_LOGGING") == 0) {
                 LOG_DEBUG << "Enabling logging";
                 this->SetLogging(true);
             } else if (value.compare("DISABLE_LOGGING") == 0) {
                 LOG_DEBUG << "Disabling logging";
                 this->SetLogging(false);
-            } else if (!value.compare(0, loadPrefix.size(), loadPrefix)) {
-                if (running || m_pe != nullptr) {
-                    LOG_INFO << "Loading state, but shutting down existing sim and physiology engine thread first.";
-                    StopTickSimulation();
-                }
-
-                authoringMode = false;
-                LOG_INFO << "Loading state.  Setting state file to " << value.substr(loadPrefix.size());
-                std::string holdStateFile = stateFile;
-                stateFile = "./states/" + value.substr(loadPrefix.size()) + "." + stateFilePrefix;
-                std::ifstream infile(stateFile);
-                if (!infile.good()) {
-                    LOG_ERROR << "State file does not exist: " << stateFile;
-                    stateFile = holdStateFile;
-                    LOG_ERROR << "Returning to last good state: " << stateFile;
+            } else if (value.compare("CANCEL_ADVANCE") == 0) {
+                if (m_pe != nullptr && (m_pe->IsAdvancing() || m_pe->GetScheduledActionCount() > 0)) {
+                    LOG_INFO << "Cancelling scenario time advancement and scheduled actions";
+                    m_pe->CancelAdvance();
+                } else {
+                    LOG_WARNING << "No scenario time advancement to cancel.";
                 }
-                infile.close();
-                InitializeBiogears();
+            } else if (!value.compare(0, loadPrefix.size(), loadPrefix)) {
+                LoadStateFile(value.substr(loadPrefix.size()));
             } else if (!value.compare(0, loadPatient.size(), loadPatient)) {
                 if (running || m_pe != nullptr) {
                     LOG_INFO << "Loading patient, but shutting down existing sim and physiology engine thread first.";
@@ -662,12 +1589,34 @@ namespace AMM {
                     double simTime = m_pe->GetSimulationTime();
                     ss << value.substr(saveState.size()) << "@" << (int) std::round(simTime) << "s."
                        << stateFilePrefix;
-                    LOG_INFO << "Saved state to " << ss.str();
+                    SaveState(ss.str());
+                } else {
+                    LOG_ERROR << "Simulation has not been run, no state to save.";
+                }
+            } else if (!value.compare(0, assessmentPrefix.size(), assessmentPrefix)) {
+                AssessmentPanel panel;
+                if (BiogearsThread::ParseAssessmentPanel(value.substr(assessmentPrefix.size()), panel)) {
                     m_mutex.lock();
-                    m_pe->SaveState(ss.str());
+                    pendingAssessments.push_back(panel);
                     m_mutex.unlock();
                 } else {
-                    LOG_ERROR << "Simulation has not been run, no state to save.";
+                    LOG_ERROR << "Unknown assessment panel " << value.substr(assessmentPrefix.size());
+                }
+            } else if (!value.compare(0, whatIfPrefix.size(), whatIfPrefix)) {
+                RequestWhatIf(value.substr(whatIfPrefix.size()));
+            } else if (!value.compare(0, subscribePrefix.size(), subscribePrefix)) {
+                SubscribeNodes(value.substr(subscribePrefix.size()), true, sender);
+            } else if (!value.compare(0, unsubscribePrefix.size(), unsubscribePrefix)) {
+                SubscribeNodes(value.substr(unsubscribePrefix.size()), false, sender);
+            } else if (!value.compare(0, rewindPrefix.size(), rewindPrefix)) {
+                if (m_pe != nullptr) {
+                    double seconds = atof(value.substr(rewindPrefix.size()).c_str());
+                    LOG_INFO << "Rewinding simulation by " << seconds << "s";
+                    // Inputs taken before the rewind no longer lead to the engine's state
+                    DiscardCheckpointInputs();
+                    StartBackground([engine = m_pe, seconds] { engine->Rewind(seconds); });
+                } else {
+                    LOG_ERROR << "Simulation has not been run, nothing to rewind.";
                 }
             } else if (!value.compare(0, loadScenarioFile.size(), loadScenarioFile)) {
                 if (running || m_pe != nullptr) {
@@ -695,30 +1644,677 @@ namespace AMM {
                     return;
                 }
 
-                this->SetLogging(logging_enabled);
+                ConfigureEngine();
 
                 m_pe->scenarioLoading = true;
-                m_pe->LoadScenarioFile(scenarioFile);
-                m_pe->scenarioLoading = false;
-
-                nodePathMap = m_pe->GetNodePathTable();
+                StartBackground([this, engine = m_pe, file = scenarioFile] { RunScenario(engine, file); });
 
                 //		running = true;
                 //		m_pe->running = true;
                 paused = true;
 
             } else {
-                LOG_DEBUG << "Unknown system command received: " << cm.message();
+                LOG_DEBUG << "Unknown system command received: " << message;
+            }
+        } else {
+            LOG_DEBUG << "Unknown command received: " << message;
+        }
+    }
+
+    void PhysiologyEngineManager::LoadStateFile(const std::string &name) {
+        if (running || m_pe != nullptr) {
+            LOG_INFO << "Loading state, but shutting down existing sim and physiology engine thread first.";
+            StopTickSimulation();
+        }
+
+        authoringMode = false;
+        LOG_INFO << "Loading state.  Setting state file to " << name;
+        std::string holdStateFile = stateFile;
+        stateFile = "./states/" + name + "." + stateFilePrefix;
+        std::ifstream infile(stateFile);
+        if (!infile.good()) {
+            LOG_ERROR << "State file does not exist: " << stateFile;
+            stateFile = holdStateFile;
+            LOG_ERROR << "Returning to last good state: " << stateFile;
+        }
+        infile.close();
+        InitializeBiogears();
+    }
+
+    bool PhysiologyEngineManager::TakeAddressed(std::string &message) {
+        std::string address;
+        if (!message.compare(0, patientPrefix.size(), patientPrefix)) {
+            size_t end = message.find(']', patientPrefix.size());
+            if (end == std::string::npos) {
+                return false;
+            }
+            address = message.substr(patientPrefix.size(), end - patientPrefix.size());
+            message.erase(0, end + 1);
+        }
+        return address == patientId;
+    }
+
+    bool PhysiologyEngineManager::HandleCoordinatorCommand(const std::string &message) {
+        if (message.compare(0, sysPrefix.size(), sysPrefix)) {
+            return false;
+        }
+        std::string value = message.substr(sysPrefix.size());
+        if (!value.compare(0, announcePrefix.size(), announcePrefix)) {
+            // Other managers answering the coordinator, or another holder of this module
+            std::vector<std::string> fields;
+            uint64_t announcedTerm = 0;
+            if (ParseAnnouncement(value.substr(announcePrefix.size()), fields, announcedTerm) &&
+                fields[0] == ModuleId()) {
+                if (announcedTerm > term) {
+                    Fence(announcedTerm);
+                } else if (announcedTerm < term) {
+                    // A former primary that was only stalled; make sure it hears who holds the module now
+                    Announce();
+                }
+            }
+        } else if (!value.compare(0, fencePrefix.size(), fencePrefix)) {
+            // <module id>;<term>, from a standby that lost our feed
+            std::vector<std::string> fields;
+            std::string request = value.substr(fencePrefix.size());
+            boost::split(fields, request, boost::is_any_of(";"));
+            if (fields.size() >= 2 && fields[0] == ModuleId() && strtoull(fields[1].c_str(), nullptr, 10) > term) {
+                LOG_WARNING << "Standby lost the feed from this manager, answering it";
+                Announce();
+            }
+        } else if (!value.compare(0, queryPrefix.size(), queryPrefix)) {
+            Announce();
+        } else if (!value.compare(0, assignPrefix.size(), assignPrefix)) {
+            // <module id>;<patient id>;<state>
+            std::vector<std::string> fields;
+            std::string assignment = value.substr(assignPrefix.size());
+            boost::split(fields, assignment, boost::is_any_of(";"));
+            if (fields.size() >= 2 && fields[0] == ModuleId() && fields[1] != patientId) {
+                AssignPatient(fields[1], fields.size() > 2 ? fields[2] : "");
+            }
+        } else if (!value.compare(0, releasePrefix.size(), releasePrefix)) {
+            if (!patientId.empty() && value.substr(releasePrefix.size()) == patientId) {
+                ReleasePatient();
+            }
+        } else if (!value.compare(0, migrateInPrefix.size(), migrateInPrefix)) {
+            // <module id>;<patient id>, from the coordinator to the target
+            std::vector<std::string> fields;
+            std::string request = value.substr(migrateInPrefix.size());
+            boost::split(fields, request, boost::is_any_of(";"));
+            if (fields.size() < 2 || fields[0] != ModuleId()) {
+                return true;
+            }
+            auto link = std::make_shared<PatientMigration>(migrationToken);
+            uint16_t port = 0;
+            if (!patientId.empty() || migrationBusy.exchange(true)) {
+                SendCommand(sysPrefix + migrateFailedPrefix + fields[1] + ";target busy");
+                return true;
+            }
+            std::string host = migrationHost.empty() ? get_host_name() : migrationHost;
+            if (!link->Listen(host, port)) {
+                migrationBusy = false;
+                SendCommand(sysPrefix + migrateFailedPrefix + fields[1] + ";target unreachable");
+                return true;
+            }
+            if (migrationThread.joinable()) {
+                migrationThread.join();
+            }
+            migrationThread = std::thread(&PhysiologyEngineManager::MigrateIn, this, link, fields[1]);
+            SendCommand(sysPrefix + migrateReadyPrefix + fields[1] + ";" + ModuleId() + ";" +
+                        host + ";" + std::to_string(port));
+        } else if (!value.compare(0, migrateReadyPrefix.size(), migrateReadyPrefix)) {
+            // <patient id>;<module id>;<host>;<port>, from the target to the source
+            std::vector<std::string> fields;
+            std::string ready = value.substr(migrateReadyPrefix.size());
+            boost::split(fields, ready, boost::is_any_of(";"));
+            if (fields.size() < 4 || patientId.empty() || fields[0] != patientId || migrationBusy.exchange(true)) {
+                return true;
+            }
+            migrationTarget = fields[1];
+            migrationTargetHost = fields[2];
+            migrationTargetPort = static_cast<uint16_t>(atoi(fields[3].c_str()));
+            if (running && !paused) {
+                // At the next tick boundary
+                migrationRequested = true;
+            } else {
+                BeginMigration();
             }
+        } else if (!value.compare(0, migratedPrefix.size(), migratedPrefix) ||
+                   !value.compare(0, migrateFailedPrefix.size(), migrateFailedPrefix)) {
+            // For the coordinator
         } else {
-            LOG_DEBUG << "Unknown command received: " << cm.message();
+            return false;
         }
+        return true;
+    }
+
+    void PhysiologyEngineManager::Announce() {
+        if (fenced) {
+            return;
+        }
+        std::ostringstream ss;
+        ss << sysPrefix << announcePrefix << ModuleId() << ";" << get_host_name() << ";" << patientId << ";"
+           << stepCost << ";" << (running ? 1 : 0) << ";" << term;
+        SendCommand(ss.str());
+    }
+
+    void PhysiologyEngineManager::SendCommand(const std::string &message) {
+        AMM::Command cmd;
+        cmd.message(message);
+        m_mgr->WriteCommand(cmd);
+    }
+
+    void PhysiologyEngineManager::SetPatientId(const std::string &id) {
+        m_mutex.lock();
+        patientId = id;
+        patientAgent.id(id);
+        eventRecord.agent_id(patientAgent);
+        publishPlanDirty = true;
+        m_mutex.unlock();
+    }
+
+    void PhysiologyEngineManager::AssignPatient(const std::string &id, const std::string &state) {
+        LOG_INFO << "Coordinator assigned patient " << id << (state.empty() ? "" : " from state " + state);
+        SetPatientId(id);
+        if (!state.empty()) {
+            LoadStateFile(state);
+        }
+        Announce();
+    }
+
+    void PhysiologyEngineManager::ReleasePatient() {
+        LOG_INFO << "Coordinator released patient " << patientId;
+        StopTickSimulation();
+        SetPatientId("");
+        Announce();
+    }
+
+    void PhysiologyEngineManager::StopMigration() {
+        if (migrationThread.joinable()) {
+            migrationThread.join();
+        }
+    }
+
+    void PhysiologyEngineManager::BeginMigration() {
+        if (migrationThread.joinable()) {
+            migrationThread.join();
+        }
+        {
+            std::lock_guard<std::mutex> lock(migrationMutex);
+            migrationInputs.clear();
+            migrationBacklog.clear();
+            migrating = true;
+        }
+        migrationStart = std::chrono::steady_clock::now();
+
+        double simTime = 0.0;
+        double startingBloodVolume = 0.0;
+        std::shared_ptr<CDM::PhysiologyEngineStateData> state;
+        if (m_pe != nullptr) {
+            state = m_pe->CaptureState(simTime);
+            startingBloodVolume = m_pe->GetStartingBloodVolume();
+        }
+        if (state == nullptr) {
+            FailMigration("no engine state");
+            return;
+        }
+        LOG_INFO << "Migrating " << patientId << " at " << simTime << "s to " << migrationTarget << " on "
+                 << migrationTargetHost << ":" << migrationTargetPort;
+        migrationThread = std::thread(&PhysiologyEngineManager::MigrateOut, this, state, simTime,
+                                      startingBloodVolume);
+    }
+
+    void PhysiologyEngineManager::MigrateOut(std::shared_ptr<CDM::PhysiologyEngineStateData> state, double simTime,
+                                             double startingBloodVolume) {
+        auto remaining = [this]() {
+            auto deadline = migrationStart + std::chrono::milliseconds(static_cast<int64_t>(migrationTimeout * 1000));
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    deadline - std::chrono::steady_clock::now()).count();
+            return static_cast<int>(std::max<int64_t>(0, left));
+        };
+
+        PatientMigration link(migrationToken);
+        PatientMigration::Snapshot snapshot;
+        snapshot.patientId = patientId;
+        snapshot.moduleId = ModuleId();
+        snapshot.simTime = simTime;
+        snapshot.lastFrame = static_cast<uint64_t>(lastFrame);
+        snapshot.startingBloodVolume = startingBloodVolume;
+        snapshot.running = running;
+        snapshot.paused = paused;
+        std::string stateXml;
+        bool ok = StateArchive::Serialize(*state, stateXml) && StateArchive::Compress(stateXml, snapshot.payload);
+        snapshot.size = stateXml.size();
+        state.reset();
+        stateXml.clear();
+        ok = ok && link.Connect(migrationTargetHost, migrationTargetPort, remaining()) && link.SendSnapshot(snapshot);
+
+        // Forward what arrives until the target has the engine running
+        bool live = false;
+        PatientMigration::Message message;
+        std::string body;
+        while (ok && !live && remaining() > 0) {
+            std::vector<JournalEntry> inputs;
+            {
+                std::unique_lock<std::mutex> lock(migrationMutex);
+                migrationInput.wait_for(lock, std::chrono::milliseconds(5),
+                                        [this]() { return !migrationInputs.empty(); });
+                inputs.assign(migrationInputs.begin(), migrationInputs.end());
+                migrationInputs.clear();
+                migrationBacklog.insert(migrationBacklog.end(), inputs.begin(), inputs.end());
+            }
+            for (const auto &input : inputs) {
+                ok = ok && link.SendInput(input);
+            }
+            if (ok && link.Poll(0)) {
+                ok = link.Receive(message, body, remaining()) && message == PatientMigration::Message::LIVE;
+                live = ok;
+            }
+        }
+        if (!live) {
+            link.Send(PatientMigration::Message::ABORT);
+            link.Close();
+            FailMigration(ok ? "timed out" : "transfer failed");
+            return;
+        }
+
+        std::string id = patientId;
+        {
+            // Nothing is held back once the target has the patient
+            std::lock_guard<std::mutex> lock(migrationMutex);
+            for (const auto &input : migrationInputs) {
+                link.SendInput(input);
+            }
+            link.Send(PatientMigration::Message::CUTOVER);
+            migrationInputs.clear();
+            migrationBacklog.clear();
+            SetPatientId("");
+        }
+        link.Close();
+        double blackout = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - migrationStart).count();
+        LOG_INFO << "Migrated " << id << " to " << migrationTarget << ", " << blackout << "ms without ticking";
+
+        StopTickSimulation();
+        migrating = false;
+        SendCommand(sysPrefix + migratedPrefix + id + ";" + migrationTarget + ";" + std::to_string(blackout));
+        Announce();
+        migrationBusy = false;
+    }
+
+    void PhysiologyEngineManager::FailMigration(const std::string &reason) {
+        std::vector<JournalEntry> held;
+        {
+            std::lock_guard<std::mutex> lock(migrationMutex);
+            held.swap(migrationBacklog);
+            held.insert(held.end(), migrationInputs.begin(), migrationInputs.end());
+            migrationInputs.clear();
+            migrating = false;
+        }
+        LOG_WARNING << "Migration of " << patientId << " failed (" << reason << "), keeping it here";
+        for (const auto &input : held) {
+            DispatchInput(input);
+        }
+        SendCommand(sysPrefix + migrateFailedPrefix + patientId + ";" + reason);
+        migrationBusy = false;
+    }
+
+    void PhysiologyEngineManager::MigrateIn(std::shared_ptr<PatientMigration> link, std::string id) {
+        int timeoutMs = static_cast<int>(migrationTimeout * 1000);
+        PatientMigration::Message message;
+        std::string body;
+        PatientMigration::Snapshot snapshot;
+
+        // The source still has to hear READY and reach a tick boundary
+        bool ok = link->Accept(2 * timeoutMs) && link->Receive(message, body, timeoutMs) &&
+                  message == PatientMigration::Message::SNAPSHOT && PatientMigration::ParseSnapshot(body, snapshot) &&
+                  snapshot.patientId == id;
+        if (!ok) {
+            LOG_ERROR << "Unable to receive " << id << " from its manager";
+            link->Send(PatientMigration::Message::ABORT);
+            migrationBusy = false;
+            return;
+        }
+
+        if (running || m_pe != nullptr) {
+            StopTickSimulation();
+        }
+        if (!ResumeSnapshot(snapshot)) {
+            LOG_ERROR << "Unable to resume " << id << " from its engine state";
+            link->Send(PatientMigration::Message::ABORT);
+            StopTickSimulation();
+            migrationBusy = false;
+            return;
+        }
+
+        // Live: the patient's inputs now reach both managers until CUTOVER
+        {
+            std::lock_guard<std::mutex> lock(migrationMutex);
+            liveInputs.clear();
+            forwardedInputs.clear();
+            migrationOverlap = true;
+        }
+        SetPatientId(id);
+        if (snapshot.running) {
+            StartTickSimulation();
+            paused = snapshot.paused;
+        }
+        ok = link->Send(PatientMigration::Message::LIVE);
+        Announce();
+        LOG_INFO << "Took over " << id << " at " << snapshot.simTime << "s";
+
+        bool aborted = false;
+        bool cutover = false;
+        JournalEntry entry;
+        while (ok && !cutover && !aborted && link->Receive(message, body, timeoutMs)) {
+            if (message == PatientMigration::Message::INPUT && PatientMigration::ParseInput(body, entry)) {
+                bool duplicate;
+                {
+                    std::lock_guard<std::mutex> lock(migrationMutex);
+                    duplicate = IsDuplicateInput(entry, true);
+                }
+                if (!duplicate) {
+                    DispatchInput(entry);
+                }
+            }
+            cutover = message == PatientMigration::Message::CUTOVER;
+            aborted = message == PatientMigration::Message::ABORT;
+        }
+        link->Close();
+        if (aborted) {
+            // The source gave up waiting for LIVE and kept the patient
+            LOG_WARNING << "Migration of " << id << " was abandoned by its manager";
+            ReleasePatient();
+        }
+
+        // Late copies of forwarded inputs can still arrive live; each is dropped
+        // once, so the overlap ends when none are left to match
+        {
+            std::unique_lock<std::mutex> lock(migrationMutex);
+            if (!migrationInput.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+                                         [this]() { return forwardedInputs.empty(); })) {
+                LOG_WARNING << forwardedInputs.size() << " inputs forwarded for " << id << " never arrived here directly";
+            }
+            migrationOverlap = false;
+            liveInputs.clear();
+            forwardedInputs.clear();
+        }
+        migrationBusy = false;
+    }
+
+    bool PhysiologyEngineManager::ResumeSnapshot(PatientMigration::Snapshot &snapshot) {
+        std::string stateXml;
+        std::unique_ptr<CDM::PhysiologyEngineStateData> state;
+        if (StateArchive::Decompress(snapshot.payload, snapshot.size, stateXml)) {
+            state = StateArchive::Parse(stateXml);
+        }
+        snapshot.payload.clear();
+        if (state == nullptr) {
+            return false;
+        }
+
+        if (m_pe == nullptr) {
+            m_mutex.lock();
+            m_pe = new BiogearsThread("logs/biogears.log");
+            m_mutex.unlock();
+            ConfigureEngine();
+        }
+        m_mutex.lock();
+        bool resumed = m_pe->ResumeState(*state, snapshot.simTime, snapshot.startingBloodVolume);
+        if (resumed) {
+            nodePathMap = m_pe->GetNodePathTable();
+            lastFrame = static_cast<int>(snapshot.lastFrame);
+            m_pe->SetLastFrame(lastFrame);
+            publishPlanDirty = true;
+        }
+        m_mutex.unlock();
+        return resumed;
+    }
+
+    bool PhysiologyEngineManager::StartStandbyFeed(const std::string &host, uint16_t port) {
+        std::string address = !host.empty() ? host : !migrationHost.empty() ? migrationHost : get_host_name();
+        LOG_INFO << "Serving a standby manager on " << address << ":" << port;
+        return standbyFeed.Start(address, port, migrationToken);
+    }
+
+    void PhysiologyEngineManager::StartStandby(const std::string &host, uint16_t port) {
+        StopStandby();
+        standbyStopping = false;
+        standby = true;
+        forecaster.Stop();
+        standbyThread = std::thread(&PhysiologyEngineManager::FollowPrimary, this, host, port);
+    }
+
+    void PhysiologyEngineManager::StopStandby() {
+        fenceMutex.lock();
+        standbyStopping = true;
+        fenceAnswered.notify_all();
+        fenceMutex.unlock();
+        if (standbyThread.joinable()) {
+            standbyThread.join();
+        }
+        standbyFeed.Stop();
+    }
+
+    void PhysiologyEngineManager::FeedStandby() {
+        if (m_pe == nullptr) {
+            return;
+        }
+        // A checkpoint taken on this tick's step follows every input fed so
+        // far; otherwise the newest one goes with the inputs since, so the
+        // tick never stops to capture the engine's state
+        double simTime = 0.0;
+        uint64_t sequence = m_pe->GetLatestCheckpointSequence(simTime);
+        bool fresh = sequence != 0 && sequence != standbySnapshotSequence &&
+                     std::abs(simTime - m_pe->GetEngineTime()) < 1e-6;
+        if (!fresh && !standbyFeed.NeedsSnapshot()) {
+            return;
+        }
+        std::vector<JournalEntry> inputs;
+        std::shared_ptr<const CDM::PhysiologyEngineStateData> state = GetCheckpointInputs(simTime, inputs);
+        if (state == nullptr) {
+            // No checkpoint yet, or none since a rewind; the standby waits for the next
+            if (checkpointInterval <= 0.0 && !standbyWarned) {
+                LOG_WARNING << "A standby needs checkpoints to sync from, set checkpoint_interval above 0.";
+                standbyWarned = true;
+            }
+            return;
+        }
+        standbySnapshotSequence = checkpointInputs.sequence;
+
+        PatientMigration::Snapshot snapshot;
+        snapshot.patientId = patientId;
+        snapshot.moduleId = ModuleId();
+        snapshot.simTime = simTime;
+        snapshot.lastFrame = static_cast<uint64_t>(lastFrame);
+        snapshot.startingBloodVolume = m_pe->GetStartingBloodVolume();
+        snapshot.running = running;
+        snapshot.paused = paused;
+        snapshot.term = term;
+        standbyFeed.SendSnapshot(state, snapshot, inputs);
+    }
+
+    void PhysiologyEngineManager::FollowPrimary(std::string host, uint16_t port) {
+        bool synced = false;
+        while (!standbyStopping) {
+            int timeoutMs = static_cast<int>(standbyLiveliness * 1000);
+            PatientMigration link(migrationToken);
+            if (!link.Connect(host, port, timeoutMs)) {
+                if (synced && !PrimaryAnswers()) {
+                    break;
+                }
+                // The primary may not be up yet
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+                continue;
+            }
+            LOG_INFO << "Standing by for the manager on " << host << ":" << port;
+
+            PatientMigration::Message message;
+            std::string body;
+            JournalEntry entry;
+            while (!standbyStopping && link.Receive(message, body, timeoutMs)) {
+                if (message == PatientMigration::Message::SNAPSHOT) {
+                    PatientMigration::Snapshot snapshot;
+                    if (!PatientMigration::ParseSnapshot(body, snapshot) || !ResumeSnapshot(snapshot)) {
+                        LOG_ERROR << "Unable to load the primary's engine state";
+                        continue;
+                    }
+                    if (!synced) {
+                        LOG_INFO << "Standby in step with " << snapshot.moduleId << " at " << snapshot.simTime << "s";
+                    }
+                    synced = true;
+                    fenceMutex.lock();
+                    term = snapshot.term;
+                    standbyPrimary = snapshot.moduleId;
+                    fenceMutex.unlock();
+                    if (snapshot.patientId != patientId) {
+                        SetPatientId(snapshot.patientId);
+                    }
+                    // Ticks read the run flags under the input lock
+                    InputScope input(*this);
+                    m_mutex.lock();
+                    running = snapshot.running;
+                    paused = snapshot.paused;
+                    m_pe->running = running;
+                    m_mutex.unlock();
+                } else if (message == PatientMigration::Message::INPUT && synced &&
+                           PatientMigration::ParseInput(body, entry)) {
+                    PaceBackground(entry);
+                    DispatchInput(entry);
+                }
+            }
+            link.Close();
+            if (synced && !PrimaryAnswers()) {
+                break;
+            }
+        }
+        if (synced && !standbyStopping) {
+            TakeOver();
+        }
+    }
+
+    bool PhysiologyEngineManager::PrimaryAnswers() {
+        if (standbyStopping) {
+            return false;
+        }
+        std::unique_lock<std::mutex> lock(fenceMutex);
+        primaryAnswered = false;
+        std::string primary = standbyPrimary;
+        lock.unlock();
+
+        // A primary that is only cut off from us answers with an announcement
+        // under the term it holds, and keeps the patient
+        LOG_WARNING << "Lost the feed from " << primary << ", asking it to answer before taking over";
+        SendCommand(sysPrefix + fencePrefix + primary + ";" + std::to_string(term + 1));
+
+        lock.lock();
+        fenceAnswered.wait_for(lock, std::chrono::milliseconds(static_cast<int>(standbyLiveliness * 1000)),
+                               [this] { return primaryAnswered || standbyStopping; });
+        if (primaryAnswered) {
+            LOG_INFO << "Primary " << primary << " answered, standing by again";
+        }
+        return primaryAnswered;
+    }
+
+    void PhysiologyEngineManager::WatchPrimary(const std::string &message) {
+        if (message.compare(0, sysPrefix.size() + announcePrefix.size(), sysPrefix + announcePrefix)) {
+            return;
+        }
+        std::vector<std::string> fields;
+        uint64_t announcedTerm = 0;
+        if (!ParseAnnouncement(message.substr(sysPrefix.size() + announcePrefix.size()), fields, announcedTerm)) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(fenceMutex);
+        if (fields[0] == standbyPrimary && announcedTerm >= term) {
+            primaryAnswered = true;
+            fenceAnswered.notify_all();
+        }
+    }
+
+    bool PhysiologyEngineManager::ParseAnnouncement(const std::string &announcement,
+                                                    std::vector<std::string> &fields, uint64_t &announcedTerm) {
+        boost::split(fields, announcement, boost::is_any_of(";"));
+        if (fields.size() < 5 || fields[0].empty()) {
+            return false;
+        }
+        announcedTerm = fields.size() > 5 ? strtoull(fields[5].c_str(), nullptr, 10) : 0;
+        return true;
+    }
+
+    void PhysiologyEngineManager::Fence(uint64_t newer) {
+        LOG_ERROR << "Module " << ModuleId() << " was taken over under term " << newer << " (this manager held "
+                  << term << "), stopping";
+        fenced = true;
+        forecaster.Stop();
+        standbyFeed.Stop();
+        StopTickSimulation();
+    }
+
+    void PhysiologyEngineManager::TakeOver() {
+        // Inputs wait until the module is ours, under the new term
+        InputScope input(*this);
+        fenceMutex.lock();
+        uint64_t held = ++term;
+        std::string primary = standbyPrimary;
+        // Carries on as the same module, so routing and subscribers need not change
+        if (!primary.empty()) {
+            m_uuid.id(primary);
+        }
+        fenceMutex.unlock();
+        LOG_WARNING << "Primary manager " << primary << " went quiet, taking over at frame " << lastFrame
+                    << " under term " << held;
+        if (scenarioEngine != nullptr) {
+            scenarioEngine->ReleaseHold();
+        }
+        m_mutex.lock();
+        publishPlanDirty = true;
+        m_mutex.unlock();
+        standby = false;
+        UpdateForecaster();
+        PublishOperationalDescription();
+        PublishConfiguration();
+        Announce();
+
+        std::ostringstream data;
+        data << "<Failover frame='" << lastFrame << "' simtime='" << (m_pe != nullptr ? m_pe->GetEngineTime() : 0.0)
+             << "'/>";
+        PublishEventRecord("PHYSIOLOGY_MANAGER_FAILOVER", data.str(), false);
+    }
+
+    std::string PhysiologyEngineManager::ModuleId() {
+        std::lock_guard<std::mutex> lock(fenceMutex);
+        return m_uuid.id();
+    }
+
+    bool PhysiologyEngineManager::IsDuplicateInput(const JournalEntry &entry, bool forwarded) {
+        std::ostringstream ss;
+        ss << static_cast<int>(entry.type) << ';' << static_cast<int>(entry.control) << ';' << entry.frame << ';'
+           << entry.first << '\0' << entry.second;
+        std::string key = ss.str();
+        auto &seen = forwarded ? liveInputs : forwardedInputs;
+        auto match = seen.find(key);
+        if (match != seen.end()) {
+            seen.erase(match);
+            return true;
+        }
+        (forwarded ? forwardedInputs : liveInputs).insert(key);
+        return false;
     }
 
     void PhysiologyEngineManager::OnNewModuleConfiguration(AMM::ModuleConfiguration &mc, SampleInfo_t *info) {
+        InputScope input(*this);
+        JournalEntry entry;
+        entry.type = JournalEntryType::MODULE_CONFIGURATION;
+        entry.first = mc.name();
+        entry.second = mc.capabilities_configuration();
+        if (!AcceptInput(entry, info)) {
+            return;
+        }
+
         if (mc.name() == "physiology_engine") {
             LOG_DEBUG << "Entering ModuleConfiguration for physiology engine.";
             ParseXML(mc.capabilities_configuration());
+            ReadEngineConfig();
             auto it = config.find("state_file");
             if (it != config.end()) {
                 LOG_INFO << "(find) state_file is " << it->second;
@@ -806,25 +2402,66 @@ namespace AMM {
     }
 
     void PhysiologyEngineManager::OnNewTick(AMM::Tick &ti, SampleInfo_t *info) {
-        if (running) {
+        InputScope input(*this);
+        JournalEntry entry;
+        entry.type = JournalEntryType::TICK;
+        entry.frame = ti.frame();
+        entry.time = ti.time();
+        if (!AcceptInput(entry, info)) {
+            return;
+        }
+
+        if (migrationRequested.exchange(false)) {
+            BeginMigration();
+        }
+        if (migrating) {
+            return;
+        }
+
+        if (running && m_pe != nullptr) {
             if (ti.frame() > 0 || !paused) {
                 m_pe->running = true;
                 lastFrame = static_cast<int>(ti.frame());
                 m_pe->SetLastFrame(lastFrame);
                 // Per-frame stuff happens here
+                auto tickStart = std::chrono::steady_clock::now();
                 try {
                     AdvanceTimeTick();
-                    PublishData(false);
+                    if (!standby) {
+                        PublishData(false);
+                    }
                 } catch (std::exception &e) {
                     LOG_ERROR << "Unable to advance time: " << e.what();
                 }
+                auto tickTime = std::chrono::steady_clock::now() - tickStart;
+                stepCost += 0.05 * (std::chrono::duration<double, std::milli>(tickTime).count() - stepCost);
+                if (forecaster.IsRunning()) {
+                    // Ticks are 20ms apart; a tick this slow leaves no room for forecasting
+                    if (tickTime > std::chrono::milliseconds(15)) {
+                        forecaster.Preempt();
+                    }
+                    forecaster.Notify(m_pe->GetSimulationTime());
+                }
             } else {
                 std::cout.flush();
             }
         }
+
+        if (standbyFeed.IsConnected()) {
+            FeedStandby();
+        }
     }
 
     void PhysiologyEngineManager::OnNewInstrumentData(AMM::InstrumentData &i, SampleInfo_t *info) {
+        InputScope input(*this);
+        JournalEntry entry;
+        entry.type = JournalEntryType::INSTRUMENT_DATA;
+        entry.first = i.instrument();
+        entry.second = i.payload();
+        if (!AcceptInput(entry, info)) {
+            return;
+        }
+
         LOG_DEBUG << "Instrument data for " << i.instrument() << " received with payload: " << i.payload();
         if (m_pe == nullptr || !running) {
             LOG_WARNING << "Physiology engine not running, cannot execute instrument data.";
@@ -1,9 +1,14 @@
 #pragma once
 
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <ctime>
 
+#include <deque>
+#include <functional>
 #include <mutex>
+#include <set>
 #include <thread>
 
 #include "amm_std.h"
@@ -11,6 +16,11 @@
 #include "tinyxml2.h"
 
 #include "BiogearsThread.h"
+#include "ForecastService.h"
+#include "InputJournal.h"
+#include "PatientMigration.h"
+#include "StandbyFeed.h"
+#include "WhatIfPredictor.h"
 
 using namespace tinyxml2;
 
@@ -23,7 +33,7 @@ namespace AMM {
 
         virtual ~PhysiologyEngineManager();
 
-        BiogearsThread *m_pe;
+        BiogearsThread *m_pe = nullptr;
         std::string stateFile;
         std::string patientFile;
         std::string scenarioFile;
@@ -34,6 +44,31 @@ namespace AMM {
 
         void SetLogging(bool logging_enabled);
 
+        void SetBinaryStates(bool binaryStates);
+
+        void ConfigureEngine();
+
+        void ReadEngineConfig();
+
+        // ./states/<name>.xml, keeping the current state file when it does not exist
+        void LoadStateFile(const std::string &name);
+
+        void SaveState(const std::string &saveFile);
+
+        // Record every input the manager handles to a binary journal
+        bool StartJournal(const std::string &journalFile);
+
+        void StopJournal();
+
+        // Drive the engine from a recorded journal as fast as it will step,
+        // ignoring live inputs until the journal is exhausted.
+        bool Replay(const std::string &journalFile);
+
+        // Feeds a journaled or forwarded input through the handler it arrived on
+        void DispatchInput(const JournalEntry &entry);
+
+        void PublishStateSaved(const std::string &saveFile, bool saved);
+
         void StartSimulation();
 
         void StopSimulation();
@@ -46,6 +81,9 @@ namespace AMM {
 
         void ExecutePhysiologyModification(std::string pm);
 
+        // Applies an AMM physiology modification to the given engine
+        void ExecutePhysiologyModification(BiogearsThread *engine, const std::string &pm);
+
         void PublishData(bool force);
 
         void PrintAvailableNodePaths();
@@ -62,20 +100,152 @@ namespace AMM {
 
         void SendShutdown();
 
+        // Tells the coordinator which patient this process runs and what a step costs
+        void Announce();
+
+        // Takes on a patient for the coordinator; state is a name under ./states, or empty to keep the engine
+        void AssignPatient(const std::string &id, const std::string &state);
+
+        void ReleasePatient();
+
+        // Waits for a finished migration's thread
+        void StopMigration();
+
+        // Serves a hot standby manager on this port, on the migration host's
+        // interface unless host names another
+        bool StartStandbyFeed(const std::string &host, uint16_t port);
+
+        // Follows the manager at host:port as its standby, taking over when it goes quiet
+        void StartStandby(const std::string &host, uint16_t port);
+
+        void StopStandby();
+
+        // Coordinator traffic, which is never addressed to a patient or journaled
+        bool HandleCoordinatorCommand(const std::string &message);
+
+        // Strips a [PATIENT:<id>] address; false when the message is for another process.
+        // Unaddressed messages are only for a process without a patient.
+        bool TakeAddressed(std::string &message);
+
         void WriteNodeData(std::string node);
 
         void WriteHighFrequencyNodeData(std::string node);
 
+        void PublishTrends();
+
+        // Adds or removes node paths or prefixes from what PublishData sends
+        // for one subscriber; * for all.  Other subscribers and the default
+        // set are not affected.
+        void SubscribeNodes(const std::string &nodes, bool subscribe, const std::string &subscriber);
+
+        // The nodes sent whatever is subscribed, from publish_nodes; empty or * for all
+        void SetDefaultNodes(const std::string &nodes);
+
+        // <WhatIf id minutes interval nodes>intervention</WhatIf>, where the
+        // intervention is an AMM PhysiologyModification or BioGears scenario XML
+        void RequestWhatIf(const std::string &request);
+
+        // Called from a what-if or forecast worker once the prediction is done
+        void PublishPrediction(const std::string &type, const WhatIfPredictor::Prediction &prediction);
+
+        // Node paths and prefixes, split and resolved
+        std::vector<std::string> ResolveNodeList(const std::string &nodes);
+
+        // Starts or stops the forecaster to match forecastSettings
+        void UpdateForecaster();
+
         void AdvanceTimeTick();
 
         void InitializeBiogears();
 
         void ProcessStates();
 
+        void PublishEvent(const PhysiologyEvent &event);
+
+        void PublishEventRecord(const std::string &type, const std::string &data, bool render);
+
+        AMM::RenderModification &GetRenderModification(const std::string &type);
+
         bool paused = false;
         bool running = false;
         int lastFrame = 0;
         bool logging_enabled = false;
+        bool binary_states_enabled = false;
+        // Checkpoints stall the tick while the state is captured, so they are opt-in
+        double checkpointInterval = 0.0;
+        size_t checkpointDepth = 20;
+        size_t checkpointMemoryMB = 256;
+        std::string loggedFields;
+        std::string trendNodes;
+        std::vector<double> trendWindows = {10, 60, 300};
+        std::vector<std::pair<std::string, double>> trendValues;
+        AMM::PhysiologyValue trendInstance;
+        std::vector<AlarmEngine::Rule> alarmRules;
+        std::vector<AlarmEngine::Transition> alarmTransitions;
+        std::vector<AssessmentPanel> pendingAssessments;
+        // Schedule scenario actions against the running clock instead of advancing through them
+        bool liveScenarios = true;
+        // Started with the first what-if request
+        std::unique_ptr<WhatIfPredictor> predictor;
+        uint64_t whatIfCount = 0;
+        // Key vitals, predicted unless a request names its own nodes
+        std::string forecastNodes = "Cardiovascular_HeartRate,Cardiovascular_Arterial_Mean_Pressure,"
+                                    "Respiratory_Respiration_Rate,BloodChemistry_Oxygen_Saturation";
+        // A horizon of 0 leaves the forecaster off
+        ForecastService::Settings forecastSettings;
+        ForecastService forecaster;
+
+        // Assigned by the coordinator; empty when this is the only manager on the domain
+        std::string patientId;
+        AMM::UUID patientAgent;
+        // Milliseconds per tick, engine step and publish, smoothed
+        double stepCost = 0.0;
+        // Longest a patient may go without ticking while it moves to another manager
+        double migrationTimeout = 5.0;
+        // Address other managers connect to for a migration; the host name when empty
+        std::string migrationHost;
+        // Shared by the managers, from AMM_MIGRATION_TOKEN; presented on every
+        // migration and standby connection
+        std::string migrationToken;
+        // Seconds without word from the primary before a standby asks it to
+        // answer, and as long again for the answer before taking over
+        double standbyLiveliness = 5.0;
+
+        struct PublishedNode {
+            std::string name;
+            // name, addressed to this process's patient
+            std::string publishedName;
+            double (BiogearsThread::*getter)();
+            // When there is no getter
+            int substanceNode;
+            // Sent as a value every publish cycle, evaluated every tick, sent as a waveform every tick
+            bool publish;
+            bool everyTick;
+            bool highFrequency;
+            // An evaluation failure was logged
+            bool failed;
+        };
+
+        void BuildPublishPlan();
+
+        std::vector<PublishedNode> publishPlan;
+        std::atomic<bool> publishPlanDirty{true};
+        // Under m_mutex: the default set, and what each subscriber added by writer id
+        bool publishAll = true;
+        std::set<std::string> defaultNodes;
+        std::map<std::string, std::set<std::string>> subscriptions;
+        uint64_t evaluatedNodes = 0;
+        uint64_t skippedNodes = 0;
+        AMM::PhysiologyValue nodeInstance;
+        AMM::PhysiologyWaveform waveformInstance;
+        uint64_t reportedDroppedEvents = 0;
+        int lastBreathPhase = -1;
+
+        // Reused samples; map entries keep their address
+        std::map<std::string, AMM::RenderModification> renderModifications;
+        AMM::RenderModification *startOfInhaleRenderMod = nullptr;
+        AMM::RenderModification *startOfExhaleRenderMod = nullptr;
+        AMM::EventRecord eventRecord;
         bool moduleEnabled = true;
 
         void OnNewModuleConfiguration(AMM::ModuleConfiguration &mc, SampleInfo_t *info);
@@ -103,6 +273,21 @@ namespace AMM {
         std::string loadPatient = "LOAD_PATIENT:";
         std::string saveState = "SAVE_STATE:";
         std::string loadScenarioFile = "LOAD_SCENARIOFILE:";
+        std::string rewindPrefix = "REWIND:";
+        std::string subscribePrefix = "SUBSCRIBE_NODES:";
+        std::string assessmentPrefix = "ASSESSMENT:";
+        std::string unsubscribePrefix = "UNSUBSCRIBE_NODES:";
+        std::string whatIfPrefix = "WHAT_IF:";
+        std::string patientPrefix = "[PATIENT:";
+        std::string announcePrefix = "PE_ANNOUNCE:";
+        std::string queryPrefix = "PE_QUERY";
+        std::string assignPrefix = "PE_ASSIGN:";
+        std::string releasePrefix = "PE_RELEASE:";
+        std::string migrateInPrefix = "PE_MIGRATE_IN:";
+        std::string migrateReadyPrefix = "PE_MIGRATE_READY:";
+        std::string migratedPrefix = "PE_MIGRATED:";
+        std::string migrateFailedPrefix = "PE_MIGRATE_FAILED:";
+        std::string fencePrefix = "PE_FENCE:";
         std::string stateFilePrefix = "xml";
         std::string patientFilePrefix = "xml";
 
@@ -114,5 +299,157 @@ namespace AMM {
 
         std::mutex m_mutex;
 
+        // Held by a handler from journaling an input until it has been applied,
+        // so inputs are applied in journal order and a scenario advancing on its
+        // own thread gives way between chunks
+        std::recursive_mutex inputMutex;
+
+        class InputScope {
+        public:
+            explicit InputScope(PhysiologyEngineManager &manager);
+
+            ~InputScope();
+
+        private:
+            PhysiologyEngineManager &m_manager;
+            BiogearsThread *m_engine;
+        };
+
+        InputJournal journal;
+        bool replaying = false;
+
+        bool AcceptInput(JournalEntry &entry, SampleInfo_t *info);
+
+        // Inputs accepted since the live engine's newest checkpoint, in order,
+        // so a copy of the engine can be brought up to date from that
+        // checkpoint instead of capturing its state.  Only touched with
+        // inputMutex held.
+        struct CheckpointInputs {
+            BiogearsThread *engine = nullptr;
+            uint64_t sequence = 0;
+            // False after a rewind or a new engine, until the next checkpoint
+            bool complete = false;
+            std::deque<JournalEntry> entries;
+        };
+        CheckpointInputs checkpointInputs;
+        static const size_t MaxCheckpointInputs = 50000;
+
+        void TrackCheckpointInputs();
+
+        void DiscardCheckpointInputs();
+
+        // The newest checkpoint and every input since, or nullptr when those do not add up to the live engine
+        std::shared_ptr<const CDM::PhysiologyEngineStateData> GetCheckpointInputs(double &simTime,
+                                                                                  std::vector<JournalEntry> &inputs);
+
+        // Applies a journaled input that changes the patient to a copy of the engine
+        void ReplayOnBranch(BiogearsThread &engine, const JournalEntry &input);
+
+        // sender is the writer of the command, journaled with it
+        void HandleCommand(Command &cm, SampleInfo_t *info, const std::string &sender);
+
+        void SendCommand(const std::string &message);
+
+        void SetPatientId(const std::string &id);
+
+        // Live migration, see PatientMigration.  The source stops ticking at a
+        // tick boundary and holds the patient's inputs for the target, which
+        // resumes from the engine state in memory rather than a state file.
+        void BeginMigration();
+
+        void MigrateOut(std::shared_ptr<CDM::PhysiologyEngineStateData> state, double simTime,
+                        double startingBloodVolume);
+
+        void MigrateIn(std::shared_ptr<PatientMigration> link, std::string id);
+
+        // Source side: the patient stays here and the held inputs are applied
+        void FailMigration(const std::string &reason);
+
+        // Target side, during the overlap: true when the input already came the other way
+        bool IsDuplicateInput(const JournalEntry &entry, bool forwarded);
+
+        std::thread migrationThread;
+        std::atomic<bool> migrationBusy{false};
+        std::atomic<bool> migrationRequested{false};
+        std::atomic<bool> migrating{false};
+        std::string migrationTarget;
+        std::string migrationTargetHost;
+        uint16_t migrationTargetPort = 0;
+        std::chrono::steady_clock::time_point migrationStart;
+        std::mutex migrationMutex;
+        std::condition_variable migrationInput;
+        // Inputs held while migrating, and those already forwarded in case the migration fails
+        std::deque<JournalEntry> migrationInputs;
+        std::vector<JournalEntry> migrationBacklog;
+        // Inputs seen on only one of the live and forwarded paths so far
+        bool migrationOverlap = false;
+        std::multiset<std::string> liveInputs;
+        std::multiset<std::string> forwardedInputs;
+
+        // Loads another manager's engine snapshot, into a new engine if there is none
+        bool ResumeSnapshot(PatientMigration::Snapshot &snapshot);
+
+        // Primary side, every tick: a new checkpoint, or a standby that just connected, gets a snapshot
+        void FeedStandby();
+
+        void FollowPrimary(std::string host, uint16_t port);
+
+        // Asks a primary whose feed lapsed whether it is still up; false when
+        // it does not answer within standbyLiveliness
+        bool PrimaryAnswers();
+
+        // Notes the primary's answer while standing by
+        void WatchPrimary(const std::string &message);
+
+        void TakeOver();
+
+        // m_uuid's id, which a standby changes when it takes the module over
+        std::string ModuleId();
+
+        // Another manager took this module over under a higher term
+        void Fence(uint64_t newer);
+
+        // <module id>;<host>;<patient id>;<step cost>;<running>;<term>, the term
+        // read as 0 when absent; false when there are too few fields
+        static bool ParseAnnouncement(const std::string &announcement, std::vector<std::string> &fields,
+                                      uint64_t &announcedTerm);
+
+        StandbyFeed standbyFeed;
+        uint64_t standbySnapshotSequence = 0;
+        bool standbyWarned = false;
+        std::thread standbyThread;
+        // While following a primary, inputs come only from its feed and nothing is published
+        std::atomic<bool> standby{false};
+        std::atomic<bool> standbyStopping{false};
+        // Guards standbyPrimary, primaryAnswered, term changes and the module id
+        std::mutex fenceMutex;
+        std::condition_variable fenceAnswered;
+        std::string standbyPrimary;
+        bool primaryAnswered = false;
+        // Raised each time a standby takes the module over; a manager that
+        // sees its module announced under a higher one stops for good
+        std::atomic<uint64_t> term{0};
+        std::atomic<bool> fenced{false};
+
+        // Scenario actions run off the command listener so physmods and
+        // CANCEL_ADVANCE are handled while long advances are in progress
+        void RunScenario(BiogearsThread *engine, const std::string &file);
+
+        // Cancels the running scenario and waits for it
+        void StopScenario();
+
+        // Runs a scenario or a rewind on scenarioThread.  When replaying or following a
+        // primary it is held until PaceBackground places each input against it.
+        void StartBackground(std::function<void()> work);
+
+        // Holds the scenario at the engine time the input was applied at, or
+        // lets it finish when it had finished by then
+        void PaceBackground(const JournalEntry &entry);
+
+        void FinishBackground();
+
+        std::thread scenarioThread;
+        BiogearsThread *scenarioEngine = nullptr;
+
     };
 }
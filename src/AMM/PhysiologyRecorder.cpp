@@ -0,0 +1,144 @@
+#include "PhysiologyRecorder.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "amm/BaseLogger.h"
+
+namespace AMM {
+    namespace {
+        // About 25 minutes of a 25-column table at 50Hz before rows are dropped
+        const size_t RingCapacity = 1 << 21;
+
+        const uint32_t ChunkRows = 1024;
+    }
+
+    PhysiologyRecorder::PhysiologyRecorder() : m_ring(RingCapacity) {
+    }
+
+    PhysiologyRecorder::~PhysiologyRecorder() {
+        Stop();
+    }
+
+    uint32_t PhysiologyRecorder::AddTable(const std::string &name, const std::vector<std::string> &columns) {
+        PendingTable table;
+        table.name = name;
+        table.columns.push_back("SIM_TIME");
+        table.columns.insert(table.columns.end(), columns.begin(), columns.end());
+        m_tables.push_back(table);
+        return static_cast<uint32_t>(m_tables.size() - 1);
+    }
+
+    void PhysiologyRecorder::ClearTables() {
+        if (!m_recording) {
+            m_tables.clear();
+        }
+    }
+
+    bool PhysiologyRecorder::Start(const std::string &file) {
+        if (m_recording) {
+            Stop();
+        }
+
+        if (!m_writer.Open(file)) {
+            return false;
+        }
+        size_t widest = 0;
+        for (auto &table : m_tables) {
+            m_writer.AddTable(table.name, table.columns);
+            table.rows.reserve(table.columns.size() * ChunkRows);
+            widest = std::max(widest, table.columns.size());
+        }
+        // table id + row
+        m_row.resize(widest + 1);
+
+        m_droppedRows = 0;
+        m_stopping = false;
+        m_recording = true;
+        m_thread = std::thread(&PhysiologyRecorder::Run, this);
+        LOG_INFO << "Recording physiology to " << file;
+        return true;
+    }
+
+    void PhysiologyRecorder::Stop() {
+        if (!m_recording) {
+            return;
+        }
+
+        m_recording = false;
+        m_stopping = true;
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+
+        m_writer.Close();
+        if (m_droppedRows > 0) {
+            LOG_WARNING << "Physiology recorder dropped " << m_droppedRows << " rows, the writer fell behind.";
+        }
+    }
+
+    bool PhysiologyRecorder::IsRecording() const {
+        return m_recording;
+    }
+
+    void PhysiologyRecorder::Record(uint32_t table, double simTime, const double *values) {
+        if (!m_recording || table >= m_tables.size()) {
+            return;
+        }
+
+        size_t width = m_tables[table].columns.size();
+        m_row[0] = table;
+        m_row[1] = simTime;
+        std::copy(values, values + width - 1, m_row.begin() + 2);
+        if (!m_ring.TryPush(m_row.data(), width + 1)) {
+            ++m_droppedRows;
+        }
+    }
+
+    uint64_t PhysiologyRecorder::GetDroppedRows() const {
+        return m_droppedRows;
+    }
+
+    void PhysiologyRecorder::Run() {
+        while (!m_stopping) {
+            if (m_ring.Empty()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                continue;
+            }
+            Drain();
+        }
+
+        // Whatever the engine pushed before Stop, then the partial chunks
+        Drain();
+        for (uint32_t table = 0; table < m_tables.size(); ++table) {
+            WriteRows(table);
+        }
+    }
+
+    void PhysiologyRecorder::Drain() {
+        double id = 0;
+        while (m_ring.TryPop(id)) {
+            auto table = static_cast<uint32_t>(id);
+            PendingTable &pending = m_tables[table];
+            size_t width = pending.columns.size();
+            size_t first = pending.rows.size();
+            pending.rows.resize(first + width);
+            // The producer pushes whole rows, so the rest of this one is already there
+            m_ring.TryPop(&pending.rows[first], width);
+
+            if (pending.rows.size() >= width * ChunkRows) {
+                WriteRows(table);
+            }
+        }
+    }
+
+    void PhysiologyRecorder::WriteRows(uint32_t table) {
+        PendingTable &pending = m_tables[table];
+        if (pending.rows.empty()) {
+            return;
+        }
+        auto rows = static_cast<uint32_t>(pending.rows.size() / pending.columns.size());
+        m_writer.WriteChunk(table, pending.rows.data(), rows);
+        pending.rows.clear();
+    }
+}
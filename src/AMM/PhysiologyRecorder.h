@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ColumnarFile.h"
+#include "SpscRing.h"
+
+namespace AMM {
+    // Records node values at full tick rate into a columnar file.  The engine
+    // thread only copies a row into a lock-free ring; a background thread
+    // batches rows into chunks and does the file I/O.
+    class PhysiologyRecorder {
+    public:
+        PhysiologyRecorder();
+
+        ~PhysiologyRecorder();
+
+        // Tables must be added before Start.  Every table gets a leading
+        // SIM_TIME column ahead of the given columns.
+        uint32_t AddTable(const std::string &name, const std::vector<std::string> &columns);
+
+        // Not while recording.
+        void ClearTables();
+
+        bool Start(const std::string &file);
+
+        // Drains the ring and closes the file.
+        void Stop();
+
+        bool IsRecording() const;
+
+        // Engine thread only.  values holds one value per column of the table.
+        void Record(uint32_t table, double simTime, const double *values);
+
+        uint64_t GetDroppedRows() const;
+
+    private:
+        struct PendingTable {
+            std::string name;
+            std::vector<std::string> columns;
+            std::vector<double> rows;
+        };
+
+        void Run();
+
+        void Drain();
+
+        void WriteRows(uint32_t table);
+
+        std::vector<PendingTable> m_tables;
+        SpscRing<double> m_ring;
+        ColumnarWriter m_writer;
+        std::thread m_thread;
+        std::atomic<bool> m_recording{false};
+        std::atomic<bool> m_stopping{false};
+        std::atomic<uint64_t> m_droppedRows{0};
+        std::vector<double> m_row;
+    };
+}
@@ -0,0 +1,322 @@
+#include "ScenarioReader.h"
+
+#include <cstring>
+#include <sstream>
+
+#include <biogears/cdm/scenario/SEAdvanceTime.h>
+
+#include "amm/BaseLogger.h"
+
+namespace AMM {
+    namespace {
+        const size_t BlockSize = 64 * 1024;
+
+        // "<cdm:Action xsi:type=..." is an Action
+        std::string LocalName(const std::string &tag) {
+            size_t end = tag.find_first_of(" \t\r\n/>", 1);
+            std::string name = tag.substr(1, end == std::string::npos ? std::string::npos : end - 1);
+            size_t colon = name.find(':');
+            return colon == std::string::npos ? name : name.substr(colon + 1);
+        }
+
+        std::string QualifiedName(const std::string &tag) {
+            size_t end = tag.find_first_of(" \t\r\n/>", 1);
+            return tag.substr(1, end == std::string::npos ? std::string::npos : end - 1);
+        }
+
+        bool IsEmptyElement(const std::string &tag) {
+            return tag.size() >= 2 && tag[tag.size() - 2] == '/';
+        }
+    }
+
+    bool ScenarioReader::Open(const std::string &scenarioFile) {
+        m_in.close();
+        m_in.clear();
+        m_in.open(scenarioFile, std::ios::binary);
+        if (!m_in.is_open()) {
+            LOG_ERROR << "Unable to open scenario " << scenarioFile;
+            return false;
+        }
+        m_buffer.clear();
+        m_pos = 0;
+        m_done = false;
+        m_prefix.clear();
+        m_pending.clear();
+        m_hasPending = false;
+        m_actionCount = 0;
+
+        std::string markup;
+        while (true) {
+            ReadText(nullptr);
+            if (!Available(1)) {
+                LOG_ERROR << "No scenario element in " << scenarioFile;
+                return false;
+            }
+            if (StartsWith("<?xml")) {
+                ReadUntil("?>", m_prefix);
+            } else if (StartsWith("<?")) {
+                ReadUntil("?>", markup);
+            } else if (StartsWith("<!--")) {
+                ReadUntil("-->", markup);
+            } else if (StartsWith("<!")) {
+                ReadUntil(">", markup);
+            } else {
+                break;
+            }
+        }
+
+        if (!ReadTag(markup)) {
+            LOG_ERROR << "Truncated scenario " << scenarioFile;
+            return false;
+        }
+        m_suffix = "</" + QualifiedName(markup) + ">";
+        if (IsEmptyElement(markup)) {
+            markup.erase(markup.size() - 2, 1);
+            m_done = true;
+        }
+        m_prefix += markup;
+
+        std::string element;
+        std::string name;
+        while (!m_done && ReadChild(element, name)) {
+            if (name == "Action") {
+                m_pending.swap(element);
+                m_hasPending = true;
+                break;
+            }
+            // Data requests are for BioGears' own scenario executor and can be long
+            if (name != "DataRequests") {
+                m_prefix += element;
+            }
+        }
+        m_header = m_prefix + m_suffix;
+        return true;
+    }
+
+    const std::string &ScenarioReader::GetHeader() const {
+        return m_header;
+    }
+
+    bool ScenarioReader::Next(std::string &document) {
+        std::string name;
+        while (!m_hasPending) {
+            if (m_done || !ReadChild(m_pending, name)) {
+                return false;
+            }
+            m_hasPending = name == "Action";
+        }
+        m_hasPending = false;
+
+        document.assign(m_prefix);
+        document += m_pending;
+        document += m_suffix;
+        ++m_actionCount;
+        return true;
+    }
+
+    size_t ScenarioReader::GetActionCount() const {
+        return m_actionCount;
+    }
+
+    std::unique_ptr<CDM::ScenarioData> ScenarioReader::Parse(const std::string &document) {
+        std::istringstream in(document);
+        try {
+            return CDM::Scenario(in, xml_schema::flags::dont_validate);
+        } catch (std::exception &e) {
+            LOG_ERROR << "Unable to parse scenario: " << e.what();
+        }
+        return nullptr;
+    }
+
+    std::unique_ptr<biogears::SEAction>
+    ScenarioReader::ParseAction(const std::string &document, biogears::SESubstanceManager &substances) {
+        std::unique_ptr<CDM::ScenarioData> data = Parse(document);
+        std::unique_ptr<biogears::SEAction> action;
+        try {
+            if (data != nullptr && !data->Action().empty()) {
+                action.reset(biogears::SEAction::newFromBind(data->Action().front(), substances));
+            }
+        } catch (std::exception &e) {
+            LOG_ERROR << "Unable to read action: " << e.what();
+        }
+        return action;
+    }
+
+    LiveScenarioFeed::LiveScenarioFeed(ScenarioReader &&reader, const std::string &scenarioFile, double nextTime,
+                                       double horizon)
+            : m_reader(std::move(reader)), m_file(scenarioFile), m_nextTime(nextTime), m_horizon(horizon) {}
+
+    bool LiveScenarioFeed::Feed(double simTime, biogears::SESubstanceManager &substances,
+                                ActionScheduler &scheduler) {
+        std::string document;
+        while (m_nextTime <= simTime + m_horizon) {
+            if (!m_reader.Next(document)) {
+                LOG_INFO << "Scheduled all " << m_scheduled << " actions of " << m_file << ", the last at "
+                         << m_nextTime << "s.";
+                return false;
+            }
+            std::unique_ptr<biogears::SEAction> action = ScenarioReader::ParseAction(document, substances);
+            if (action == nullptr) {
+                LOG_ERROR << "Unable to read action " << m_reader.GetActionCount() << " of " << m_file;
+                continue;
+            }
+            auto *advance = dynamic_cast<biogears::SEAdvanceTime *>(action.get());
+            if (advance != nullptr) {
+                m_nextTime += advance->GetTime(biogears::TimeUnit::s);
+            } else {
+                scheduler.Schedule(m_nextTime, std::move(action));
+                ++m_scheduled;
+            }
+        }
+        return true;
+    }
+
+    size_t LiveScenarioFeed::GetScheduledCount() const {
+        return m_scheduled;
+    }
+
+    bool ScenarioReader::Fill() {
+        // Offsets relative to m_pos stay valid across a fill
+        if (m_pos > 0) {
+            m_buffer.erase(0, m_pos);
+            m_pos = 0;
+        }
+        size_t size = m_buffer.size();
+        m_buffer.resize(size + BlockSize);
+        m_in.read(&m_buffer[size], BlockSize);
+        m_buffer.resize(size + static_cast<size_t>(m_in.gcount()));
+        return m_buffer.size() > size;
+    }
+
+    bool ScenarioReader::Available(size_t count) {
+        while (m_buffer.size() - m_pos < count) {
+            if (!Fill()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool ScenarioReader::StartsWith(const char *text) {
+        size_t length = strlen(text);
+        return Available(length) && m_buffer.compare(m_pos, length, text) == 0;
+    }
+
+    bool ScenarioReader::ReadText(std::string *text) {
+        while (true) {
+            size_t next = m_buffer.find('<', m_pos);
+            size_t end = next == std::string::npos ? m_buffer.size() : next;
+            if (text != nullptr) {
+                text->append(m_buffer, m_pos, end - m_pos);
+            }
+            m_pos = end;
+            if (next != std::string::npos) {
+                return true;
+            }
+            if (!Fill()) {
+                return false;
+            }
+        }
+    }
+
+    bool ScenarioReader::ReadUntil(const char *terminator, std::string &markup) {
+        size_t length = strlen(terminator);
+        size_t searched = 0;
+        while (true) {
+            size_t found = m_buffer.find(terminator, m_pos + searched);
+            if (found != std::string::npos) {
+                markup.assign(m_buffer, m_pos, found + length - m_pos);
+                m_pos = found + length;
+                return true;
+            }
+            size_t unread = m_buffer.size() - m_pos;
+            searched = unread >= length ? unread - length + 1 : 0;
+            if (!Fill()) {
+                return false;
+            }
+        }
+    }
+
+    bool ScenarioReader::ReadTag(std::string &tag) {
+        char quote = 0;
+        size_t offset = 1;
+        while (true) {
+            for (; m_pos + offset < m_buffer.size(); ++offset) {
+                char c = m_buffer[m_pos + offset];
+                if (quote != 0) {
+                    if (c == quote) {
+                        quote = 0;
+                    }
+                } else if (c == '"' || c == '\'') {
+                    quote = c;
+                } else if (c == '>') {
+                    tag.assign(m_buffer, m_pos, offset + 1);
+                    m_pos += offset + 1;
+                    return true;
+                }
+            }
+            if (!Fill()) {
+                return false;
+            }
+        }
+    }
+
+    bool ScenarioReader::ReadChild(std::string &element, std::string &name) {
+        element.clear();
+        std::string markup;
+        int depth = 0;
+        while (true) {
+            ReadText(depth > 0 ? &element : nullptr);
+            if (!Available(1)) {
+                if (depth > 0) {
+                    LOG_WARNING << "Scenario ends inside " << name << ", ignoring it.";
+                }
+                m_done = true;
+                return false;
+            }
+
+            bool copied = true;
+            if (StartsWith("<!--")) {
+                copied = ReadUntil("-->", markup);
+            } else if (StartsWith("<![CDATA[")) {
+                copied = ReadUntil("]]>", markup);
+            } else if (StartsWith("<?")) {
+                copied = ReadUntil("?>", markup);
+            } else if (StartsWith("</")) {
+                if (!ReadTag(markup) || depth == 0) {
+                    // End of the root
+                    m_done = true;
+                    return false;
+                }
+                element += markup;
+                if (--depth == 0) {
+                    return true;
+                }
+                continue;
+            } else {
+                copied = ReadTag(markup);
+                if (copied && depth == 0) {
+                    name = LocalName(markup);
+                }
+                if (copied && !IsEmptyElement(markup)) {
+                    ++depth;
+                } else if (copied && depth == 0) {
+                    element = markup;
+                    return true;
+                }
+                if (copied) {
+                    element += markup;
+                }
+                continue;
+            }
+
+            if (!copied) {
+                m_done = true;
+                return false;
+            }
+            if (depth > 0) {
+                element += markup;
+            }
+        }
+    }
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include <biogears/cdm/CommonDataModel.h>
+#include <biogears/cdm/scenario/SEAction.h>
+#include <biogears/cdm/substance/SESubstanceManager.h>
+#include <biogears/schema/cdm/Scenario.hxx>
+
+#include "ActionScheduler.h"
+
+namespace AMM {
+    // Reads a scenario file one top-level <Action> at a time instead of
+    // building the whole scenario up front.  Memory stays bounded by the
+    // scenario header and the largest single action, however many actions
+    // the file holds.
+    class ScenarioReader {
+    public:
+        // Reads up to the first action.
+        bool Open(const std::string &scenarioFile);
+
+        // The scenario without its actions or data requests: name, engine
+        // state file and initial parameters.
+        const std::string &GetHeader() const;
+
+        // The next action, wrapped in the scenario header so it parses as a
+        // scenario document on its own.  False once the actions run out.
+        bool Next(std::string &document);
+
+        size_t GetActionCount() const;
+
+        // Parses without schema validation; the document is only checked
+        // against the structure the bindings expect.
+        static std::unique_ptr<CDM::ScenarioData> Parse(const std::string &document);
+
+        // The action in a document from Next, or nullptr when it does not parse
+        static std::unique_ptr<biogears::SEAction>
+        ParseAction(const std::string &document, biogears::SESubstanceManager &substances);
+
+    private:
+        bool Fill();
+
+        bool Available(size_t count);
+
+        bool StartsWith(const char *text);
+
+        bool ReadText(std::string *text);
+
+        bool ReadUntil(const char *terminator, std::string &markup);
+
+        bool ReadTag(std::string &tag);
+
+        // The next child element of the root, or false at the end of the root
+        bool ReadChild(std::string &element, std::string &name);
+
+        std::ifstream m_in;
+        std::string m_buffer;
+        size_t m_pos = 0;
+        bool m_done = false;
+
+        // Prolog, root start tag and header children, then the root end tag
+        std::string m_prefix;
+        std::string m_suffix;
+        std::string m_header;
+
+        std::string m_pending;
+        bool m_hasPending = false;
+        size_t m_actionCount = 0;
+    };
+
+    // The rest of a live scenario after its first AdvanceTime.  Actions are
+    // read and scheduled only up to a horizon ahead of the engine, so the
+    // scheduler holds a window of the scenario rather than all of it.
+    class LiveScenarioFeed {
+    public:
+        // nextTime is when the action after the reader's position is due
+        LiveScenarioFeed(ScenarioReader &&reader, const std::string &scenarioFile, double nextTime,
+                         double horizon);
+
+        // Schedules the actions due up to simTime + horizon.  False once the
+        // scenario has run out.
+        bool Feed(double simTime, biogears::SESubstanceManager &substances, ActionScheduler &scheduler);
+
+        size_t GetScheduledCount() const;
+
+    private:
+        ScenarioReader m_reader;
+        std::string m_file;
+        double m_nextTime;
+        double m_horizon;
+        size_t m_scheduled = 0;
+    };
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace AMM {
+    // Fixed-capacity lock-free ring for exactly one producer thread and one
+    // consumer thread.  Blocks are pushed all-or-nothing, so a consumer that
+    // pops the same block sizes the producer pushed always sees whole blocks.
+    template<typename T>
+    class SpscRing {
+    public:
+        // Capacity is rounded up to a power of two.
+        explicit SpscRing(size_t capacity = 1024) {
+            size_t size = 1;
+            while (size < capacity) {
+                size <<= 1;
+            }
+            m_buffer.resize(size);
+            m_mask = size - 1;
+        }
+
+        SpscRing(const SpscRing &) = delete;
+
+        SpscRing &operator=(const SpscRing &) = delete;
+
+        size_t Capacity() const {
+            return m_buffer.size();
+        }
+
+        // Approximate when called from neither the producer nor the consumer.
+        size_t Size() const {
+            return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+        }
+
+        bool Empty() const {
+            return Size() == 0;
+        }
+
+        // Producer only.  Returns false, pushing nothing, when the block does not fit.
+        bool TryPush(const T *values, size_t count) {
+            size_t head = m_head.load(std::memory_order_relaxed);
+            size_t tail = m_tail.load(std::memory_order_acquire);
+            if (m_buffer.size() - (head - tail) < count) {
+                return false;
+            }
+            for (size_t i = 0; i < count; ++i) {
+                m_buffer[(head + i) & m_mask] = values[i];
+            }
+            m_head.store(head + count, std::memory_order_release);
+            return true;
+        }
+
+        bool TryPush(const T &value) {
+            return TryPush(&value, 1);
+        }
+
+        // Consumer only.  Returns false, popping nothing, when fewer than count are queued.
+        bool TryPop(T *values, size_t count) {
+            size_t tail = m_tail.load(std::memory_order_relaxed);
+            size_t head = m_head.load(std::memory_order_acquire);
+            if (head - tail < count) {
+                return false;
+            }
+            for (size_t i = 0; i < count; ++i) {
+                values[i] = m_buffer[(tail + i) & m_mask];
+            }
+            m_tail.store(tail + count, std::memory_order_release);
+            return true;
+        }
+
+        bool TryPop(T &value) {
+            return TryPop(&value, 1);
+        }
+
+    private:
+        std::vector<T> m_buffer;
+        size_t m_mask = 0;
+        std::atomic<size_t> m_head{0};
+        // Keeps the producer and consumer indices off the same cache line
+        char m_padding[64];
+        std::atomic<size_t> m_tail{0};
+    };
+}
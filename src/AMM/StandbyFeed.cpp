@@ -0,0 +1,153 @@
+#include "StandbyFeed.h"
+
+#include <algorithm>
+
+#include "amm/BaseLogger.h"
+
+namespace AMM {
+    namespace {
+        // Longest wait before listening again after the listener failed
+        const std::chrono::seconds MaxBackoff(30);
+    }
+
+    StandbyFeed::~StandbyFeed() {
+        Stop();
+    }
+
+    bool StandbyFeed::Start(const std::string &host, uint16_t port, const std::string &token) {
+        Stop();
+        m_host = host;
+        m_port = port;
+        m_token = token;
+        m_running = true;
+        m_thread = std::thread(&StandbyFeed::Run, this);
+        return true;
+    }
+
+    void StandbyFeed::Stop() {
+        m_running = false;
+        m_ready.notify_all();
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+    }
+
+    void StandbyFeed::SendSnapshot(std::shared_ptr<const CDM::PhysiologyEngineStateData> state,
+                                   const PatientMigration::Snapshot &snapshot,
+                                   const std::vector<JournalEntry> &inputs) {
+        if (!m_connected || state == nullptr) {
+            return;
+        }
+        Item item;
+        item.state = std::move(state);
+        item.snapshot = snapshot;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.clear();
+        m_queue.push_back(std::move(item));
+        for (const auto &entry : inputs) {
+            Item input;
+            input.entry = entry;
+            m_queue.push_back(std::move(input));
+        }
+        m_needsSnapshot = false;
+        m_ready.notify_one();
+    }
+
+    void StandbyFeed::Record(const JournalEntry &entry) {
+        if (!m_connected || m_needsSnapshot) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_queue.size() >= MaxQueue) {
+            LOG_WARNING << "Standby is " << m_queue.size() << " inputs behind, resending the engine state";
+            m_queue.clear();
+            m_needsSnapshot = true;
+            return;
+        }
+        Item item;
+        item.entry = entry;
+        m_queue.push_back(std::move(item));
+        m_ready.notify_one();
+    }
+
+    bool StandbyFeed::Backoff(std::chrono::seconds delay) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return !m_ready.wait_for(lock, delay, [this]() { return !m_running; });
+    }
+
+    void StandbyFeed::Run() {
+        std::chrono::seconds delay(1);
+        while (m_running) {
+            PatientMigration link(m_token);
+            uint16_t port = m_port;
+            if (!link.Listen(m_host, port)) {
+                if (!Backoff(delay)) {
+                    break;
+                }
+                delay = std::min(delay * 2, MaxBackoff);
+                continue;
+            }
+            LOG_INFO << "Waiting for a standby manager on " << m_host << ":" << port;
+            bool accepted = false;
+            while (m_running && link.IsListening() && !(accepted = link.Accept(250))) {
+            }
+            if (!m_running) {
+                break;
+            }
+            if (!accepted) {
+                // The listener is gone after a failed accept; open a new one
+                LOG_WARNING << "Unable to accept a standby manager, listening again in " << delay.count() << "s";
+                if (!Backoff(delay)) {
+                    break;
+                }
+                delay = std::min(delay * 2, MaxBackoff);
+                continue;
+            }
+            delay = std::chrono::seconds(1);
+            LOG_INFO << "Standby manager connected";
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_queue.clear();
+                m_needsSnapshot = true;
+                m_connected = true;
+            }
+
+            bool sent = true;
+            while (sent && m_running) {
+                Item item;
+                bool queued = false;
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_ready.wait_for(lock, std::chrono::milliseconds(200),
+                                     [this]() { return !m_queue.empty() || !m_running; });
+                    if (!m_queue.empty()) {
+                        item = std::move(m_queue.front());
+                        m_queue.pop_front();
+                        queued = true;
+                    }
+                }
+                if (!queued) {
+                    sent = link.Send(PatientMigration::Message::LIVE);
+                } else if (item.state != nullptr) {
+                    std::string stateXml;
+                    sent = StateArchive::Serialize(*item.state, stateXml) &&
+                           StateArchive::Compress(stateXml, item.snapshot.payload);
+                    item.snapshot.size = stateXml.size();
+                    sent = sent && link.SendSnapshot(item.snapshot);
+                } else {
+                    sent = link.SendInput(item.entry);
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_connected = false;
+                m_needsSnapshot = false;
+                m_queue.clear();
+            }
+            if (m_running) {
+                LOG_WARNING << "Standby manager disconnected";
+            }
+        }
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "PatientMigration.h"
+#include "StateArchive.h"
+
+namespace AMM {
+    // Keeps a hot standby manager in step with this one.  A standby connects
+    // to the port; it gets the engine's newest rewind checkpoint and the
+    // inputs since, then every input this manager journals (ticks included),
+    // and a fresh snapshot whenever the engine takes a checkpoint.  A
+    // heartbeat goes out when there is nothing else to send, so the standby
+    // can tell a quiet primary from a dead one.  Snapshots carry the
+    // primary's term; a standby that takes over raises it, and a primary
+    // that sees its module announced under a higher term stands down.
+    class StandbyFeed {
+    public:
+        StandbyFeed() = default;
+
+        ~StandbyFeed();
+
+        // Listens on the interface host resolves to, for a standby presenting token
+        bool Start(const std::string &host, uint16_t port, const std::string &token);
+
+        void Stop();
+
+        bool IsConnected() const { return m_connected; }
+
+        // A standby is connected and has nothing to replay inputs onto yet
+        bool NeedsSnapshot() const { return m_needsSnapshot; }
+
+        // Supersedes everything queued; state is serialized on the feed thread.
+        // inputs are the ones taken since the snapshot, sent right after it.
+        void SendSnapshot(std::shared_ptr<const CDM::PhysiologyEngineStateData> state,
+                          const PatientMigration::Snapshot &snapshot, const std::vector<JournalEntry> &inputs);
+
+        void Record(const JournalEntry &entry);
+
+    private:
+        struct Item {
+            std::shared_ptr<const CDM::PhysiologyEngineStateData> state;
+            PatientMigration::Snapshot snapshot;
+            JournalEntry entry;
+        };
+
+        void Run();
+
+        // Sleeps the given delay unless stopped first; false when stopped
+        bool Backoff(std::chrono::seconds delay);
+
+        // A standby this far behind is sent a new snapshot instead
+        static const size_t MaxQueue = 50000;
+
+        std::string m_host;
+        uint16_t m_port = 0;
+        std::string m_token;
+        std::thread m_thread;
+        std::atomic<bool> m_running{false};
+        std::atomic<bool> m_connected{false};
+        std::atomic<bool> m_needsSnapshot{false};
+        std::mutex m_mutex;
+        std::condition_variable m_ready;
+        std::deque<Item> m_queue;
+    };
+}
@@ -0,0 +1,257 @@
+#include "StateArchive.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+#include <boost/crc.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+
+#include "BinaryIO.h"
+#include "amm/BaseLogger.h"
+
+namespace AMM {
+    namespace {
+        const char ArchiveMagic[8] = {'A', 'M', 'M', 'S', 'T', 'A', 'T', 'E'};
+        const uint32_t ZlibPayload = 1;
+
+        struct ArchiveHeader {
+            uint32_t version = 0;
+            uint32_t flags = 0;
+            uint64_t sourceSize = 0;
+            int64_t sourceTime = 0;
+            uint64_t stateSize = 0;
+            uint64_t payloadSize = 0;
+            uint32_t checksum = 0;
+        };
+
+        bool ReadHeader(std::istream &in, ArchiveHeader &header) {
+            char magic[sizeof(ArchiveMagic)];
+            if (!in.read(magic, sizeof(magic)) || memcmp(magic, ArchiveMagic, sizeof(magic)) != 0) {
+                return false;
+            }
+            return ReadValue(in, header.version) && ReadValue(in, header.flags) &&
+                   ReadValue(in, header.sourceSize) && ReadValue(in, header.sourceTime) &&
+                   ReadValue(in, header.stateSize) && ReadValue(in, header.payloadSize) &&
+                   ReadValue(in, header.checksum);
+        }
+
+        uint32_t Checksum(const std::string &data) {
+            boost::crc_32_type crc;
+            crc.process_bytes(data.data(), data.size());
+            return crc.checksum();
+        }
+    }
+
+    const uint32_t StateArchive::FormatVersion;
+
+    std::string StateArchive::ArchivePath(const std::string &stateFile) {
+        boost::filesystem::path path(stateFile);
+        return path.replace_extension(".state").string();
+    }
+
+    bool StateArchive::IsCurrent(const std::string &archiveFile, const std::string &stateFile) {
+        std::ifstream in(archiveFile, std::ios::binary);
+        ArchiveHeader header;
+        if (!in.good() || !ReadHeader(in, header)) {
+            return false;
+        }
+
+        if (header.version != FormatVersion) {
+            LOG_DEBUG << "State archive " << archiveFile << " has format version " << header.version
+                      << ", expected " << FormatVersion;
+            return false;
+        }
+
+        boost::system::error_code ec;
+        if (!stateFile.empty() && boost::filesystem::exists(stateFile, ec)) {
+            if (header.sourceSize != boost::filesystem::file_size(stateFile, ec) ||
+                header.sourceTime != static_cast<int64_t>(boost::filesystem::last_write_time(stateFile, ec))) {
+                LOG_DEBUG << "State archive " << archiveFile << " is older than " << stateFile;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool StateArchive::Write(const std::string &archiveFile, const std::string &stateXml,
+                             const std::string &stateFile) {
+        ArchiveHeader header;
+        header.version = FormatVersion;
+        header.flags = ZlibPayload;
+        header.stateSize = stateXml.size();
+        header.checksum = Checksum(stateXml);
+
+        boost::system::error_code ec;
+        if (!stateFile.empty() && boost::filesystem::exists(stateFile, ec)) {
+            header.sourceSize = boost::filesystem::file_size(stateFile, ec);
+            header.sourceTime = static_cast<int64_t>(boost::filesystem::last_write_time(stateFile, ec));
+        }
+
+        std::string payload;
+        if (!Compress(stateXml, payload)) {
+            return false;
+        }
+        header.payloadSize = payload.size();
+
+        // Write to a temporary name first so a reader never sees a partial archive
+        std::string tmpFile = archiveFile + ".tmp";
+        std::ofstream out(tmpFile, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            LOG_ERROR << "Unable to open state archive " << tmpFile;
+            return false;
+        }
+        out.write(ArchiveMagic, sizeof(ArchiveMagic));
+        WriteValue(out, header.version);
+        WriteValue(out, header.flags);
+        WriteValue(out, header.sourceSize);
+        WriteValue(out, header.sourceTime);
+        WriteValue(out, header.stateSize);
+        WriteValue(out, header.payloadSize);
+        WriteValue(out, header.checksum);
+        out.write(payload.data(), payload.size());
+        out.close();
+        if (!out) {
+            LOG_ERROR << "Unable to write state archive " << tmpFile;
+            return false;
+        }
+
+        boost::filesystem::rename(tmpFile, archiveFile, ec);
+        if (ec) {
+            LOG_ERROR << "Unable to move state archive into place: " << ec.message();
+            return false;
+        }
+        return true;
+    }
+
+    bool StateArchive::WriteFromStateFile(const std::string &stateFile) {
+        std::ifstream in(stateFile, std::ios::binary);
+        if (!in.good()) {
+            LOG_ERROR << "Unable to read state file " << stateFile;
+            return false;
+        }
+        std::string stateXml((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        in.close();
+        return Write(ArchivePath(stateFile), stateXml, stateFile);
+    }
+
+    bool StateArchive::Read(const std::string &archiveFile, std::string &stateXml) {
+        std::ifstream in(archiveFile, std::ios::binary);
+        ArchiveHeader header;
+        if (!in.good() || !ReadHeader(in, header) || header.version != FormatVersion) {
+            LOG_ERROR << "Not a readable state archive: " << archiveFile;
+            return false;
+        }
+
+        // A corrupt header must not size the buffer past what the file holds
+        std::streampos start = in.tellg();
+        in.seekg(0, std::ios::end);
+        std::streamoff remaining = in.tellg() - start;
+        in.seekg(start);
+        if (start < 0 || remaining < 0 || header.payloadSize > static_cast<uint64_t>(remaining)) {
+            LOG_ERROR << "State archive is truncated: " << archiveFile;
+            return false;
+        }
+
+        std::string payload;
+        try {
+            payload.resize(header.payloadSize);
+        } catch (std::exception &e) {
+            LOG_ERROR << "Unable to read state archive " << archiveFile << ": " << e.what();
+            return false;
+        }
+        if (!in.read(&payload[0], payload.size())) {
+            LOG_ERROR << "State archive is truncated: " << archiveFile;
+            return false;
+        }
+
+        if (header.flags & ZlibPayload) {
+            if (!Decompress(payload, header.stateSize, stateXml)) {
+                LOG_ERROR << "Unable to decompress state archive " << archiveFile;
+                return false;
+            }
+        } else {
+            stateXml.swap(payload);
+        }
+
+        if (stateXml.size() != header.stateSize || Checksum(stateXml) != header.checksum) {
+            LOG_ERROR << "State archive failed its checksum: " << archiveFile;
+            return false;
+        }
+        return true;
+    }
+
+    std::unique_ptr<CDM::PhysiologyEngineStateData> StateArchive::Load(const std::string &archiveFile) {
+        std::string stateXml;
+        if (!Read(archiveFile, stateXml)) {
+            return nullptr;
+        }
+        return Parse(stateXml);
+    }
+
+    bool StateArchive::Compress(const std::string &data, std::string &payload) {
+        payload.clear();
+        try {
+            boost::iostreams::filtering_ostream deflate;
+            deflate.push(boost::iostreams::zlib_compressor(boost::iostreams::zlib::best_speed));
+            deflate.push(boost::iostreams::back_inserter(payload));
+            deflate.write(data.data(), data.size());
+            deflate.reset();
+        } catch (std::exception &e) {
+            LOG_ERROR << "Unable to compress engine state: " << e.what();
+            return false;
+        }
+        return true;
+    }
+
+    bool StateArchive::Decompress(const std::string &payload, size_t size, std::string &data) {
+        data.clear();
+        try {
+            // Deflate expands by at most about 1000:1, whatever size claims
+            data.reserve(std::min<size_t>(size, payload.size() * 1032));
+            boost::iostreams::filtering_istream inflate;
+            inflate.push(boost::iostreams::zlib_decompressor());
+            inflate.push(boost::iostreams::array_source(payload.data(), payload.size()));
+            boost::iostreams::copy(inflate, boost::iostreams::back_inserter(data));
+        } catch (std::exception &e) {
+            LOG_ERROR << "Unable to decompress engine state: " << e.what();
+            return false;
+        }
+        return true;
+    }
+
+    bool StateArchive::Serialize(const CDM::PhysiologyEngineStateData &state, std::string &stateXml) {
+        // Same namespace map BioGears uses when it writes a state file
+        xml_schema::namespace_infomap map;
+        map[""].name = "uri:/mil/tatrc/physiology/datamodel";
+
+        std::ostringstream out;
+        try {
+            CDM::PhysiologyEngineState(out, state, map);
+        } catch (std::exception &e) {
+            LOG_ERROR << "Unable to serialize engine state: " << e.what();
+            return false;
+        }
+        stateXml = out.str();
+        return true;
+    }
+
+    std::unique_ptr<CDM::PhysiologyEngineStateData> StateArchive::Parse(const std::string &stateXml) {
+        // The archive was checksummed and was schema-valid when it was written,
+        // so skip validation here.
+        std::istringstream in(stateXml);
+        try {
+            return CDM::PhysiologyEngineState(in, xml_schema::flags::dont_validate);
+        } catch (std::exception &e) {
+            LOG_ERROR << "Unable to parse engine state: " << e.what();
+        }
+        return nullptr;
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <biogears/cdm/CommonDataModel.h>
+#include <biogears/schema/cdm/EngineState.hxx>
+
+namespace AMM {
+    // Compact binary container for BioGears engine state, kept next to the XML
+    // state file.  The container holds the state XML deflated, with a format
+    // version, the size/mtime of the XML it was made from and a CRC-32, and is
+    // parsed without schema validation, which is where most of the XML load
+    // time goes.
+    class StateArchive {
+    public:
+        static const uint32_t FormatVersion = 1;
+
+        // ./states/StandardMale@0s.xml -> ./states/StandardMale@0s.state
+        static std::string ArchivePath(const std::string &stateFile);
+
+        // True when the archive exists, has the current format version and was
+        // made from the state file as it is on disk now.
+        static bool IsCurrent(const std::string &archiveFile, const std::string &stateFile);
+
+        static bool Write(const std::string &archiveFile, const std::string &stateXml,
+                          const std::string &stateFile = "");
+
+        static bool WriteFromStateFile(const std::string &stateFile);
+
+        static bool Read(const std::string &archiveFile, std::string &stateXml);
+
+        static std::unique_ptr<CDM::PhysiologyEngineStateData> Load(const std::string &archiveFile);
+
+        // zlib (best speed) helpers shared with the in-memory checkpoints
+        static bool Compress(const std::string &data, std::string &payload);
+
+        static bool Decompress(const std::string &payload, size_t size, std::string &data);
+
+        static bool Serialize(const CDM::PhysiologyEngineStateData &state, std::string &stateXml);
+
+        static std::unique_ptr<CDM::PhysiologyEngineStateData> Parse(const std::string &stateXml);
+    };
+}
@@ -0,0 +1,120 @@
+#include "StateWriter.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+
+#include "StateArchive.h"
+
+#include "amm/BaseLogger.h"
+
+namespace AMM {
+    StateWriter::~StateWriter() {
+        Stop();
+    }
+
+    void StateWriter::Stop() {
+        m_mutex.lock();
+        m_stopping = true;
+        m_mutex.unlock();
+        m_jobAvailable.notify_all();
+
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+    }
+
+    void StateWriter::Submit(const std::string &stateFile, std::unique_ptr<CDM::PhysiologyEngineStateData> state,
+                             bool writeArchive, Completion done) {
+        Job job;
+        job.stateFile = stateFile;
+        job.state = std::move(state);
+        job.writeArchive = writeArchive;
+        job.done = std::move(done);
+
+        m_mutex.lock();
+        if (m_stopping) {
+            m_mutex.unlock();
+            LOG_WARNING << "State writer stopped, not saving " << stateFile;
+            if (job.done) {
+                job.done(stateFile, false);
+            }
+            return;
+        }
+        if (!m_thread.joinable()) {
+            m_thread = std::thread(&StateWriter::Run, this);
+        }
+        m_jobs.push_back(std::move(job));
+        m_mutex.unlock();
+        m_jobAvailable.notify_one();
+    }
+
+    size_t StateWriter::GetPendingCount() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_jobs.size();
+    }
+
+    void StateWriter::Run() {
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_jobAvailable.wait(lock, [this] { return m_stopping || !m_jobs.empty(); });
+                if (m_jobs.empty()) {
+                    return;
+                }
+                job = std::move(m_jobs.front());
+                m_jobs.pop_front();
+            }
+
+            auto begin = std::chrono::high_resolution_clock::now();
+            bool saved = Write(job);
+            auto end = std::chrono::high_resolution_clock::now();
+            auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin);
+            if (saved) {
+                LOG_INFO << "Saved state to " << job.stateFile << " in " << elapsed.count() * 1e-9 << "s.";
+            }
+
+            if (job.done) {
+                try {
+                    job.done(job.stateFile, saved);
+                } catch (std::exception &e) {
+                    LOG_ERROR << "Error reporting saved state: " << e.what();
+                }
+            }
+        }
+    }
+
+    bool StateWriter::Write(const Job &job) {
+        if (job.state == nullptr) {
+            LOG_ERROR << "No engine state captured for " << job.stateFile;
+            return false;
+        }
+
+        std::string stateXml;
+        if (!StateArchive::Serialize(*job.state, stateXml)) {
+            return false;
+        }
+
+        // Write to a temporary name first so a loader never sees a partial state file
+        std::string tmpFile = job.stateFile + ".tmp";
+        std::ofstream out(tmpFile, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            LOG_ERROR << "Unable to open state file " << tmpFile;
+            return false;
+        }
+        out.write(stateXml.data(), stateXml.size());
+        out.close();
+        if (!out || std::rename(tmpFile.c_str(), job.stateFile.c_str()) != 0) {
+            LOG_ERROR << "Unable to write state file " << job.stateFile;
+            std::remove(tmpFile.c_str());
+            return false;
+        }
+
+        if (job.writeArchive &&
+            !StateArchive::Write(StateArchive::ArchivePath(job.stateFile), stateXml, job.stateFile)) {
+            LOG_WARNING << "Unable to write binary state archive for " << job.stateFile;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <biogears/cdm/CommonDataModel.h>
+#include <biogears/schema/cdm/EngineState.hxx>
+
+namespace AMM {
+    // Background writer for engine state snapshots.  The engine thread only
+    // captures the in-memory state; serialization and file I/O happen here.
+    // The writer thread starts with the first save, so an idle engine can
+    // still be forked.
+    class StateWriter {
+    public:
+        typedef std::function<void(const std::string &stateFile, bool saved)> Completion;
+
+        StateWriter() = default;
+
+        // Finishes any queued saves before returning.
+        ~StateWriter();
+
+        // Finishes queued saves and joins the writer; later submissions are dropped.
+        void Stop();
+
+        void Submit(const std::string &stateFile, std::unique_ptr<CDM::PhysiologyEngineStateData> state,
+                    bool writeArchive, Completion done = nullptr);
+
+        size_t GetPendingCount();
+
+    private:
+        struct Job {
+            std::string stateFile;
+            std::unique_ptr<CDM::PhysiologyEngineStateData> state;
+            bool writeArchive = false;
+            Completion done;
+        };
+
+        void Run();
+
+        bool Write(const Job &job);
+
+        std::thread m_thread;
+        std::deque<Job> m_jobs;
+        std::mutex m_mutex;
+        std::condition_variable m_jobAvailable;
+        bool m_stopping = false;
+    };
+}
@@ -0,0 +1,155 @@
+#include "TrendEngine.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+namespace AMM {
+    void TrendEngine::Configure(const std::vector<std::string> &names, const std::vector<int> &indices,
+                                const std::vector<double> &windows, double tickSeconds) {
+        m_names = names;
+        m_indices = indices;
+        m_tickSeconds = tickSeconds > 0.0 ? tickSeconds : 0.02;
+        m_windows.clear();
+
+        size_t longest = 0;
+        for (double seconds : windows) {
+            if (seconds <= 0.0) {
+                continue;
+            }
+            Window window;
+            window.length = std::max<size_t>(1, static_cast<size_t>(std::round(seconds / m_tickSeconds)));
+            std::ostringstream suffix;
+            suffix << "_" << seconds << "s";
+            window.suffix = suffix.str();
+            m_windows.push_back(window);
+            longest = std::max(longest, window.length);
+        }
+
+        m_capacity = longest + 1;
+        Clear();
+    }
+
+    void TrendEngine::Clear() {
+        size_t nodes = m_indices.size();
+        m_samples = 0;
+        m_history.assign(IsEnabled() ? m_capacity * nodes : 0, 0.0);
+        for (auto &window : m_windows) {
+            window.count = 0;
+            window.sinceRefresh = 0;
+            window.sum.assign(nodes, 0.0);
+            window.weighted.assign(nodes, 0.0);
+            window.minimum.assign(nodes, std::deque<uint64_t>());
+            window.maximum.assign(nodes, std::deque<uint64_t>());
+        }
+    }
+
+    bool TrendEngine::IsEnabled() const {
+        return !m_indices.empty() && !m_windows.empty();
+    }
+
+    double TrendEngine::Value(uint64_t sample, size_t node) const {
+        return m_history[(sample % m_capacity) * m_indices.size() + node];
+    }
+
+    void TrendEngine::Sample(const std::vector<double> &snapshot) {
+        if (!IsEnabled()) {
+            return;
+        }
+
+        const size_t nodes = m_indices.size();
+        const uint64_t sample = m_samples++;
+        double *row = &m_history[(sample % m_capacity) * nodes];
+        for (size_t n = 0; n < nodes; ++n) {
+            row[n] = snapshot[m_indices[n]];
+        }
+
+        for (auto &window : m_windows) {
+            double *sum = window.sum.data();
+            double *weighted = window.weighted.data();
+
+            if (window.count == window.length) {
+                // Drop the oldest; everything left moves down one position
+                const double *oldest = &m_history[((sample - window.length) % m_capacity) * nodes];
+                for (size_t n = 0; n < nodes; ++n) {
+                    weighted[n] -= sum[n] - oldest[n];
+                    sum[n] -= oldest[n];
+                }
+                --window.count;
+            }
+
+            const double position = static_cast<double>(window.count);
+            for (size_t n = 0; n < nodes; ++n) {
+                weighted[n] += position * row[n];
+                sum[n] += row[n];
+            }
+            ++window.count;
+
+            const uint64_t first = sample + 1 - window.count;
+            for (size_t n = 0; n < nodes; ++n) {
+                auto &minimum = window.minimum[n];
+                while (!minimum.empty() && minimum.front() < first) {
+                    minimum.pop_front();
+                }
+                while (!minimum.empty() && Value(minimum.back(), n) >= row[n]) {
+                    minimum.pop_back();
+                }
+                minimum.push_back(sample);
+
+                auto &maximum = window.maximum[n];
+                while (!maximum.empty() && maximum.front() < first) {
+                    maximum.pop_front();
+                }
+                while (!maximum.empty() && Value(maximum.back(), n) <= row[n]) {
+                    maximum.pop_back();
+                }
+                maximum.push_back(sample);
+            }
+
+            if (++window.sinceRefresh >= window.length) {
+                Refresh(window);
+            }
+        }
+    }
+
+    void TrendEngine::Refresh(Window &window) {
+        const size_t nodes = m_indices.size();
+        std::fill(window.sum.begin(), window.sum.end(), 0.0);
+        std::fill(window.weighted.begin(), window.weighted.end(), 0.0);
+        const uint64_t first = m_samples - window.count;
+        for (size_t j = 0; j < window.count; ++j) {
+            const double *row = &m_history[((first + j) % m_capacity) * nodes];
+            for (size_t n = 0; n < nodes; ++n) {
+                window.sum[n] += row[n];
+                window.weighted[n] += j * row[n];
+            }
+        }
+        window.sinceRefresh = 0;
+    }
+
+    void TrendEngine::GetTrends(std::vector<std::pair<std::string, double>> &values) const {
+        values.clear();
+        for (const auto &window : m_windows) {
+            if (window.count == 0) {
+                continue;
+            }
+
+            // Least squares over positions 0..count-1
+            const double count = static_cast<double>(window.count);
+            const double positions = count * (count - 1) / 2;
+            const double squares = (count - 1) * count * (2 * count - 1) / 6;
+            const double denominator = count * squares - positions * positions;
+
+            for (size_t n = 0; n < m_names.size(); ++n) {
+                double slope = 0.0;
+                if (denominator > 0.0) {
+                    slope = (count * window.weighted[n] - positions * window.sum[n]) / denominator / m_tickSeconds;
+                }
+                values.emplace_back(m_names[n] + "_Mean" + window.suffix, window.sum[n] / count);
+                values.emplace_back(m_names[n] + "_Min" + window.suffix, Value(window.minimum[n].front(), n));
+                values.emplace_back(m_names[n] + "_Max" + window.suffix, Value(window.maximum[n].front(), n));
+                values.emplace_back(m_names[n] + "_Slope" + window.suffix, slope);
+            }
+        }
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace AMM {
+    // Rolling mean, min, max and slope of selected snapshot nodes over a few
+    // fixed windows.  Every tick costs O(1) amortized per node and window:
+    // the sums slide with the window, min and max come from monotonic
+    // queues, and the sums are recomputed once per window length so
+    // rounding does not accumulate.
+    class TrendEngine {
+    public:
+        // indices are positions in the snapshot passed to Sample, windows are
+        // in seconds and tickSeconds is the time between samples.
+        void Configure(const std::vector<std::string> &names, const std::vector<int> &indices,
+                       const std::vector<double> &windows, double tickSeconds);
+
+        // Forget the samples, after the simulation time jumps.
+        void Clear();
+
+        bool IsEnabled() const;
+
+        void Sample(const std::vector<double> &snapshot);
+
+        // <node>_Mean_<window>s, _Min_, _Max_ and _Slope_ (per second) for
+        // every window holding at least one sample.
+        void GetTrends(std::vector<std::pair<std::string, double>> &values) const;
+
+    private:
+        struct Window {
+            size_t length = 0;
+            std::string suffix;
+            size_t count = 0;
+            size_t sinceRefresh = 0;
+            // Per node; weighted is the sum of each value times its position in the window
+            std::vector<double> sum;
+            std::vector<double> weighted;
+            std::vector<std::deque<uint64_t>> minimum;
+            std::vector<std::deque<uint64_t>> maximum;
+        };
+
+        double Value(uint64_t sample, size_t node) const;
+
+        void Refresh(Window &window);
+
+        std::vector<std::string> m_names;
+        std::vector<int> m_indices;
+        std::vector<Window> m_windows;
+        double m_tickSeconds = 0.02;
+
+        // One row of node values per sample, the longest window plus one
+        std::vector<double> m_history;
+        size_t m_capacity = 0;
+        uint64_t m_samples = 0;
+    };
+}
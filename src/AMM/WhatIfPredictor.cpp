@@ -0,0 +1,161 @@
+#include "WhatIfPredictor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <sstream>
+
+#include "amm/BaseLogger.h"
+
+namespace AMM {
+    namespace {
+        // Branches running at once each log to their own file, reused once the branch is done
+        class LogSlot {
+        public:
+            LogSlot() {
+                std::lock_guard<std::mutex> lock(s_mutex);
+                while (s_used.count(m_slot) > 0) {
+                    ++m_slot;
+                }
+                s_used.insert(m_slot);
+            }
+
+            ~LogSlot() {
+                std::lock_guard<std::mutex> lock(s_mutex);
+                s_used.erase(m_slot);
+            }
+
+            std::string GetLogFile() const {
+                return "logs/whatif_" + std::to_string(m_slot) + ".log";
+            }
+
+        private:
+            static std::mutex s_mutex;
+            static std::set<int> s_used;
+            int m_slot = 0;
+        };
+
+        std::mutex LogSlot::s_mutex;
+        std::set<int> LogSlot::s_used;
+    }
+
+    WhatIfPredictor::WhatIfPredictor(unsigned int workers, size_t maxPending)
+            : m_maxPending(maxPending), m_pool(workers) {
+    }
+
+    WhatIfPredictor::~WhatIfPredictor() {
+        // Queued predictions return at once and running ones stop at their next sample
+        m_stopping = true;
+    }
+
+    bool WhatIfPredictor::Submit(std::shared_ptr<const CDM::PhysiologyEngineStateData> state, double simTime,
+                                 Request request, Completion done) {
+        if (state == nullptr) {
+            return false;
+        }
+        if (++m_pending > m_maxPending) {
+            --m_pending;
+            return false;
+        }
+        m_pool.Submit([this, state, simTime, request, done] {
+            if (!m_stopping) {
+                Predict(*state, simTime, request, done);
+            }
+            --m_pending;
+        });
+        return true;
+    }
+
+    size_t WhatIfPredictor::GetPendingCount() const {
+        return m_pending;
+    }
+
+    void WhatIfPredictor::Predict(const CDM::PhysiologyEngineStateData &state, double simTime,
+                                  const Request &request, const Completion &done) {
+        Prediction prediction;
+        Predict(state, simTime, request, prediction, [this] { return !m_stopping; });
+        LOG_INFO << "What-if " << request.id << " predicted " << request.seconds << "s from " << prediction.startTime << "s in "
+                 << prediction.elapsed << "s" << (prediction.completed ? "" : " (incomplete)");
+        if (!m_stopping && done) {
+            done(prediction);
+        }
+    }
+
+    void WhatIfPredictor::Predict(const CDM::PhysiologyEngineStateData &state, double simTime,
+                                  const Request &request, Prediction &prediction,
+                                  const std::function<bool()> &proceed) {
+        auto begin = std::chrono::steady_clock::now();
+        prediction.id = request.id;
+        prediction.startTime = std::max(simTime, request.startTime);
+        prediction.interval = request.interval;
+        prediction.nodes = request.nodes;
+
+        LogSlot slot;
+        BiogearsThread branch(slot.GetLogFile());
+        if (branch.LoadState(state, simTime)) {
+            // Steps of at most a second of simulation, so proceed is asked often
+            double engineTime = simTime;
+            bool ok = true;
+            auto catchUp = [&](double until) {
+                while (ok && engineTime < until - 1e-6) {
+                    double step = std::min(1.0, until - engineTime);
+                    ok = proceed() && branch.AdvanceModelTime(step);
+                    engineTime += step;
+                }
+            };
+            for (const auto &input : request.inputs) {
+                catchUp(input.engineTime);
+                if (ok && request.replay) {
+                    request.replay(branch, input);
+                }
+            }
+            catchUp(prediction.startTime);
+
+            if (ok && request.apply) {
+                request.apply(branch);
+            }
+
+            auto sample = [&] {
+                for (const auto &node : request.nodes) {
+                    prediction.values.push_back(branch.GetNodePath(node));
+                }
+            };
+
+            double advanced = 0.0;
+            if (ok) {
+                sample();
+            }
+            while (ok && advanced < request.seconds) {
+                double target = std::min(advanced + request.interval, request.seconds);
+                while (ok && advanced < target) {
+                    double step = std::min(1.0, target - advanced);
+                    ok = proceed() && branch.AdvanceModelTime(step);
+                    advanced += step;
+                }
+                if (ok) {
+                    sample();
+                }
+            }
+            prediction.completed = ok;
+        }
+
+        prediction.elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    }
+
+    std::string WhatIfPredictor::Prediction::ToXml() const {
+        std::ostringstream out;
+        out << "<Prediction id='" << id << "' start='" << startTime << "' interval='" << interval
+            << "' completed='" << (completed ? "true" : "false") << "'>";
+        size_t columns = nodes.size();
+        for (size_t c = 0; c < columns; ++c) {
+            out << "<Node name='" << nodes[c] << "'>";
+            for (size_t r = 0; r * columns + c < values.size(); ++r) {
+                out << (r > 0 ? "," : "") << values[r * columns + c];
+            }
+            out << "</Node>";
+        }
+        out << "</Prediction>";
+        return out.str();
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "BiogearsThread.h"
+#include "InputJournal.h"
+#include "WorkerPool.h"
+
+namespace AMM {
+    // Forecasts a proposed intervention on a copy of the live engine.  Each
+    // prediction loads a rewind checkpoint into its own engine on a worker
+    // thread, reapplies the inputs the live engine took since, then applies
+    // the intervention and fast-forwards, sampling the requested nodes; the
+    // live engine is never touched.
+    class WhatIfPredictor {
+    public:
+        struct Request {
+            std::string id;
+            double seconds = 600.0;
+            double interval = 10.0;
+            std::vector<std::string> nodes;
+            // Applies the intervention to the branch engine; empty for a baseline
+            std::function<void(BiogearsThread &)> apply;
+            // Engine time to predict from; the branch catches up from the
+            // checkpoint, applying each input at the engine time it was taken
+            double startTime = 0.0;
+            std::vector<JournalEntry> inputs;
+            std::function<void(BiogearsThread &, const JournalEntry &)> replay;
+        };
+
+        struct Prediction {
+            std::string id;
+            bool completed = false;
+            double startTime = 0.0;
+            double interval = 0.0;
+            std::vector<std::string> nodes;
+            // One row per sample, starting at startTime, one value per node
+            std::vector<double> values;
+            double elapsed = 0.0;
+
+            // <Prediction id start interval completed><Node name>v,v,...</Node>...</Prediction>
+            std::string ToXml() const;
+        };
+
+        // Called on the worker thread
+        using Completion = std::function<void(const Prediction &)>;
+
+        explicit WhatIfPredictor(unsigned int workers = 1, size_t maxPending = 4);
+
+        ~WhatIfPredictor();
+
+        // False, doing nothing, when maxPending predictions are already queued or running
+        bool Submit(std::shared_ptr<const CDM::PhysiologyEngineStateData> state, double simTime, Request request,
+                    Completion done);
+
+        size_t GetPendingCount() const;
+
+        // Runs one prediction on the calling thread.  proceed is asked before
+        // every engine step and may block to throttle; returning false
+        // abandons the prediction, leaving it incomplete.
+        static void Predict(const CDM::PhysiologyEngineStateData &state, double simTime, const Request &request,
+                            Prediction &prediction, const std::function<bool()> &proceed);
+
+    private:
+        void Predict(const CDM::PhysiologyEngineStateData &state, double simTime, const Request &request,
+                     const Completion &done);
+
+        size_t m_maxPending;
+        std::atomic<size_t> m_pending{0};
+        std::atomic<bool> m_stopping{false};
+        // Last, so the workers are joined before anything they use goes away
+        WorkerPool m_pool;
+    };
+}
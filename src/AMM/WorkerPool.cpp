@@ -0,0 +1,76 @@
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+#include "amm/BaseLogger.h"
+
+namespace AMM {
+    WorkerPool::WorkerPool(unsigned int workers) {
+        if (workers == 0) {
+            workers = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        for (unsigned int i = 0; i < workers; ++i) {
+            m_workers.emplace_back(&WorkerPool::Run, this);
+        }
+    }
+
+    WorkerPool::~WorkerPool() {
+        m_mutex.lock();
+        m_stopping = true;
+        m_mutex.unlock();
+        m_jobAvailable.notify_all();
+
+        for (auto &worker : m_workers) {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+    }
+
+    void WorkerPool::Submit(std::function<void()> job) {
+        m_mutex.lock();
+        m_jobs.push_back(std::move(job));
+        m_mutex.unlock();
+        m_jobAvailable.notify_one();
+    }
+
+    void WorkerPool::Wait() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_idle.wait(lock, [this] { return m_jobs.empty() && m_active == 0; });
+    }
+
+    unsigned int WorkerPool::GetWorkerCount() const {
+        return static_cast<unsigned int>(m_workers.size());
+    }
+
+    void WorkerPool::Run() {
+        while (true) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_jobAvailable.wait(lock, [this] { return m_stopping || !m_jobs.empty(); });
+                if (m_jobs.empty()) {
+                    return;
+                }
+                job = std::move(m_jobs.front());
+                m_jobs.pop_front();
+                ++m_active;
+            }
+
+            try {
+                job();
+            } catch (std::exception &e) {
+                LOG_ERROR << "Worker job failed: " << e.what();
+            }
+
+            m_mutex.lock();
+            --m_active;
+            bool idle = m_jobs.empty() && m_active == 0;
+            m_mutex.unlock();
+            if (idle) {
+                m_idle.notify_all();
+            }
+        }
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace AMM {
+    // Fixed-size pool of worker threads draining a FIFO of jobs.  Each job is
+    // expected to own whatever engine it needs; the pool only schedules.
+    class WorkerPool {
+    public:
+        explicit WorkerPool(unsigned int workers = 0);
+
+        ~WorkerPool();
+
+        void Submit(std::function<void()> job);
+
+        // Block until the queue is empty and every worker is idle.
+        void Wait();
+
+        unsigned int GetWorkerCount() const;
+
+    private:
+        void Run();
+
+        std::vector<std::thread> m_workers;
+        std::deque<std::function<void()>> m_jobs;
+
+        std::mutex m_mutex;
+        std::condition_variable m_jobAvailable;
+        std::condition_variable m_idle;
+
+        unsigned int m_active = 0;
+        bool m_stopping = false;
+    };
+}
@@ -0,0 +1,266 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+
+#include "AMM/BiogearsThread.h"
+
+#include "amm/BaseLogger.h"
+
+namespace fs = boost::filesystem;
+
+static volatile sig_atomic_t stopping = 0;
+
+static void handle_signal(int) {
+   stopping = 1;
+}
+
+static void show_usage(const std::string &name) {
+   std::cerr << "Usage: " << name << " <option(s)>"
+             << "\nOptions:\n"
+             << "\t-s <state file>\t\tBase state every job starts from (default ./states/StandardMale@0s.xml)\n"
+             << "\t-l <socket>\t\tUnix socket to listen on (default /tmp/amm_fork_server.sock)\n"
+             << "\t-j <n>\t\tMaximum concurrent jobs (default: one per core)\n"
+             << "\t-h,--help\t\tShow this help message\n"
+             << "\nOne job per connection, one command per line, each answered with one line:\n"
+             << "\tSCENARIO <file>\t\tRun the scenario's actions; its initial state is ignored\n"
+             << "\tXML <scenario>\t\tRun the actions of a scenario document given on the line\n"
+             << "\tADVANCE <seconds>\tAdvance the engine\n"
+             << "\tSAMPLE <nodes>\t\tComma separated node paths at the current time\n"
+             << "\tEND\t\t\tFinish the job\n"
+             << std::endl;
+}
+
+static bool send_line(int fd, const std::string &line) {
+   std::string data = line + "\n";
+   size_t sent = 0;
+   while (sent < data.size()) {
+      ssize_t n = write(fd, data.data() + sent, data.size() - sent);
+      if (n < 0 && errno == EINTR) {
+         continue;
+      }
+      if (n <= 0) {
+         return false;
+      }
+      sent += static_cast<size_t>(n);
+   }
+   return true;
+}
+
+// Runs in the forked child against its copy-on-write image of the engine.
+static int run_job(int fd, AMM::BiogearsThread &engine, uint64_t job) {
+   auto begin = std::chrono::high_resolution_clock::now();
+   FILE *in = fdopen(dup(fd), "r");
+   if (in == nullptr) {
+      return 1;
+   }
+
+   std::ostringstream prefix;
+   prefix << "Job " << job << ": ";
+   char *buffer = nullptr;
+   size_t capacity = 0;
+   ssize_t length;
+   bool ok = true;
+   while (ok && (length = getline(&buffer, &capacity, in)) > 0) {
+      std::string line(buffer, static_cast<size_t>(length));
+      boost::trim(line);
+      size_t space = line.find(' ');
+      std::string command = line.substr(0, space);
+      std::string argument = space == std::string::npos ? "" : boost::trim_copy(line.substr(space + 1));
+      if (command.empty()) {
+         continue;
+      }
+      if (command == "END") {
+         break;
+      }
+
+      std::ostringstream reply;
+      reply << std::setprecision(10);
+      if (command == "SCENARIO" || command == "XML") {
+         bool loaded = command == "SCENARIO" ? engine.LoadScenarioFile(argument) : engine.ExecuteXMLCommand(argument);
+         if (loaded) {
+            reply << "OK " << command << " " << engine.GetEngineTime();
+         } else {
+            reply << "ERROR " << command << " unable to run " << (command == "SCENARIO" ? argument : "actions");
+         }
+      } else if (command == "ADVANCE") {
+         double seconds = atof(argument.c_str());
+         if (seconds > 0.0 && engine.AdvanceTime(seconds)) {
+            reply << "OK ADVANCE " << engine.GetEngineTime();
+         } else {
+            reply << "ERROR ADVANCE " << argument;
+         }
+      } else if (command == "SAMPLE") {
+         std::vector<std::string> nodes;
+         boost::split(nodes, argument, boost::is_any_of(", "), boost::token_compress_on);
+         reply << "SAMPLE " << engine.GetEngineTime();
+         for (const auto &node : nodes) {
+            if (!node.empty()) {
+               reply << " " << node << "=" << engine.GetNodePath(node);
+            }
+         }
+      } else {
+         reply << "ERROR unknown command " << command;
+      }
+      LOG_DEBUG << prefix.str() << reply.str();
+      ok = send_line(fd, reply.str());
+   }
+   free(buffer);
+   fclose(in);
+
+   auto end = std::chrono::high_resolution_clock::now();
+   double wallTime = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count() * 1e-9;
+   std::ostringstream done;
+   done << "DONE " << wallTime;
+   send_line(fd, done.str());
+   LOG_INFO << prefix.str() << "finished in " << wallTime << "s";
+   return ok ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+   static plog::ColorConsoleAppender<plog::TxtFormatter> consoleAppender;
+   plog::init(plog::info, &consoleAppender);
+
+   std::string stateFile = "./states/StandardMale@0s.xml";
+   std::string socketPath = "/tmp/amm_fork_server.sock";
+   unsigned int maxJobs = std::max(1u, std::thread::hardware_concurrency());
+
+   for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      if ((arg == "-h") || (arg == "--help")) {
+         show_usage(argv[0]);
+         return 0;
+      }
+
+      if (i + 1 >= argc) {
+         show_usage(argv[0]);
+         return 1;
+      }
+
+      if (arg == "-s") {
+         stateFile = argv[++i];
+      } else if (arg == "-l") {
+         socketPath = argv[++i];
+      } else if (arg == "-j") {
+         maxJobs = static_cast<unsigned int>(std::max(1, atoi(argv[++i])));
+      } else {
+         show_usage(argv[0]);
+         return 1;
+      }
+   }
+
+   if (!fs::exists(stateFile)) {
+      LOG_ERROR << "State file does not exist: " << stateFile;
+      return 1;
+   }
+
+   // Same @<sec>s naming that PhysiologyEngineManager::InitializeBiogears parses
+   double startPosition = 0.0;
+   std::string stem = fs::path(stateFile).stem().string();
+   std::size_t at = stem.find('@');
+   if (at != std::string::npos) {
+      startPosition = atof(stem.substr(at + 1).c_str());
+   }
+
+   // Everything a job would otherwise pay for on startup happens once, here
+   auto begin = std::chrono::high_resolution_clock::now();
+   fs::create_directories("./logs");
+   AMM::BiogearsThread engine("./logs/fork_server.log");
+   // A child only gets the thread that forked it, so the engine must not start
+   // any before the fork; its writers start on first use and recording stays off
+   engine.SetLogging(false);
+   if (!engine.LoadState(stateFile, startPosition)) {
+      LOG_ERROR << "Unable to load base state " << stateFile;
+      return 1;
+   }
+   auto end = std::chrono::high_resolution_clock::now();
+   LOG_INFO << "Loaded " << stateFile << " in "
+            << std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count() * 1e-9 << "s";
+
+   sockaddr_un address{};
+   address.sun_family = AF_UNIX;
+   if (socketPath.size() >= sizeof(address.sun_path)) {
+      LOG_ERROR << "Socket path is too long: " << socketPath;
+      return 1;
+   }
+   strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+   int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+   unlink(socketPath.c_str());
+   if (listener < 0 || bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 ||
+       listen(listener, 16) < 0) {
+      LOG_ERROR << "Unable to listen on " << socketPath << ": " << strerror(errno);
+      return 1;
+   }
+
+   // No SA_RESTART, so a signal breaks out of accept
+   struct sigaction action{};
+   action.sa_handler = handle_signal;
+   sigaction(SIGINT, &action, nullptr);
+   sigaction(SIGTERM, &action, nullptr);
+   signal(SIGPIPE, SIG_IGN);
+
+   LOG_INFO << "Listening on " << socketPath << " for up to " << maxJobs << " concurrent jobs";
+   unsigned int running = 0;
+   uint64_t jobs = 0;
+   while (!stopping) {
+      while (running > 0 && waitpid(-1, nullptr, running >= maxJobs ? 0 : WNOHANG) > 0) {
+         --running;
+      }
+
+      int client = accept(listener, nullptr, nullptr);
+      if (client < 0) {
+         if (errno != EINTR) {
+            LOG_ERROR << "Unable to accept a connection: " << strerror(errno);
+         }
+         continue;
+      }
+
+      ++jobs;
+      pid_t pid = fork();
+      if (pid == 0) {
+         // Leave with _exit rather than running the parent's destructors on
+         // the copy; anything the job started dies with the process.
+         close(listener);
+         signal(SIGINT, SIG_DFL);
+         signal(SIGTERM, SIG_DFL);
+         int status = run_job(client, engine, jobs);
+         close(client);
+         _exit(status);
+      }
+
+      if (pid < 0) {
+         LOG_ERROR << "Unable to fork a job: " << strerror(errno);
+         send_line(client, "ERROR unable to start job");
+      } else {
+         ++running;
+         LOG_INFO << "Job " << jobs << " started in process " << pid;
+      }
+      close(client);
+   }
+
+   LOG_INFO << "Shutting down after " << jobs << " jobs, waiting for " << running << " to finish";
+   close(listener);
+   unlink(socketPath.c_str());
+   while (running > 0 && waitpid(-1, nullptr, 0) > 0) {
+      --running;
+   }
+   return 0;
+}
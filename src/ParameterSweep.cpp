@@ -0,0 +1,419 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+
+#include "AMM/BiogearsThread.h"
+#include "AMM/ColumnarFile.h"
+#include "AMM/WorkerPool.h"
+
+#include "amm/BaseLogger.h"
+
+namespace fs = boost::filesystem;
+
+// A ${name} placeholder in the scenario template, swept over a grid or drawn at random
+struct SweepParameter {
+   enum Kind {
+      GRID, UNIFORM, NORMAL
+   };
+
+   std::string name;
+   Kind kind = GRID;
+   // Grid values, or (low, high) for UNIFORM and (mean, deviation) for NORMAL
+   std::vector<double> values;
+};
+
+struct SweepOptions {
+   std::vector<std::string> metrics = {"Cardiovascular_HeartRate", "Cardiovascular_Arterial_Mean_Pressure",
+                                       "Respiratory_Respiration_Rate", "BloodChemistry_Oxygen_Saturation"};
+   std::vector<std::string> series;
+   double interval = 10.0;
+   std::string logDir = "./logs/sweep";
+};
+
+struct SweepRun {
+   uint32_t index = 0;
+   std::vector<double> parameters;
+   std::string scenarioFile;
+   double simTime = 0.0;
+   double wallTime = 0.0;
+   bool completed = false;
+};
+
+// Runs finish in any order; each one writes its rows as a single chunk per table
+struct SweepResults {
+   std::mutex mutex;
+   AMM::ColumnarWriter writer;
+   uint32_t runsTable = 0;
+   uint32_t seriesTable = 0;
+};
+
+struct Statistic {
+   double min = std::numeric_limits<double>::quiet_NaN();
+   double max = std::numeric_limits<double>::quiet_NaN();
+   double sum = 0.0;
+   double last = std::numeric_limits<double>::quiet_NaN();
+   uint64_t count = 0;
+
+   void Add(double value) {
+      min = count == 0 ? value : std::min(min, value);
+      max = count == 0 ? value : std::max(max, value);
+      sum += value;
+      last = value;
+      ++count;
+   }
+
+   double Mean() const {
+      return count == 0 ? std::numeric_limits<double>::quiet_NaN() : sum / count;
+   }
+};
+
+static void show_usage(const std::string &name) {
+   std::cerr << "Usage: " << name << " <scenario template> <parameter(s)> [options]"
+             << "\nParameters replace ${name} in the scenario template:\n"
+             << "\t-g <name>=<v1>,<v2>,...\tGrid of values\n"
+             << "\t-g <name>=<low>:<high>:<count>\tGrid of evenly spaced values\n"
+             << "\t-u <name>=<low>,<high>\tUniformly distributed\n"
+             << "\t-N <name>=<mean>,<deviation>\tNormally distributed\n"
+             << "\nOptions:\n"
+             << "\t-n <count>\t\tRandom draws per grid point (default 1)\n"
+             << "\t-s <seed>\t\tRandom seed (default 1)\n"
+             << "\t-m <nodes>\t\tComma separated node paths summarized per run (default: vitals)\n"
+             << "\t-t <nodes>\t\tComma separated node paths recorded as time series (default: none)\n"
+             << "\t-i <seconds>\t\tTime series interval in simulated seconds (default 10)\n"
+             << "\t-o <file>\t\tResults file (default <scenario>_sweep.amm)\n"
+             << "\t-j <n>\t\tNumber of parallel engines (default: one per core)\n"
+             << "\t-k\t\tKeep the generated scenario files\n"
+             << "\t-h,--help\t\tShow this help message\n"
+             << std::endl;
+}
+
+static bool parse_values(const std::string &text, std::vector<double> &values) {
+   std::vector<std::string> fields;
+   boost::split(fields, text, boost::is_any_of(","));
+   try {
+      for (const auto &field : fields) {
+         values.push_back(std::stod(field));
+      }
+   } catch (std::exception &) {
+      return false;
+   }
+   return !values.empty();
+}
+
+static bool parse_parameter(const std::string &arg, SweepParameter::Kind kind, SweepParameter &parameter) {
+   size_t equals = arg.find('=');
+   if (equals == std::string::npos || equals == 0) {
+      return false;
+   }
+   parameter.name = arg.substr(0, equals);
+   parameter.kind = kind;
+   std::string text = arg.substr(equals + 1);
+
+   std::vector<std::string> range;
+   boost::split(range, text, boost::is_any_of(":"));
+   if (kind == SweepParameter::GRID && range.size() == 3) {
+      std::vector<double> bounds;
+      if (!parse_values(range[0] + "," + range[1] + "," + range[2], bounds) || bounds[2] < 1) {
+         return false;
+      }
+      auto count = static_cast<int>(bounds[2]);
+      for (int i = 0; i < count; ++i) {
+         parameter.values.push_back(count == 1 ? bounds[0] : bounds[0] + (bounds[1] - bounds[0]) * i / (count - 1));
+      }
+      return true;
+   }
+
+   if (!parse_values(text, parameter.values)) {
+      return false;
+   }
+   return kind == SweepParameter::GRID || parameter.values.size() == 2;
+}
+
+static std::vector<std::string> parse_nodes(const std::string &text) {
+   std::vector<std::string> nodes;
+   boost::split(nodes, text, boost::is_any_of(", "), boost::token_compress_on);
+   nodes.erase(std::remove(nodes.begin(), nodes.end(), std::string()), nodes.end());
+   return nodes;
+}
+
+static std::string format_value(double value) {
+   std::ostringstream ss;
+   ss << std::setprecision(10) << value;
+   return ss.str();
+}
+
+// Same semantics as a scenario loaded into the manager: the scenario's own
+// initial state or patient, then its actions in order, advancing as it says.
+static void run_variation(SweepRun &run, const SweepOptions &options, SweepResults &results) {
+   auto begin = std::chrono::high_resolution_clock::now();
+
+   std::ostringstream logFile;
+   logFile << "run" << run.index << ".log";
+   AMM::BiogearsThread engine((fs::path(options.logDir) / logFile.str()).string());
+
+   std::vector<Statistic> statistics(options.metrics.size());
+   std::vector<double> series;
+   double nextSample = 0.0;
+   engine.SetAdvanceObserver([&](double simTime) {
+      run.simTime = simTime;
+      for (size_t m = 0; m < options.metrics.size(); ++m) {
+         statistics[m].Add(engine.GetNodePath(options.metrics[m]));
+      }
+      if (!options.series.empty() && simTime >= nextSample) {
+         series.push_back(run.index);
+         series.push_back(simTime);
+         for (const auto &node : options.series) {
+            series.push_back(engine.GetNodePath(node));
+         }
+         nextSample = simTime + options.interval;
+      }
+   });
+
+   try {
+      engine.scenarioLoading = true;
+      run.completed = engine.LoadScenarioFile(run.scenarioFile);
+   } catch (std::exception &e) {
+      LOG_ERROR << "Exception in run " << run.index << ": " << e.what();
+      run.completed = false;
+   }
+
+   auto end = std::chrono::high_resolution_clock::now();
+   run.wallTime = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count() * 1e-9;
+
+   std::vector<double> row;
+   row.push_back(run.index);
+   row.insert(row.end(), run.parameters.begin(), run.parameters.end());
+   row.push_back(run.completed ? 1.0 : 0.0);
+   row.push_back(run.wallTime);
+   row.push_back(run.simTime);
+   for (const auto &statistic : statistics) {
+      row.push_back(statistic.min);
+      row.push_back(statistic.max);
+      row.push_back(statistic.Mean());
+      row.push_back(statistic.last);
+   }
+
+   std::lock_guard<std::mutex> lock(results.mutex);
+   results.writer.WriteChunk(results.runsTable, row.data(), 1);
+   size_t width = options.series.size() + 2;
+   if (!series.empty()) {
+      results.writer.WriteChunk(results.seriesTable, series.data(), static_cast<uint32_t>(series.size() / width));
+   }
+}
+
+int main(int argc, char *argv[]) {
+   static plog::ColorConsoleAppender<plog::TxtFormatter> consoleAppender;
+   plog::init(plog::info, &consoleAppender);
+
+   std::string scenarioTemplate;
+   std::string output;
+   std::vector<SweepParameter> parameters;
+   SweepOptions options;
+   unsigned int workers = 0;
+   int draws = 1;
+   unsigned long seed = 1;
+   bool keepScenarios = false;
+
+   for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      if ((arg == "-h") || (arg == "--help")) {
+         show_usage(argv[0]);
+         return 0;
+      }
+
+      if (arg == "-k") {
+         keepScenarios = true;
+         continue;
+      }
+
+      if (arg[0] != '-') {
+         scenarioTemplate = arg;
+         continue;
+      }
+
+      if (i + 1 >= argc) {
+         show_usage(argv[0]);
+         return 1;
+      }
+
+      if (arg == "-g" || arg == "-u" || arg == "-N") {
+         SweepParameter parameter;
+         SweepParameter::Kind kind = arg == "-g" ? SweepParameter::GRID
+                                                 : (arg == "-u" ? SweepParameter::UNIFORM : SweepParameter::NORMAL);
+         if (!parse_parameter(argv[++i], kind, parameter)) {
+            LOG_ERROR << "Unable to parse parameter " << argv[i];
+            return 1;
+         }
+         parameters.push_back(parameter);
+      } else if (arg == "-n") {
+         draws = std::max(1, atoi(argv[++i]));
+      } else if (arg == "-s") {
+         seed = strtoul(argv[++i], nullptr, 10);
+      } else if (arg == "-m") {
+         options.metrics = parse_nodes(argv[++i]);
+      } else if (arg == "-t") {
+         options.series = parse_nodes(argv[++i]);
+      } else if (arg == "-i") {
+         options.interval = std::max(0.0, atof(argv[++i]));
+      } else if (arg == "-o") {
+         output = argv[++i];
+      } else if (arg == "-j") {
+         workers = static_cast<unsigned int>(std::max(0, atoi(argv[++i])));
+      } else {
+         show_usage(argv[0]);
+         return 1;
+      }
+   }
+
+   if (scenarioTemplate.empty() || parameters.empty()) {
+      show_usage(argv[0]);
+      return 1;
+   }
+
+   std::ifstream in(scenarioTemplate);
+   if (!in.is_open()) {
+      LOG_ERROR << "Unable to open scenario template " << scenarioTemplate;
+      return 1;
+   }
+   std::stringstream buffer;
+   buffer << in.rdbuf();
+   std::string scenario = buffer.str();
+   for (const auto &parameter : parameters) {
+      if (scenario.find("${" + parameter.name + "}") == std::string::npos) {
+         LOG_WARNING << "Scenario template has no ${" << parameter.name << "} placeholder";
+      }
+   }
+
+   // Grid points times random draws; everything is drawn up front so a seed
+   // always gives the same runs, whatever order the engines finish in.
+   size_t gridPoints = 1;
+   for (const auto &parameter : parameters) {
+      if (parameter.kind == SweepParameter::GRID) {
+         gridPoints *= parameter.values.size();
+      }
+   }
+   std::mt19937_64 random(seed);
+   std::vector<SweepRun> runs;
+   for (size_t point = 0; point < gridPoints; ++point) {
+      for (int draw = 0; draw < draws; ++draw) {
+         SweepRun run;
+         run.index = static_cast<uint32_t>(runs.size());
+         size_t remaining = point;
+         for (const auto &parameter : parameters) {
+            if (parameter.kind == SweepParameter::GRID) {
+               run.parameters.push_back(parameter.values[remaining % parameter.values.size()]);
+               remaining /= parameter.values.size();
+            } else if (parameter.kind == SweepParameter::UNIFORM) {
+               std::uniform_real_distribution<double> distribution(parameter.values[0], parameter.values[1]);
+               run.parameters.push_back(distribution(random));
+            } else {
+               std::normal_distribution<double> distribution(parameter.values[0], parameter.values[1]);
+               run.parameters.push_back(distribution(random));
+            }
+         }
+         runs.push_back(run);
+      }
+   }
+
+   fs::path scenarioPath(scenarioTemplate);
+   if (output.empty()) {
+      output = (scenarioPath.parent_path() / (scenarioPath.stem().string() + "_sweep.amm")).string();
+   }
+   fs::path scenarioDir = fs::path(output).replace_extension();
+   fs::create_directories(scenarioDir);
+   fs::create_directories(options.logDir);
+
+   for (auto &run : runs) {
+      std::string variation = scenario;
+      for (size_t p = 0; p < parameters.size(); ++p) {
+         boost::replace_all(variation, "${" + parameters[p].name + "}", format_value(run.parameters[p]));
+      }
+      std::ostringstream name;
+      name << scenarioPath.stem().string() << "_" << run.index << ".xml";
+      run.scenarioFile = (scenarioDir / name.str()).string();
+      std::ofstream out(run.scenarioFile);
+      out << variation;
+      if (!out) {
+         LOG_ERROR << "Unable to write " << run.scenarioFile;
+         return 1;
+      }
+   }
+
+   // runs: one row per run, keyed by run index
+   // series: RUN, SIM_TIME, nodes...; keyed by run so a run's rows share chunks
+   SweepResults results;
+   if (!results.writer.Open(output)) {
+      LOG_ERROR << "Unable to open results file " << output;
+      return 1;
+   }
+   std::vector<std::string> columns;
+   for (const auto &parameter : parameters) {
+      columns.push_back(parameter.name);
+   }
+   columns.push_back("COMPLETED");
+   columns.push_back("WALL_TIME");
+   columns.push_back("SIM_TIME");
+   for (const auto &metric : options.metrics) {
+      columns.push_back(metric + "_MIN");
+      columns.push_back(metric + "_MAX");
+      columns.push_back(metric + "_MEAN");
+      columns.push_back(metric + "_FINAL");
+   }
+   columns.insert(columns.begin(), "RUN");
+   results.runsTable = results.writer.AddTable("runs", columns);
+   columns = options.series;
+   columns.insert(columns.begin(), {"RUN", "SIM_TIME"});
+   results.seriesTable = results.writer.AddTable("series", columns);
+
+   auto begin = std::chrono::high_resolution_clock::now();
+   {
+      AMM::WorkerPool pool(workers);
+      LOG_INFO << "Running " << runs.size() << " variation(s) of " << scenarioTemplate << " on "
+               << pool.GetWorkerCount() << " engine(s)";
+      for (auto &run : runs) {
+         pool.Submit([&run, &options, &results, &runs, keepScenarios] {
+            run_variation(run, options, results);
+            LOG_INFO << "Run " << run.index + 1 << "/" << runs.size() << (run.completed ? " finished" : " FAILED")
+                     << " in " << run.wallTime << "s";
+            if (!keepScenarios) {
+               fs::remove(run.scenarioFile);
+            }
+         });
+      }
+      pool.Wait();
+   }
+   results.writer.Close();
+   if (!keepScenarios) {
+      boost::system::error_code ec;
+      fs::remove(scenarioDir, ec);
+   }
+   auto end = std::chrono::high_resolution_clock::now();
+   double totalTime = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count() * 1e-9;
+
+   int failed = 0;
+   double serialTime = 0.0;
+   for (const auto &run : runs) {
+      serialTime += run.wallTime;
+      if (!run.completed) {
+         ++failed;
+      }
+   }
+   std::cout << std::endl << "Completed " << (runs.size() - failed) << "/" << runs.size() << " runs in " << std::fixed
+             << std::setprecision(2) << totalTime << "s (" << serialTime << "s of engine time), results in "
+             << output << std::endl;
+
+   return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,230 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include <biogears/cdm/properties/SEScalarTime.h>
+#include <biogears/cdm/scenario/SEScenario.h>
+#include <biogears/cdm/scenario/SEScenarioInitialParameters.h>
+#include <biogears/engine/BioGearsPhysiologyEngine.h>
+
+#include "AMM/StateArchive.h"
+#include "AMM/WorkerPool.h"
+
+#include "amm/BaseLogger.h"
+
+namespace fs = boost::filesystem;
+
+struct StabilizationJob {
+   std::string name;
+   std::string patientFile;
+   std::string conditionFile;
+   std::string stateFile;
+   double wallTime = 0.0;
+   bool stabilized = false;
+};
+
+static void show_usage(const std::string &name) {
+   std::cerr << "Usage: " << name << " <option(s)>"
+             << "\nOptions:\n"
+             << "\t-p <dir>\t\tPatient directory (default ./patients)\n"
+             << "\t-c <dir|file>\t\tCondition set(s): scenario files whose initial parameters carry conditions\n"
+             << "\t-o <dir>\t\tOutput state directory (default ./states)\n"
+             << "\t-j <n>\t\tNumber of parallel engines (default: one per core)\n"
+             << "\t-b\t\tAlso write binary state archives\n"
+             << "\t-h,--help\t\tShow this help message\n"
+             << std::endl;
+}
+
+static std::vector<std::string> list_xml_files(const std::string &location) {
+   std::vector<std::string> files;
+   if (fs::is_regular_file(location)) {
+      files.push_back(location);
+      return files;
+   }
+
+   if (!fs::is_directory(location)) {
+      return files;
+   }
+
+   for (fs::directory_iterator it(location), end; it != end; ++it) {
+      if (fs::is_regular_file(it->path()) && it->path().extension() == ".xml") {
+         files.push_back(it->path().string());
+      }
+   }
+   std::sort(files.begin(), files.end());
+   return files;
+}
+
+// Each job owns an independent engine, so jobs never share BioGears state.
+static void stabilize(StabilizationJob &job, const std::string &outputDir, const std::string &logDir,
+                      bool binaryStates) {
+   auto begin = std::chrono::high_resolution_clock::now();
+
+   std::unique_ptr<biogears::PhysiologyEngine> engine;
+   try {
+      engine = biogears::CreateBioGearsEngine((fs::path(logDir) / (job.name + ".log")).string());
+   } catch (std::exception &e) {
+      LOG_ERROR << "Error starting engine for " << job.name << ": " << e.what();
+      return;
+   }
+
+   std::unique_ptr<biogears::SEScenario> conditionSet;
+   std::vector<const biogears::SECondition *> conditions;
+   if (!job.conditionFile.empty()) {
+      conditionSet.reset(new biogears::SEScenario(engine->GetSubstanceManager()));
+      conditionSet->Load(job.conditionFile);
+      if (!conditionSet->HasInitialParameters()) {
+         LOG_ERROR << "Condition set has no initial parameters: " << job.conditionFile;
+         return;
+      }
+      for (biogears::SECondition *c : conditionSet->GetInitialParameters().GetConditions())
+         conditions.push_back(c);// Copy to const
+   }
+
+   LOG_INFO << "Stabilizing " << job.name;
+   try {
+      if (!engine->InitializeEngine(job.patientFile, conditions.empty() ? nullptr : &conditions)) {
+         LOG_ERROR << "Unable to stabilize " << job.name;
+         return;
+      }
+   } catch (std::exception &e) {
+      LOG_ERROR << "Exception stabilizing " << job.name << ": " << e.what();
+      return;
+   }
+
+   // Same @<sec>s naming that PhysiologyEngineManager::InitializeBiogears parses back out
+   std::ostringstream ss;
+   double simTime = engine->GetSimulationTime(biogears::TimeUnit::s);
+   ss << job.name << "@" << (int) std::round(simTime) << "s.xml";
+   job.stateFile = (fs::path(outputDir) / ss.str()).string();
+   engine->SaveStateToFile(job.stateFile);
+   if (binaryStates && !AMM::StateArchive::WriteFromStateFile(job.stateFile)) {
+      LOG_WARNING << "Unable to write binary state archive for " << job.name;
+   }
+
+   auto end = std::chrono::high_resolution_clock::now();
+   job.wallTime = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count() * 1e-9;
+   job.stabilized = true;
+   LOG_INFO << "Stabilized " << job.name << " in " << job.wallTime << "s, saved " << job.stateFile;
+}
+
+int main(int argc, char *argv[]) {
+   static plog::ColorConsoleAppender<plog::TxtFormatter> consoleAppender;
+   plog::init(plog::info, &consoleAppender);
+
+   std::string patientDir = "./patients";
+   std::string conditionDir;
+   std::string outputDir = "./states";
+   std::string logDir = "./logs";
+   unsigned int workers = 0;
+   bool binaryStates = false;
+
+   for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      if ((arg == "-h") || (arg == "--help")) {
+         show_usage(argv[0]);
+         return 0;
+      }
+
+      if (arg == "-b") {
+         binaryStates = true;
+         continue;
+      }
+
+      if (i + 1 >= argc) {
+         show_usage(argv[0]);
+         return 1;
+      }
+
+      if (arg == "-p") {
+         patientDir = argv[++i];
+      } else if (arg == "-c") {
+         conditionDir = argv[++i];
+      } else if (arg == "-o") {
+         outputDir = argv[++i];
+      } else if (arg == "-j") {
+         workers = static_cast<unsigned int>(std::max(0, atoi(argv[++i])));
+      } else {
+         show_usage(argv[0]);
+         return 1;
+      }
+   }
+
+   std::vector<std::string> patients = list_xml_files(patientDir);
+   if (patients.empty()) {
+      LOG_ERROR << "No patient files found in " << patientDir;
+      return 1;
+   }
+
+   std::vector<std::string> conditionSets;
+   if (!conditionDir.empty()) {
+      conditionSets = list_xml_files(conditionDir);
+      if (conditionSets.empty()) {
+         LOG_ERROR << "No condition sets found in " << conditionDir;
+         return 1;
+      }
+   }
+
+   fs::create_directories(outputDir);
+   fs::create_directories(logDir);
+
+   std::vector<StabilizationJob> jobs;
+   for (const auto &patient : patients) {
+      std::string patientName = fs::path(patient).stem().string();
+      if (conditionSets.empty()) {
+         StabilizationJob job;
+         job.name = patientName;
+         job.patientFile = patient;
+         jobs.push_back(job);
+      } else {
+         for (const auto &conditions : conditionSets) {
+            StabilizationJob job;
+            job.name = patientName + "_" + fs::path(conditions).stem().string();
+            job.patientFile = patient;
+            job.conditionFile = conditions;
+            jobs.push_back(job);
+         }
+      }
+   }
+
+   auto begin = std::chrono::high_resolution_clock::now();
+   {
+      AMM::WorkerPool pool(workers);
+      LOG_INFO << "Stabilizing " << jobs.size() << " patient(s) on " << pool.GetWorkerCount() << " engine(s)";
+      for (auto &job : jobs) {
+         pool.Submit([&job, &outputDir, &logDir, binaryStates] {
+            stabilize(job, outputDir, logDir, binaryStates);
+         });
+      }
+      pool.Wait();
+   }
+   auto end = std::chrono::high_resolution_clock::now();
+   double totalTime = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count() * 1e-9;
+
+   int failed = 0;
+   double serialTime = 0.0;
+   std::cout << std::endl;
+   std::cout << std::left << std::setw(40) << "Patient" << std::setw(16) << "Wall time (s)" << "State file"
+             << std::endl;
+   for (const auto &job : jobs) {
+      std::cout << std::left << std::setw(40) << job.name << std::setw(16) << std::fixed << std::setprecision(2)
+                << job.wallTime << (job.stabilized ? job.stateFile : "FAILED") << std::endl;
+      serialTime += job.wallTime;
+      if (!job.stabilized) {
+         ++failed;
+      }
+   }
+   std::cout << std::endl << "Stabilized " << (jobs.size() - failed) << "/" << jobs.size() << " in " << totalTime
+             << "s (" << serialTime << "s of engine time)" << std::endl;
+
+   return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,263 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include <biogears/cdm/properties/SEScalarTime.h>
+#include <biogears/cdm/scenario/SEAdvanceTime.h>
+#include <biogears/cdm/scenario/SEScenario.h>
+#include <biogears/engine/BioGearsPhysiologyEngine.h>
+
+#include "AMM/ActionScheduler.h"
+#include "AMM/ScenarioReader.h"
+#include "AMM/StateArchive.h"
+
+#include "amm/BaseLogger.h"
+
+namespace fs = boost::filesystem;
+
+static void show_usage(const std::string &name) {
+   std::cerr << "Usage: " << name << " <benchmark> <file> [options]"
+             << "\nBenchmarks:\n"
+             << "\tstate <state file>\t\tCompare XML and binary archive state loading\n"
+             << "\tscenario <scenario file>\tCompare full and streamed scenario loading, and live scheduling\n"
+             << "\nOptions:\n"
+             << "\t-n <count>\t\tIterations per measurement (default 5)\n"
+             << "\t-h,--help\t\tShow this help message\n"
+             << std::endl;
+}
+
+struct Measurement {
+   std::string name;
+   std::vector<double> samples;
+
+   double Mean() const {
+      double sum = 0.0;
+      for (double s : samples) sum += s;
+      return samples.empty() ? 0.0 : sum / samples.size();
+   }
+
+   double Min() const {
+      return samples.empty() ? 0.0 : *std::min_element(samples.begin(), samples.end());
+   }
+};
+
+static Measurement measure(const std::string &name, int iterations, const std::function<bool()> &run) {
+   Measurement m;
+   m.name = name;
+   for (int i = 0; i < iterations; ++i) {
+      auto begin = std::chrono::high_resolution_clock::now();
+      if (!run()) {
+         LOG_ERROR << name << " failed on iteration " << i;
+         break;
+      }
+      auto end = std::chrono::high_resolution_clock::now();
+      m.samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count() * 1e-9);
+   }
+   return m;
+}
+
+static void print_measurements(const std::vector<Measurement> &measurements) {
+   std::cout << std::left << std::setw(32) << "Measurement" << std::setw(14) << "Mean (s)" << std::setw(14)
+             << "Min (s)" << "Runs" << std::endl;
+   for (const auto &m : measurements) {
+      std::cout << std::left << std::setw(32) << m.name << std::setw(14) << std::fixed << std::setprecision(4)
+                << m.Mean() << std::setw(14) << m.Min() << m.samples.size() << std::endl;
+   }
+}
+
+static int benchmark_state(const std::string &stateFile, int iterations) {
+   if (!fs::exists(stateFile)) {
+      LOG_ERROR << "State file does not exist: " << stateFile;
+      return 1;
+   }
+
+   std::string archiveFile = AMM::StateArchive::ArchivePath(stateFile);
+   if (!AMM::StateArchive::IsCurrent(archiveFile, stateFile)) {
+      LOG_INFO << "Writing binary state archive " << archiveFile;
+      if (!AMM::StateArchive::WriteFromStateFile(stateFile)) {
+         return 1;
+      }
+   }
+
+   std::unique_ptr<biogears::PhysiologyEngine> engine = biogears::CreateBioGearsEngine("./logs/benchmark.log");
+   biogears::SEScalarTime startTime;
+   startTime.SetValue(0, biogears::TimeUnit::s);
+
+   std::vector<Measurement> measurements;
+   measurements.push_back(measure("XML state (validated)", iterations, [&] {
+      return engine->LoadState(stateFile, &startTime);
+   }));
+   measurements.push_back(measure("Binary archive read", iterations, [&] {
+      std::string stateXml;
+      return AMM::StateArchive::Read(archiveFile, stateXml);
+   }));
+   measurements.push_back(measure("Binary archive state", iterations, [&] {
+      std::unique_ptr<CDM::PhysiologyEngineStateData> state = AMM::StateArchive::Load(archiveFile);
+      return state != nullptr && engine->LoadState(*state, &startTime);
+   }));
+
+   uintmax_t xmlSize = fs::file_size(stateFile);
+   uintmax_t archiveSize = fs::file_size(archiveFile);
+   std::cout << std::endl;
+   std::cout << "XML state size:       " << xmlSize << " bytes" << std::endl;
+   std::cout << "Binary archive size:  " << archiveSize << " bytes (" << std::fixed << std::setprecision(1)
+             << (100.0 * archiveSize / std::max<uintmax_t>(xmlSize, 1)) << "%)" << std::endl;
+   std::cout << std::endl;
+   print_measurements(measurements);
+   return 0;
+}
+
+static int benchmark_scenario(const std::string &scenarioFile, int iterations) {
+   if (!fs::exists(scenarioFile)) {
+      LOG_ERROR << "Scenario file does not exist: " << scenarioFile;
+      return 1;
+   }
+
+   std::unique_ptr<biogears::PhysiologyEngine> engine = biogears::CreateBioGearsEngine("./logs/benchmark.log");
+   biogears::SESubstanceManager &substances = engine->GetSubstanceManager();
+
+   // A full load has every action before it can run the first one
+   size_t actions = 0;
+   size_t largestDocument = 0;
+   std::vector<Measurement> measurements;
+   measurements.push_back(measure("Full load (validated)", iterations, [&] {
+      biogears::SEScenario scenario(substances);
+      return scenario.Load(scenarioFile) && !scenario.GetActions().empty();
+   }));
+   measurements.push_back(measure("Streamed first action", iterations, [&] {
+      AMM::ScenarioReader reader;
+      std::string document;
+      return reader.Open(scenarioFile) && AMM::ScenarioReader::Parse(reader.GetHeader()) != nullptr &&
+             reader.Next(document) && AMM::ScenarioReader::ParseAction(document, substances) != nullptr;
+   }));
+   measurements.push_back(measure("Streamed all actions", iterations, [&] {
+      AMM::ScenarioReader reader;
+      std::string document;
+      if (!reader.Open(scenarioFile) || AMM::ScenarioReader::Parse(reader.GetHeader()) == nullptr) {
+         return false;
+      }
+      while (reader.Next(document)) {
+         largestDocument = std::max(largestDocument, document.size());
+         if (AMM::ScenarioReader::ParseAction(document, substances) == nullptr) {
+            return false;
+         }
+      }
+      actions = reader.GetActionCount();
+      return true;
+   }));
+
+   // Live mode runs the actions before the first AdvanceTime and schedules the rest
+   size_t upFrontPeak = 0;
+   size_t aheadPeak = 0;
+   measurements.push_back(measure("Live, scheduled up front", iterations, [&] {
+      AMM::ScenarioReader reader;
+      AMM::ActionScheduler scheduler;
+      std::string document;
+      if (!reader.Open(scenarioFile)) {
+         return false;
+      }
+      double time = 0.0;
+      while (reader.Next(document)) {
+         std::unique_ptr<biogears::SEAction> action = AMM::ScenarioReader::ParseAction(document, substances);
+         if (action == nullptr) {
+            return false;
+         }
+         auto *advance = dynamic_cast<biogears::SEAdvanceTime *>(action.get());
+         if (advance != nullptr) {
+            time += advance->GetTime(biogears::TimeUnit::s);
+         } else if (time > 0.0) {
+            scheduler.Schedule(time, std::move(action));
+         }
+      }
+      upFrontPeak = scheduler.GetPendingCount();
+      return true;
+   }));
+   measurements.push_back(measure("Live, scheduled ahead", iterations, [&] {
+      AMM::ScenarioReader reader;
+      std::string document;
+      if (!reader.Open(scenarioFile)) {
+         return false;
+      }
+      double firstAdvance = -1.0;
+      while (firstAdvance < 0.0 && reader.Next(document)) {
+         std::unique_ptr<biogears::SEAction> action = AMM::ScenarioReader::ParseAction(document, substances);
+         auto *advance = dynamic_cast<biogears::SEAdvanceTime *>(action.get());
+         if (advance != nullptr) {
+            firstAdvance = advance->GetTime(biogears::TimeUnit::s);
+         }
+      }
+      if (firstAdvance < 0.0) {
+         return true;
+      }
+
+      // The engine feeds the scheduler before every tick; once a simulated second is enough here
+      AMM::LiveScenarioFeed feed(std::move(reader), scenarioFile, firstAdvance, 30.0);
+      AMM::ActionScheduler scheduler;
+      std::vector<std::shared_ptr<const biogears::SEAction>> due;
+      bool feeding = true;
+      size_t peak = 0;
+      for (double now = 0.0; feeding || scheduler.GetPendingCount() > 0; now += 1.0) {
+         if (feeding) {
+            feeding = feed.Feed(now, substances, scheduler);
+         }
+         peak = std::max(peak, scheduler.GetPendingCount());
+         due.clear();
+         scheduler.TakeDue(now, due);
+      }
+      aheadPeak = peak;
+      return true;
+   }));
+
+   std::cout << std::endl;
+   std::cout << "Scenario size:        " << fs::file_size(scenarioFile) << " bytes, " << actions << " actions"
+             << std::endl;
+   std::cout << "Largest streamed:     " << largestDocument << " bytes" << std::endl;
+   std::cout << "Live scheduler peak:  " << upFrontPeak << " actions up front, " << aheadPeak
+             << " scheduled 30s ahead" << std::endl;
+   std::cout << std::endl;
+   print_measurements(measurements);
+   return 0;
+}
+
+int main(int argc, char *argv[]) {
+   static plog::ColorConsoleAppender<plog::TxtFormatter> consoleAppender;
+   plog::init(plog::info, &consoleAppender);
+
+   std::vector<std::string> positional;
+   int iterations = 5;
+   for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      if ((arg == "-h") || (arg == "--help")) {
+         show_usage(argv[0]);
+         return 0;
+      } else if (arg == "-n" && i + 1 < argc) {
+         iterations = std::max(1, atoi(argv[++i]));
+      } else {
+         positional.push_back(arg);
+      }
+   }
+
+   if (positional.size() < 2) {
+      show_usage(argv[0]);
+      return 1;
+   }
+
+   fs::create_directories("./logs");
+
+   if (positional[0] == "state") {
+      return benchmark_state(positional[1], iterations);
+   } else if (positional[0] == "scenario") {
+      return benchmark_scenario(positional[1], iterations);
+   }
+
+   show_usage(argv[0]);
+   return 1;
+}
@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+
+#include "AMM/PatientCoordinator.h"
+
+#include "amm/BaseLogger.h"
+
+namespace fs = boost::filesystem;
+
+static volatile sig_atomic_t closed = 0;
+
+static void handle_signal(int) {
+   closed = 1;
+}
+
+static void show_usage(const std::string &name) {
+   std::cerr << "Usage: " << name << " <option(s)>"
+             << "\nOptions:\n"
+             << "\t-n <count>\t\tPatients to admit on startup (default 0)\n"
+             << "\t-s <state>\t\tState under ./states they start from (default StandardMale@0s)\n"
+             << "\t-m <count>\t\tLocal manager processes to start (default 0, use managers already on the domain)\n"
+             << "\t-e <path>\t\tManager executable for -m (default amm_physiology_manager next to this one)\n"
+             << "\t-h,--help\t\tShow this help message\n"
+             << "\nPatients are addressed with a [PATIENT:<id>] prefix on Command messages and\n"
+             << "PhysiologyModification types; values they publish carry the same prefix.\n"
+             << "[SYS]PE_ADMIT:<state>[;<id>] and [SYS]PE_DISCHARGE:<id> admit and discharge patients.\n"
+             << "[SYS]PE_MIGRATE:<id>[;<manager id>] moves a running patient to another manager.\n"
+             << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+   static plog::ColorConsoleAppender<plog::TxtFormatter> consoleAppender;
+   plog::init(plog::info, &consoleAppender);
+
+   int patients = 0;
+   int managers = 0;
+   std::string state = "StandardMale@0s";
+   std::string managerExe = (fs::path(argv[0]).parent_path() / "amm_physiology_manager").string();
+
+   for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      if ((arg == "-h") || (arg == "--help")) {
+         show_usage(argv[0]);
+         return 0;
+      }
+
+      if (i + 1 >= argc) {
+         show_usage(argv[0]);
+         return 1;
+      }
+
+      if (arg == "-n") {
+         patients = std::max(0, atoi(argv[++i]));
+      } else if (arg == "-s") {
+         state = argv[++i];
+      } else if (arg == "-m") {
+         managers = std::max(0, atoi(argv[++i]));
+      } else if (arg == "-e") {
+         managerExe = argv[++i];
+      } else {
+         show_usage(argv[0]);
+         return 1;
+      }
+   }
+
+   // Several managers on one machine, for trying sharding without more hosts
+   std::vector<pid_t> children;
+   for (int i = 0; i < managers; ++i) {
+      pid_t pid = fork();
+      if (pid == 0) {
+         execl(managerExe.c_str(), managerExe.c_str(), "-a", static_cast<char *>(nullptr));
+         LOG_ERROR << "Unable to start " << managerExe;
+         _exit(1);
+      }
+      if (pid > 0) {
+         children.push_back(pid);
+      }
+   }
+
+   signal(SIGINT, handle_signal);
+   signal(SIGTERM, handle_signal);
+
+   AMM::PatientCoordinator coordinator;
+   for (int i = 0; i < patients; ++i) {
+      coordinator.Admit(state);
+   }
+
+   LOG_INFO << "Physiology coordinator started.";
+   int cycles = 0;
+   while (!closed) {
+      coordinator.Balance();
+      if (++cycles % 15 == 0) {
+         coordinator.Status();
+      }
+      std::this_thread::sleep_for(std::chrono::seconds(2));
+   }
+
+   coordinator.Shutdown();
+   for (pid_t pid : children) {
+      kill(pid, SIGTERM);
+      waitpid(pid, nullptr, 0);
+   }
+
+   LOG_INFO << "Exiting.";
+   return 0;
+}
@@ -8,13 +8,23 @@ using namespace AMM;
 bool closed = false;
 int autostart = 0;
 bool logging = false;
+bool binaryStates = false;
+std::string journalFile;
+std::string replayFile;
+std::string standbyAddress;
+std::string primaryAddress;
 
 
 static void show_usage(const std::string &name) {
    std::cerr << "Usage: " << name << " <option(s)>"
              << "\nOptions:\n"
              << "\t-a\t\tAuto-start based on ticks\n"
-             << "\t-l\t\tEnable physiology CSV logging\n"
+             << "\t-l\t\tEnable physiology recording (.amm, see amm_recording_to_csv)\n"
+             << "\t-b\t\tWrite binary state archives alongside saved states\n"
+             << "\t-j <file>\tRecord all inputs to an input journal\n"
+             << "\t-r <file>\tReplay an input journal as fast as possible, then exit\n"
+             << "\t-f <[host:]port>\tFeed a hot standby manager connecting on this port\n"
+             << "\t-s <host:port>\tRun as the hot standby of the manager feeding host:port\n"
              << "\t-h,--help\t\tShow this help message\n"
              << std::endl;
 }
@@ -146,14 +156,67 @@ int main(int argc, char *argv[]) {
       if (arg == "-a") {
          autostart = 1;
       }
+
+      if (arg == "-b") {
+         binaryStates = true;
+      }
+
+      if (arg == "-j" && i + 1 < argc) {
+         journalFile = argv[++i];
+      }
+
+      if (arg == "-r" && i + 1 < argc) {
+         replayFile = argv[++i];
+      }
+
+      if (arg == "-f" && i + 1 < argc) {
+         standbyAddress = argv[++i];
+      }
+
+      if (arg == "-s" && i + 1 < argc) {
+         primaryAddress = argv[++i];
+      }
+   }
+
+   if (!journalFile.empty() && !replayFile.empty()) {
+      std::cerr << "A replay cannot be journaled again, use either -j or -r" << std::endl;
+      return 1;
    }
 
    auto *pe = new AMM::PhysiologyEngineManager();
    pe->SetLogging(logging);
+   pe->SetBinaryStates(binaryStates);
+   if (!journalFile.empty()) {
+      pe->StartJournal(journalFile);
+   }
+
+   if (!replayFile.empty()) {
+      bool replayed = pe->Replay(replayFile);
+      pe->StopJournal();
+      pe->Shutdown();
+      return replayed ? 0 : 1;
+   }
    std::this_thread::sleep_for(std::chrono::milliseconds(250));
 
-   pe->PublishOperationalDescription();
-   pe->PublishConfiguration();
+   if (!standbyAddress.empty()) {
+      size_t colon = standbyAddress.rfind(':');
+      std::string host = colon != std::string::npos ? standbyAddress.substr(0, colon) : "";
+      int port = atoi(standbyAddress.substr(colon != std::string::npos ? colon + 1 : 0).c_str());
+      if (port > 0) {
+         pe->StartStandbyFeed(host, static_cast<uint16_t>(port));
+      }
+   }
+
+   // A standby stays off the domain until its primary goes quiet
+   size_t separator = primaryAddress.rfind(':');
+   if (separator != std::string::npos) {
+      pe->StartStandby(primaryAddress.substr(0, separator),
+                       static_cast<uint16_t>(atoi(primaryAddress.substr(separator + 1).c_str())));
+   } else {
+      pe->PublishOperationalDescription();
+      pe->PublishConfiguration();
+      pe->Announce();
+   }
 
    if (autostart == 1) {
       LOG_INFO << "Physiology engine wrapper started.";
@@ -167,6 +230,7 @@ int main(int argc, char *argv[]) {
       std::cout.flush();
    }
 
+   pe->StopJournal();
    pe->Shutdown();
 
    LOG_INFO << "Exiting.";
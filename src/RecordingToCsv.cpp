@@ -0,0 +1,132 @@
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "AMM/ColumnarFile.h"
+
+#include "amm/BaseLogger.h"
+
+namespace fs = boost::filesystem;
+
+static void show_usage(const std::string &name) {
+   std::cerr << "Usage: " << name << " <recording> [options]"
+             << "\nOptions:\n"
+             << "\t-o <path>\t\tOutput CSV file, or prefix when there are several tables\n"
+             << "\t-t <table>\t\tOnly convert the named table\n"
+             << "\t-l\t\t\tList tables and columns, then exit\n"
+             << "\t-h,--help\t\tShow this help message\n"
+             << std::endl;
+}
+
+static bool write_csv(AMM::ColumnarReader &reader, uint32_t table, const std::string &csvFile) {
+   const AMM::ColumnarReader::Table &definition = reader.GetTables()[table];
+   std::vector<double> rows;
+   if (!reader.ReadTable(table, rows)) {
+      return false;
+   }
+
+   std::ofstream out(csvFile);
+   if (!out.is_open()) {
+      LOG_ERROR << "Unable to open " << csvFile;
+      return false;
+   }
+
+   size_t columns = definition.columns.size();
+   for (size_t c = 0; c < columns; ++c) {
+      out << (c > 0 ? "," : "") << definition.columns[c];
+   }
+   out << "\n" << std::setprecision(10);
+
+   for (size_t r = 0; columns > 0 && r < rows.size() / columns; ++r) {
+      for (size_t c = 0; c < columns; ++c) {
+         out << (c > 0 ? "," : "") << rows[r * columns + c];
+      }
+      out << "\n";
+   }
+
+   LOG_INFO << "Wrote " << rows.size() / std::max<size_t>(columns, 1) << " rows of " << definition.name << " to "
+            << csvFile;
+   return static_cast<bool>(out);
+}
+
+int main(int argc, char *argv[]) {
+   static plog::ColorConsoleAppender<plog::TxtFormatter> consoleAppender;
+   plog::init(plog::info, &consoleAppender);
+
+   std::string recording;
+   std::string output;
+   std::string tableName;
+   bool list = false;
+   for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      if ((arg == "-h") || (arg == "--help")) {
+         show_usage(argv[0]);
+         return 0;
+      } else if (arg == "-o" && i + 1 < argc) {
+         output = argv[++i];
+      } else if (arg == "-t" && i + 1 < argc) {
+         tableName = argv[++i];
+      } else if (arg == "-l") {
+         list = true;
+      } else {
+         recording = arg;
+      }
+   }
+
+   if (recording.empty()) {
+      show_usage(argv[0]);
+      return 1;
+   }
+
+   AMM::ColumnarReader reader;
+   if (!reader.Open(recording)) {
+      return 1;
+   }
+
+   const auto &tables = reader.GetTables();
+   if (list) {
+      for (uint32_t t = 0; t < tables.size(); ++t) {
+         std::cout << tables[t].name << " (" << reader.GetRowCount(t) << " rows)" << std::endl;
+         for (const auto &column : tables[t].columns) {
+            std::cout << "\t" << column << std::endl;
+         }
+      }
+      return 0;
+   }
+
+   std::vector<uint32_t> selected;
+   for (uint32_t t = 0; t < tables.size(); ++t) {
+      if (tableName.empty() || tables[t].name == tableName) {
+         selected.push_back(t);
+      }
+   }
+   if (selected.empty()) {
+      LOG_ERROR << "No table named " << tableName << " in " << recording;
+      return 1;
+   }
+
+   if (output.empty()) {
+      output = fs::path(recording).replace_extension().string();
+   }
+
+   // A single table goes to the output file itself, several get a suffix each
+   for (uint32_t t : selected) {
+      std::string csvFile = output;
+      if (selected.size() > 1) {
+         csvFile += "_" + tables[t].name;
+      }
+      if (fs::path(csvFile).extension() != ".csv") {
+         csvFile += ".csv";
+      }
+      if (!write_csv(reader, t, csvFile)) {
+         return 1;
+      }
+   }
+   return 0;
+}
@@ -0,0 +1,170 @@
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "AMM/AlarmEngine.h"
+
+#include "TestCheck.h"
+
+namespace fs = boost::filesystem;
+
+using AMM::AlarmEngine;
+
+static AlarmEngine::Rule make_rule(const std::string &name, bool above, double threshold, double clear,
+                                   double duration) {
+   AlarmEngine::Rule rule;
+   rule.name = name;
+   rule.node = name + "_node";
+   rule.above = above;
+   rule.threshold = threshold;
+   rule.clear = clear;
+   rule.duration = duration;
+   return rule;
+}
+
+static void test_raise_and_clear_with_hysteresis() {
+   AlarmEngine engine;
+   CHECK(!engine.IsEnabled());
+   // Snapshot position 1 holds the heart rate
+   engine.Configure({make_rule("Tachycardia", true, 120.0, 110.0, 0.0)}, {1}, 0.02);
+   CHECK(engine.IsEnabled());
+
+   std::vector<AlarmEngine::Transition> transitions;
+   engine.Evaluate({0.0, 100.0}, 1.0);
+   engine.TakeTransitions(transitions);
+   CHECK(transitions.empty());
+
+   engine.Evaluate({0.0, 125.0}, 2.0);
+   engine.TakeTransitions(transitions);
+   CHECK(transitions.size() == 1);
+   CHECK(transitions.size() == 1 && transitions[0].active && transitions[0].name == "Tachycardia" &&
+         transitions[0].node == "Tachycardia_node" && transitions[0].value == 125.0 &&
+         transitions[0].simTime == 2.0);
+   CHECK(engine.GetActiveCount() == 1);
+
+   // Below the threshold but not past clear, still active and nothing reported again
+   engine.Evaluate({0.0, 115.0}, 3.0);
+   engine.Evaluate({0.0, 130.0}, 4.0);
+   engine.TakeTransitions(transitions);
+   CHECK(transitions.empty());
+   CHECK(engine.GetActiveCount() == 1);
+
+   engine.Evaluate({0.0, 105.0}, 5.0);
+   engine.TakeTransitions(transitions);
+   CHECK(transitions.size() == 1 && !transitions[0].active && transitions[0].value == 105.0);
+   CHECK(engine.GetActiveCount() == 0);
+}
+
+static void test_below_rule_needs_duration() {
+   AlarmEngine engine;
+   // Two seconds at half-second ticks is four ticks in a row
+   engine.Configure({make_rule("Hypoxia", false, 90.0, 92.0, 2.0)}, {0}, 0.5);
+
+   std::vector<AlarmEngine::Transition> transitions;
+   double time = 0.0;
+   for (int i = 0; i < 3; ++i) {
+      engine.Evaluate({85.0}, time += 0.5);
+   }
+   // A single tick back above restarts the count
+   engine.Evaluate({91.0}, time += 0.5);
+   for (int i = 0; i < 3; ++i) {
+      engine.Evaluate({85.0}, time += 0.5);
+   }
+   engine.TakeTransitions(transitions);
+   CHECK(transitions.empty());
+
+   engine.Evaluate({85.0}, time += 0.5);
+   engine.TakeTransitions(transitions);
+   CHECK(transitions.size() == 1 && transitions[0].active && transitions[0].value == 85.0 &&
+         transitions[0].simTime == time);
+
+   // Clears only once back above the clear level
+   engine.Evaluate({91.0}, time += 0.5);
+   engine.TakeTransitions(transitions);
+   CHECK(transitions.empty());
+   engine.Evaluate({93.0}, time += 0.5);
+   engine.TakeTransitions(transitions);
+   CHECK(transitions.size() == 1 && !transitions[0].active);
+}
+
+static void test_rules_are_independent() {
+   AlarmEngine engine;
+   engine.Configure({make_rule("High", true, 10.0, 10.0, 0.0), make_rule("Low", false, 0.0, 0.0, 0.0),
+                     make_rule("AlsoHigh", true, 5.0, 5.0, 0.0)}, {0, 0, 1}, 0.02);
+
+   std::vector<AlarmEngine::Transition> transitions;
+   engine.Evaluate({11.0, 1.0}, 1.0);
+   engine.TakeTransitions(transitions);
+   CHECK(transitions.size() == 1 && transitions[0].name == "High");
+
+   engine.Evaluate({-1.0, 6.0}, 2.0);
+   engine.TakeTransitions(transitions);
+   // In rule order
+   CHECK(transitions.size() == 3);
+   CHECK(transitions.size() == 3 && transitions[0].name == "High" && !transitions[0].active &&
+         transitions[1].name == "Low" && transitions[1].active && transitions[2].name == "AlsoHigh" &&
+         transitions[2].active);
+   CHECK(engine.GetActiveCount() == 2);
+}
+
+static void test_reset_clears_active() {
+   AlarmEngine engine;
+   engine.Configure({make_rule("High", true, 10.0, 10.0, 0.0), make_rule("Low", false, 0.0, 0.0, 0.0)}, {0, 1},
+                    0.02);
+   std::vector<AlarmEngine::Transition> transitions;
+   engine.Evaluate({20.0, 5.0}, 1.0);
+   engine.TakeTransitions(transitions);
+
+   engine.Reset(7.0);
+   engine.TakeTransitions(transitions);
+   CHECK(transitions.size() == 1 && transitions[0].name == "High" && !transitions[0].active &&
+         transitions[0].value == 20.0 && transitions[0].simTime == 7.0);
+   CHECK(engine.GetActiveCount() == 0);
+
+   // Raised again from scratch
+   engine.Evaluate({20.0, 5.0}, 8.0);
+   engine.TakeTransitions(transitions);
+   CHECK(transitions.size() == 1 && transitions[0].active);
+}
+
+static void test_load_rules(const fs::path &dir) {
+   std::string file = (dir / "alarms.xml").string();
+   {
+      std::ofstream out(file);
+      out << "<AlarmRules>"
+          << "<Rule name='Tachycardia' node='Cardiovascular_HeartRate' above='120' clear='110' duration='5'/>"
+          << "<Rule name='Hypoxia' node='BloodChemistry_Oxygen_Saturation' below='0.9'/>"
+          << "<Rule name='NoThreshold' node='Cardiovascular_HeartRate'/>"
+          << "<Rule node='Cardiovascular_HeartRate' above='1'/>"
+          << "</AlarmRules>";
+   }
+
+   std::vector<AlarmEngine::Rule> rules;
+   CHECK(AlarmEngine::LoadRules(file, rules));
+   CHECK(rules.size() == 2);
+   if (rules.size() == 2) {
+      CHECK(rules[0].name == "Tachycardia" && rules[0].above && rules[0].threshold == 120.0 &&
+            rules[0].clear == 110.0 && rules[0].duration == 5.0);
+      // clear defaults to the threshold
+      CHECK(rules[1].name == "Hypoxia" && !rules[1].above && rules[1].threshold == 0.9 && rules[1].clear == 0.9 &&
+            rules[1].duration == 0.0);
+   }
+
+   CHECK(!AlarmEngine::LoadRules((dir / "missing.xml").string(), rules));
+}
+
+int main() {
+   fs::path dir = fs::temp_directory_path() / fs::unique_path("amm_alarm_test_%%%%%%%%");
+   fs::create_directories(dir);
+
+   test_raise_and_clear_with_hysteresis();
+   test_below_rule_needs_duration();
+   test_rules_are_independent();
+   test_reset_clears_active();
+   test_load_rules(dir);
+
+   fs::remove_all(dir);
+   return TEST_RESULT();
+}
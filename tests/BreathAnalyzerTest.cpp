@@ -0,0 +1,106 @@
+#include <cmath>
+
+#include "AMM/BreathAnalyzer.h"
+
+#include "TestCheck.h"
+
+using AMM::BreathAnalyzer;
+
+namespace {
+   const double Pi = 3.14159265358979323846;
+   // The engine's timestep
+   const double Step = 0.02;
+   const double Baseline = 2300.0;
+
+   // Half-sine inspiratory and expiratory flow in mL/s, each moving tidalVolume
+   struct Waveform {
+      double tidalVolume;
+      double inspiration;
+      double expiration;
+      // Added to every other sample, mL
+      double noise;
+
+      double Flow(double t) const {
+         double phase = std::fmod(t, inspiration + expiration);
+         if (phase < inspiration) {
+            return tidalVolume * Pi / (2 * inspiration) * std::sin(Pi * phase / inspiration);
+         }
+         phase -= inspiration;
+         return -tidalVolume * Pi / (2 * expiration) * std::sin(Pi * phase / expiration);
+      }
+   };
+
+   // Integrates the flow into the lung volume the analyzer follows; returns the breaths it completed
+   int run(BreathAnalyzer &analyzer, const Waveform &waveform, double seconds) {
+      int breaths = 0;
+      double volume = Baseline;
+      int steps = static_cast<int>(std::round(seconds / Step));
+      for (int i = 0; i <= steps; ++i) {
+         double t = i * Step;
+         double sampled = volume + (i % 2 == 0 ? waveform.noise : -waveform.noise);
+         if (analyzer.Sample(t, sampled)) {
+            ++breaths;
+         }
+         volume += waveform.Flow(t + Step / 2) * Step;
+      }
+      return breaths;
+   }
+}
+
+static void test_tidal_volume_ie_and_minute_ventilation() {
+   // 500 mL at 1:2, 3.6s a breath
+   Waveform waveform{500.0, 1.2, 2.4, 0.0};
+   BreathAnalyzer analyzer;
+   CHECK(analyzer.GetTidalVolume() == 0.0);
+
+   // The first trough starts the first breath, so five breaths complete four
+   int breaths = run(analyzer, waveform, 5 * 3.6 + 0.5);
+   CHECK(breaths == 4);
+   CHECK_NEAR(analyzer.GetTidalVolume(), 500.0, 0.5);
+   CHECK_NEAR(analyzer.GetIERatio(), 0.5, 0.02);
+   CHECK_NEAR(analyzer.GetMinuteVentilation(), 500.0 * 60.0 / 3.6, 10.0);
+   // Past the default full chest rise
+   CHECK(analyzer.GetChestRisePercent() == 100.0);
+}
+
+static void test_shallow_fast_breathing() {
+   // 150 mL at 1:1, 2s a breath
+   Waveform waveform{150.0, 1.0, 1.0, 0.0};
+   BreathAnalyzer analyzer(1.0, 300.0);
+   int breaths = run(analyzer, waveform, 10 * 2.0 + 0.5);
+   CHECK(breaths == 9);
+   CHECK_NEAR(analyzer.GetTidalVolume(), 150.0, 0.5);
+   CHECK_NEAR(analyzer.GetIERatio(), 1.0, 0.03);
+   CHECK_NEAR(analyzer.GetMinuteVentilation(), 150.0 * 30.0, 10.0);
+   CHECK_NEAR(analyzer.GetChestRisePercent(), 50.0, 0.2);
+}
+
+static void test_noise_below_threshold_is_ignored() {
+   Waveform clean{500.0, 1.2, 2.4, 0.0};
+   Waveform noisy{500.0, 1.2, 2.4, 0.3};
+   BreathAnalyzer cleanAnalyzer;
+   BreathAnalyzer noisyAnalyzer;
+   CHECK(run(noisyAnalyzer, noisy, 5 * 3.6 + 0.5) == run(cleanAnalyzer, clean, 5 * 3.6 + 0.5));
+   CHECK_NEAR(noisyAnalyzer.GetTidalVolume(), 500.0, 1.5);
+   CHECK_NEAR(noisyAnalyzer.GetIERatio(), 0.5, 0.05);
+}
+
+static void test_reset_forgets_the_last_breath() {
+   Waveform waveform{500.0, 1.2, 2.4, 0.0};
+   BreathAnalyzer analyzer;
+   run(analyzer, waveform, 3 * 3.6 + 0.5);
+   CHECK(analyzer.GetTidalVolume() > 0.0);
+   analyzer.Reset();
+   CHECK(analyzer.GetTidalVolume() == 0.0);
+   CHECK(analyzer.GetIERatio() == 0.0);
+   CHECK(analyzer.GetMinuteVentilation() == 0.0);
+   CHECK(analyzer.GetChestRisePercent() == 0.0);
+}
+
+int main() {
+   test_tidal_volume_ie_and_minute_ventilation();
+   test_shallow_fast_breathing();
+   test_noise_below_threshold_is_ignored();
+   test_reset_forgets_the_last_breath();
+   return TEST_RESULT();
+}
@@ -0,0 +1,179 @@
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "AMM/ColumnarFile.h"
+
+#include "TestCheck.h"
+
+namespace fs = boost::filesystem;
+
+// rows x columns, keyed by time in the first column
+static std::vector<double> make_rows(uint32_t rows, uint32_t columns, double start, double step) {
+   std::vector<double> values;
+   for (uint32_t r = 0; r < rows; ++r) {
+      values.push_back(start + r * step);
+      for (uint32_t c = 1; c < columns; ++c) {
+         values.push_back(r * 100.0 + c + start);
+      }
+   }
+   return values;
+}
+
+static void append(std::vector<double> &to, const std::vector<double> &from) {
+   to.insert(to.end(), from.begin(), from.end());
+}
+
+// Two tables with interleaved chunks, as the recorder writes them
+static void write_session(const std::string &file, std::vector<double> &fast, std::vector<double> &slow,
+                          bool close) {
+   AMM::ColumnarWriter writer;
+   CHECK(writer.Open(file));
+   CHECK(writer.IsOpen());
+   uint32_t fastTable = writer.AddTable("physiology_50Hz", {"time", "HR", "MAP"});
+   uint32_t slowTable = writer.AddTable("physiology_1Hz", {"time", "SpO2"});
+   CHECK(fastTable == 0 && slowTable == 1);
+
+   fast.clear();
+   slow.clear();
+   for (int chunk = 0; chunk < 4; ++chunk) {
+      std::vector<double> fastRows = make_rows(50, 3, chunk, 0.02);
+      std::vector<double> slowRows = make_rows(1, 2, chunk, 1.0);
+      CHECK(writer.WriteChunk(fastTable, fastRows.data(), 50));
+      CHECK(writer.WriteChunk(slowTable, slowRows.data(), 1));
+      append(fast, fastRows);
+      append(slow, slowRows);
+   }
+   // Nothing is written for an empty chunk or an unknown table
+   CHECK(!writer.WriteChunk(fastTable, fast.data(), 0));
+   CHECK(!writer.WriteChunk(7, fast.data(), 1));
+   if (close) {
+      CHECK(writer.Close());
+      CHECK(!writer.IsOpen());
+   }
+}
+
+static void check_session(AMM::ColumnarReader &reader, const std::vector<double> &fast,
+                          const std::vector<double> &slow) {
+   CHECK(reader.GetTables().size() == 2);
+   CHECK(reader.FindTable("physiology_50Hz") == 0);
+   CHECK(reader.FindTable("physiology_1Hz") == 1);
+   CHECK(reader.FindTable("missing") == -1);
+   CHECK(reader.GetTables()[0].columns == std::vector<std::string>({"time", "HR", "MAP"}));
+   CHECK(reader.GetRowCount(0) == fast.size() / 3);
+   CHECK(reader.GetRowCount(1) == slow.size() / 2);
+
+   std::vector<double> rows;
+   CHECK(reader.ReadTable(0, rows));
+   CHECK(rows == fast);
+   CHECK(reader.ReadTable(1, rows));
+   CHECK(rows == slow);
+
+   std::vector<double> column;
+   CHECK(reader.ReadColumn(0, 2, column));
+   CHECK(column.size() == fast.size() / 3);
+   for (size_t r = 0; r < column.size() && r * 3 + 2 < fast.size(); ++r) {
+      CHECK(column[r] == fast[r * 3 + 2]);
+   }
+   CHECK(!reader.ReadColumn(0, 3, column));
+   CHECK(!reader.ReadTable(2, rows));
+}
+
+static uint64_t read_index_offset(const std::string &file) {
+   std::ifstream in(file, std::ios::binary);
+   uint64_t offset = 0;
+   in.seekg(-static_cast<std::streamoff>(sizeof(offset) + 8), std::ios::end);
+   in.read(reinterpret_cast<char *>(&offset), sizeof(offset));
+   return offset;
+}
+
+static void test_round_trip(const fs::path &dir) {
+   std::string file = (dir / "closed.amm").string();
+   std::vector<double> fast;
+   std::vector<double> slow;
+   write_session(file, fast, slow, true);
+
+   AMM::ColumnarReader reader;
+   CHECK(reader.Open(file));
+   check_session(reader, fast, slow);
+}
+
+static void test_scan_without_index(const fs::path &dir) {
+   std::string file = (dir / "crashed.amm").string();
+   std::vector<double> fast;
+   std::vector<double> slow;
+   write_session(file, fast, slow, true);
+
+   // Everything before the index is what a writer that never closed leaves behind
+   fs::resize_file(file, read_index_offset(file));
+   AMM::ColumnarReader reader;
+   CHECK(reader.Open(file));
+   check_session(reader, fast, slow);
+}
+
+static void test_scan_drops_partial_chunk(const fs::path &dir) {
+   std::string file = (dir / "partial.amm").string();
+   std::vector<double> fast;
+   std::vector<double> slow;
+   write_session(file, fast, slow, true);
+
+   // The last chunk (one slow row) is cut short
+   fs::resize_file(file, read_index_offset(file) - sizeof(double));
+   slow.resize(slow.size() - 2);
+   AMM::ColumnarReader reader;
+   CHECK(reader.Open(file));
+   check_session(reader, fast, slow);
+}
+
+static void test_destructor_writes_index(const fs::path &dir) {
+   std::string file = (dir / "unclosed.amm").string();
+   std::vector<double> fast;
+   std::vector<double> slow;
+   {
+      // The destructor closes, writing the index
+      write_session(file, fast, slow, false);
+   }
+   AMM::ColumnarReader reader;
+   CHECK(reader.Open(file));
+   check_session(reader, fast, slow);
+}
+
+static void test_rejects_other_files(const fs::path &dir) {
+   AMM::ColumnarReader missing;
+   CHECK(!missing.Open((dir / "missing.amm").string()));
+
+   std::string other = (dir / "other.amm").string();
+   {
+      std::ofstream out(other, std::ios::binary);
+      out << "AMMJRNL not columnar";
+   }
+   AMM::ColumnarReader notColumnar;
+   CHECK(!notColumnar.Open(other));
+
+   // The 12 byte header and no tables
+   std::string empty = (dir / "empty.amm").string();
+   {
+      AMM::ColumnarWriter writer;
+      CHECK(writer.Open(empty));
+   }
+   fs::resize_file(empty, 12);
+   AMM::ColumnarReader noTables;
+   CHECK(!noTables.Open(empty));
+}
+
+int main() {
+   fs::path dir = fs::temp_directory_path() / fs::unique_path("amm_columnar_test_%%%%%%%%");
+   fs::create_directories(dir);
+
+   test_round_trip(dir);
+   test_scan_without_index(dir);
+   test_scan_drops_partial_chunk(dir);
+   test_destructor_writes_index(dir);
+   test_rejects_other_files(dir);
+
+   fs::remove_all(dir);
+   return TEST_RESULT();
+}
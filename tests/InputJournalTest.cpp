@@ -0,0 +1,221 @@
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "AMM/InputJournal.h"
+
+#include "TestCheck.h"
+
+namespace fs = boost::filesystem;
+
+using AMM::JournalEntry;
+using AMM::JournalEntryType;
+
+static JournalEntry make_entry(JournalEntryType type, double engineTime, bool scenario) {
+   JournalEntry entry;
+   entry.type = type;
+   entry.engineTime = engineTime;
+   entry.scenario = scenario;
+   return entry;
+}
+
+static bool same_entry(const JournalEntry &a, const JournalEntry &b) {
+   return a.type == b.type && a.engineTime == b.engineTime && a.scenario == b.scenario && a.frame == b.frame &&
+          a.time == b.time && a.control == b.control && a.first == b.first && a.second == b.second;
+}
+
+// One of every entry type, in the order a session could have taken them
+static std::vector<JournalEntry> make_session() {
+   std::vector<JournalEntry> entries;
+
+   JournalEntry tick = make_entry(JournalEntryType::TICK, 0.0, false);
+   tick.frame = 1;
+   tick.time = 0.02;
+   entries.push_back(tick);
+
+   JournalEntry control = make_entry(JournalEntryType::SIMULATION_CONTROL, 0.02, false);
+   control.control = 1;
+   control.frame = 1234567890123ull;
+   entries.push_back(control);
+
+   JournalEntry command = make_entry(JournalEntryType::COMMAND, 0.02, true);
+   command.first = "[SYS]REWIND:30";
+   command.second = "01.0f.aa.bb|0.0.1.3";
+   entries.push_back(command);
+
+   JournalEntry modification = make_entry(JournalEntryType::PHYSIOLOGY_MODIFICATION, 0.04, true);
+   modification.first = "biogears";
+   modification.second = "<Action xsi:type=\"HemorrhageData\"/>";
+   entries.push_back(modification);
+
+   // Empty strings and embedded zero bytes survive
+   JournalEntry instrument = make_entry(JournalEntryType::INSTRUMENT_DATA, 0.04, false);
+   instrument.first = "";
+   instrument.second = std::string("a\0b", 3);
+   entries.push_back(instrument);
+
+   JournalEntry configuration = make_entry(JournalEntryType::MODULE_CONFIGURATION, 0.06, false);
+   configuration.first = "physiology_engine";
+   configuration.second = std::string(100000, 'x');
+   entries.push_back(configuration);
+
+   for (uint64_t frame = 2; frame < 50; ++frame) {
+      JournalEntry next = make_entry(JournalEntryType::TICK, frame * 0.02, false);
+      next.frame = frame;
+      next.time = frame * 0.02;
+      entries.push_back(next);
+   }
+   return entries;
+}
+
+static void test_entry_round_trip() {
+   std::stringstream stream;
+   std::vector<JournalEntry> entries = make_session();
+   for (const auto &entry : entries) {
+      AMM::WriteJournalEntry(stream, entry);
+   }
+
+   JournalEntry read;
+   for (const auto &entry : entries) {
+      CHECK(AMM::ReadJournalEntry(stream, read));
+      CHECK(same_entry(entry, read));
+   }
+   CHECK(!AMM::ReadJournalEntry(stream, read));
+}
+
+static void test_journal_replays_in_recorded_order(const fs::path &dir) {
+   std::string file = (dir / "session.journal").string();
+   std::vector<JournalEntry> entries = make_session();
+   {
+      AMM::InputJournal journal;
+      CHECK(journal.Open(file, "./states/StandardMale@0s.xml"));
+      CHECK(journal.IsOpen());
+      for (const auto &entry : entries) {
+         journal.Record(entry);
+      }
+      journal.Close();
+      CHECK(!journal.IsOpen());
+      // Recording after closing is dropped
+      journal.Record(entries.front());
+   }
+
+   AMM::JournalReader reader;
+   CHECK(reader.Open(file));
+   CHECK(reader.GetStateFile() == "./states/StandardMale@0s.xml");
+   JournalEntry read;
+   size_t count = 0;
+   while (reader.Next(read)) {
+      CHECK(count < entries.size() && same_entry(entries[count], read));
+      ++count;
+   }
+   CHECK(count == entries.size());
+
+   // Two readers of the same journal see the same inputs
+   AMM::JournalReader first;
+   AMM::JournalReader second;
+   CHECK(first.Open(file) && second.Open(file));
+   JournalEntry a;
+   JournalEntry b;
+   bool more = true;
+   while (more) {
+      bool hasA = first.Next(a);
+      bool hasB = second.Next(b);
+      CHECK(hasA == hasB);
+      CHECK(!hasA || same_entry(a, b));
+      more = hasA && hasB;
+   }
+}
+
+static void test_empty_journal(const fs::path &dir) {
+   std::string file = (dir / "empty.journal").string();
+   {
+      AMM::InputJournal journal;
+      CHECK(journal.Open(file, ""));
+   }
+   AMM::JournalReader reader;
+   CHECK(reader.Open(file));
+   CHECK(reader.GetStateFile().empty());
+   JournalEntry read;
+   CHECK(!reader.Next(read));
+}
+
+static void test_truncated_journal(const fs::path &dir) {
+   std::string file = (dir / "truncated.journal").string();
+   std::vector<JournalEntry> entries = make_session();
+   {
+      AMM::InputJournal journal;
+      CHECK(journal.Open(file, "state.xml"));
+      for (const auto &entry : entries) {
+         journal.Record(entry);
+      }
+   }
+
+   // A session that crashed mid-write leaves part of its last entry
+   uintmax_t size = fs::file_size(file);
+   fs::resize_file(file, size - 3);
+
+   AMM::JournalReader reader;
+   CHECK(reader.Open(file));
+   JournalEntry read;
+   size_t count = 0;
+   while (reader.Next(read)) {
+      CHECK(same_entry(entries[count], read));
+      ++count;
+   }
+   CHECK(count == entries.size() - 1);
+}
+
+static void test_rejects_other_files(const fs::path &dir) {
+   std::string missing = (dir / "missing.journal").string();
+   AMM::JournalReader reader;
+   CHECK(!reader.Open(missing));
+
+   std::string other = (dir / "other.journal").string();
+   {
+      std::ofstream out(other, std::ios::binary);
+      out << "AMMCOLS this is not a journal";
+   }
+   AMM::JournalReader notJournal;
+   CHECK(!notJournal.Open(other));
+
+   // Same magic, a version this build does not read
+   std::string future = (dir / "future.journal").string();
+   {
+      AMM::InputJournal journal;
+      CHECK(journal.Open(future, "state.xml"));
+   }
+   {
+      std::fstream patch(future, std::ios::binary | std::ios::in | std::ios::out);
+      patch.seekp(8);
+      uint32_t version = AMM::InputJournal::FormatVersion + 1;
+      patch.write(reinterpret_cast<const char *>(&version), sizeof(version));
+   }
+   AMM::JournalReader newer;
+   CHECK(!newer.Open(future));
+}
+
+static void test_unknown_entry_type() {
+   std::stringstream stream;
+   JournalEntry entry = make_entry(static_cast<JournalEntryType>(99), 1.0, false);
+   AMM::WriteJournalEntry(stream, entry);
+   JournalEntry read;
+   CHECK(!AMM::ReadJournalEntry(stream, read));
+}
+
+int main() {
+   fs::path dir = fs::temp_directory_path() / fs::unique_path("amm_journal_test_%%%%%%%%");
+   fs::create_directories(dir);
+
+   test_entry_round_trip();
+   test_journal_replays_in_recorded_order(dir);
+   test_empty_journal(dir);
+   test_truncated_journal(dir);
+   test_rejects_other_files(dir);
+   test_unknown_entry_type();
+
+   fs::remove_all(dir);
+   return TEST_RESULT();
+}
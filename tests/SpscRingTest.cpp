@@ -0,0 +1,90 @@
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "AMM/SpscRing.h"
+
+#include "TestCheck.h"
+
+static void test_capacity() {
+   CHECK(AMM::SpscRing<int>(1000).Capacity() == 1024);
+   CHECK(AMM::SpscRing<int>(1024).Capacity() == 1024);
+   CHECK(AMM::SpscRing<int>(1).Capacity() == 1);
+}
+
+static void test_push_pop() {
+   AMM::SpscRing<int> ring(4);
+   CHECK(ring.Empty());
+   int value = 0;
+   CHECK(!ring.TryPop(value));
+
+   for (int i = 0; i < 4; ++i) {
+      CHECK(ring.TryPush(i));
+   }
+   CHECK(ring.Size() == 4);
+   CHECK(!ring.TryPush(4));
+
+   for (int i = 0; i < 4; ++i) {
+      CHECK(ring.TryPop(value));
+      CHECK(value == i);
+   }
+   CHECK(ring.Empty());
+}
+
+static void test_blocks_are_all_or_nothing() {
+   AMM::SpscRing<int> ring(8);
+   int block[5] = {1, 2, 3, 4, 5};
+   CHECK(ring.TryPush(block, 5));
+   // Three free slots, so a second block of five is refused whole
+   CHECK(!ring.TryPush(block, 5));
+   CHECK(ring.Size() == 5);
+
+   int out[6] = {};
+   CHECK(!ring.TryPop(out, 6));
+   CHECK(ring.TryPop(out, 5));
+   for (int i = 0; i < 5; ++i) {
+      CHECK(out[i] == block[i]);
+   }
+
+   // Wraps around the end of the buffer
+   CHECK(ring.TryPush(block, 5));
+   CHECK(ring.TryPop(out, 5));
+   for (int i = 0; i < 5; ++i) {
+      CHECK(out[i] == block[i]);
+   }
+   CHECK(ring.Empty());
+}
+
+static void test_producer_consumer() {
+   // Blocks of three, as the recorder pushes rows, must come out whole and in order
+   AMM::SpscRing<uint64_t> ring(64);
+   const uint64_t blocks = 200000;
+   std::thread producer([&ring, blocks] {
+      for (uint64_t b = 0; b < blocks; ++b) {
+         uint64_t block[3] = {b, b * 2, b * 3};
+         while (!ring.TryPush(block, 3)) {
+            std::this_thread::yield();
+         }
+      }
+   });
+
+   bool ordered = true;
+   for (uint64_t b = 0; b < blocks; ++b) {
+      uint64_t block[3];
+      while (!ring.TryPop(block, 3)) {
+         std::this_thread::yield();
+      }
+      ordered = ordered && block[0] == b && block[1] == b * 2 && block[2] == b * 3;
+   }
+   producer.join();
+   CHECK(ordered);
+   CHECK(ring.Empty());
+}
+
+int main() {
+   test_capacity();
+   test_push_pop();
+   test_blocks_are_all_or_nothing();
+   test_producer_consumer();
+   return TEST_RESULT();
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cmath>
+#include <iostream>
+
+// Minimal checks for the unit tests: every failure is reported and counted,
+// and main returns TEST_RESULT() so ctest sees a non-zero exit.
+namespace {
+    int testFailures = 0;
+}
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" << std::endl; \
+            ++testFailures; \
+        } \
+    } while (false)
+
+#define CHECK_NEAR(a, b, tolerance) CHECK(std::abs((a) - (b)) <= (tolerance))
+
+#define TEST_RESULT() (testFailures == 0 ? 0 : 1)
@@ -0,0 +1,136 @@
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "AMM/TrendEngine.h"
+
+#include "TestCheck.h"
+
+using AMM::TrendEngine;
+
+typedef std::vector<std::pair<std::string, double>> Trends;
+
+static bool find_trend(const Trends &trends, const std::string &name, double &value) {
+   for (const auto &trend : trends) {
+      if (trend.first == name) {
+         value = trend.second;
+         return true;
+      }
+   }
+   return false;
+}
+
+static double trend(const TrendEngine &engine, const std::string &name) {
+   Trends trends;
+   engine.GetTrends(trends);
+   double value = 0.0;
+   CHECK(find_trend(trends, name, value));
+   return value;
+}
+
+// The trended node sits at snapshot position 1, behind one it ignores
+static void sample(TrendEngine &engine, double value) {
+   std::vector<double> snapshot = {-1000.0, value};
+   engine.Sample(snapshot);
+}
+
+static void test_window_evicts_oldest() {
+   TrendEngine engine;
+   CHECK(!engine.IsEnabled());
+   engine.Configure({"HR"}, {1}, {3.0}, 1.0);
+   CHECK(engine.IsEnabled());
+
+   Trends trends;
+   engine.GetTrends(trends);
+   CHECK(trends.empty());
+
+   sample(engine, 1.0);
+   sample(engine, 2.0);
+   sample(engine, 3.0);
+   CHECK_NEAR(trend(engine, "HR_Mean_3s"), 2.0, 1e-9);
+   CHECK(trend(engine, "HR_Min_3s") == 1.0);
+   CHECK(trend(engine, "HR_Max_3s") == 3.0);
+
+   // 1 leaves the window
+   sample(engine, 10.0);
+   CHECK_NEAR(trend(engine, "HR_Mean_3s"), 5.0, 1e-9);
+   CHECK(trend(engine, "HR_Min_3s") == 2.0);
+   CHECK(trend(engine, "HR_Max_3s") == 10.0);
+
+   // So does the maximum, once three newer samples follow it
+   sample(engine, 4.0);
+   sample(engine, 5.0);
+   CHECK(trend(engine, "HR_Max_3s") == 10.0);
+   sample(engine, 6.0);
+   CHECK_NEAR(trend(engine, "HR_Mean_3s"), 5.0, 1e-9);
+   CHECK(trend(engine, "HR_Min_3s") == 4.0);
+   CHECK(trend(engine, "HR_Max_3s") == 6.0);
+
+   engine.Clear();
+   engine.GetTrends(trends);
+   CHECK(trends.empty());
+}
+
+static void test_windows_are_independent() {
+   TrendEngine engine;
+   engine.Configure({"MAP"}, {1}, {2.0, 4.0}, 0.5);
+   for (int i = 1; i <= 10; ++i) {
+      sample(engine, i);
+   }
+   // Four and eight samples of half a second
+   CHECK_NEAR(trend(engine, "MAP_Mean_2s"), 8.5, 1e-9);
+   CHECK_NEAR(trend(engine, "MAP_Mean_4s"), 6.5, 1e-9);
+   CHECK(trend(engine, "MAP_Min_2s") == 7.0);
+   CHECK(trend(engine, "MAP_Min_4s") == 3.0);
+}
+
+static void test_slope_sign() {
+   TrendEngine engine;
+   engine.Configure({"HR"}, {1}, {2.0}, 0.5);
+
+   // A single sample has no slope
+   sample(engine, 60.0);
+   CHECK(trend(engine, "HR_Slope_2s") == 0.0);
+
+   // Rising by 1 every half second
+   for (int i = 1; i <= 6; ++i) {
+      sample(engine, 60.0 + i);
+   }
+   CHECK_NEAR(trend(engine, "HR_Slope_2s"), 2.0, 1e-9);
+
+   // Holding steady flattens it once the rise has left the window
+   for (int i = 0; i < 4; ++i) {
+      sample(engine, 66.0);
+   }
+   CHECK_NEAR(trend(engine, "HR_Slope_2s"), 0.0, 1e-9);
+
+   // Falling turns it negative
+   for (int i = 1; i <= 4; ++i) {
+      sample(engine, 66.0 - 3 * i);
+   }
+   CHECK_NEAR(trend(engine, "HR_Slope_2s"), -6.0, 1e-9);
+}
+
+static void test_sums_stay_exact_over_many_windows() {
+   TrendEngine engine;
+   engine.Configure({"SpO2"}, {1}, {1.0}, 0.02);
+   double value = 0.0;
+   for (int i = 0; i < 100000; ++i) {
+      value = 0.9 + 0.1 * ((i * 7919) % 100) / 100.0;
+      sample(engine, value);
+   }
+   // The last 50 samples, recomputed directly
+   double sum = 0.0;
+   for (int i = 100000 - 50; i < 100000; ++i) {
+      sum += 0.9 + 0.1 * ((i * 7919) % 100) / 100.0;
+   }
+   CHECK_NEAR(trend(engine, "SpO2_Mean_1s"), sum / 50, 1e-12);
+}
+
+int main() {
+   test_window_evicts_oldest();
+   test_windows_are_independent();
+   test_slope_sign();
+   test_sums_stay_exact_over_many_windows();
+   return TEST_RESULT();
+}